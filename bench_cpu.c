@@ -0,0 +1,148 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  bench_cpu.c
+ *
+ *    Description:  Instructions per second of the table and threaded
+ *                  dispatch cores, and the recompiler.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:40 AM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cpu.c"
+#include "memory.h"
+
+#define PROGRAM_ADDR 0x0200
+#define ROM_PROGRAM_ADDR 0x8000
+#define CYCLE_BUDGET 200000000UL
+
+/*
+ * A small loop touching zero page, absolute indexed memory, the ALU and
+ * branches, roughly the instruction mix of a game's main loop.  The
+ * recompiler runs a copy at 0x8000.
+ *
+ * 0200  LDX #$00
+ * 0202  LDA $0300,X
+ * 0205  CLC
+ * 0206  ADC #$01
+ * 0208  STA $0300,X
+ * 020B  STA $10
+ * 020D  LSR A
+ * 020E  AND #$0F
+ * 0210  TAY
+ * 0211  INX
+ * 0212  CPX #$40
+ * 0214  BNE $0202
+ * 0216  JMP $0200
+ */
+static const uint8_t program[] = {
+	0xA2, 0x00,
+	0xBD, 0x00, 0x03,
+	0x18,
+	0x69, 0x01,
+	0x9D, 0x00, 0x03,
+	0x85, 0x10,
+	0x4A,
+	0x29, 0x0F,
+	0xA8,
+	0xE8,
+	0xE0, 0x40,
+	0xD0, 0xEC,
+	0x4C, 0x00, 0x02
+};
+
+/*
+ * Copy the program to addr, pointing its closing JMP back to addr.
+ */
+static struct cpu *setup(struct memory **memory, const uint16_t addr)
+{
+	unsigned int i;
+
+	*memory = MEM_init();
+	for (i = 0; i < sizeof(program); i++) {
+		MEM_write(*memory, addr + i, program[i]);
+	}
+	MEM_write(*memory, addr + sizeof(program) - 2, addr & 0xFF);
+	MEM_write(*memory, addr + sizeof(program) - 1, addr>>8);
+
+	return CPU_init_to_address(*memory, addr);
+}
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+	(void)clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main()
+{
+	struct memory *memory;
+	struct cpu *table_cpu = setup(&memory, PROGRAM_ADDR);
+	struct timespec start;
+	unsigned long cycles = 0;
+	unsigned long instructions = 0;
+
+	/* Table dispatch, one instruction per CPU_step */
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	while (cycles < CYCLE_BUDGET) {
+		const struct decoded_op *op = fetch(table_cpu, memory);
+		op->handler(table_cpu, memory);
+		cycles += table_cpu->cycles;
+		instructions++;
+	}
+	double table_time = seconds_since(&start);
+	MEM_delete(&memory);
+
+	/* Threaded dispatch, all in one run */
+	struct cpu *threaded_cpu = setup(&memory, PROGRAM_ADDR);
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	unsigned long threaded_cycles = run_threaded(threaded_cpu, memory, CYCLE_BUDGET);
+	double threaded_time = seconds_since(&start);
+	MEM_delete(&memory);
+
+	/* Recompiled, which only compiles ROM code */
+	struct cpu *jit_cpu = setup(&memory, ROM_PROGRAM_ADDR);
+	if (CPU_enable_jit(jit_cpu, 1) == 0) {
+		(void)printf("Recompiler not available\n");
+		return 1;
+	}
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	unsigned long jit_cycles = CPU_run(jit_cpu, memory, CYCLE_BUDGET);
+	double jit_time = seconds_since(&start);
+	MEM_delete(&memory);
+
+	(void)printf("%lu instructions, %lu cycles\n", instructions, cycles);
+	(void)printf("table dispatch:    %.3f s, %.1f M instructions/s\n", table_time, instructions / table_time / 1e6);
+	(void)printf("threaded dispatch: %.3f s, %.1f M instructions/s\n", threaded_time, instructions / threaded_time / 1e6);
+	(void)printf("recompiled:        %.3f s, %.1f M instructions/s\n", jit_time, instructions / jit_time / 1e6);
+
+	if (threaded_cycles != cycles || threaded_cpu->PC != table_cpu->PC ||
+			threaded_cpu->A != table_cpu->A || threaded_cpu->X != table_cpu->X ||
+			threaded_cpu->Y != table_cpu->Y || CPU_get_status(threaded_cpu) != CPU_get_status(table_cpu)) {
+		(void)printf("Cores disagree!\n");
+		return 1;
+	}
+	if (jit_cycles != cycles || jit_cpu->PC - ROM_PROGRAM_ADDR != table_cpu->PC - PROGRAM_ADDR ||
+			jit_cpu->A != table_cpu->A || jit_cpu->X != table_cpu->X ||
+			jit_cpu->Y != table_cpu->Y || CPU_get_status(jit_cpu) != CPU_get_status(table_cpu)) {
+		(void)printf("Recompiler disagrees!\n");
+		return 1;
+	}
+
+	CPU_delete(&table_cpu);
+	CPU_delete(&threaded_cpu);
+	CPU_delete(&jit_cpu);
+	return 0;
+}
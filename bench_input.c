@@ -0,0 +1,80 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  bench_input.c
+ *
+ *    Description:  Host time taken by input handling per frame, polled once
+ *                  per CPU instruction, and once a frame.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:20:37 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+
+#include "input_processor.h"
+#include "controller.h"
+
+#define FRAMES 600UL	// 10 seconds of NES time
+
+// A frame is 29781 CPU cycles, at about 3 cycles an instruction
+#define INSTRUCTIONS_PER_FRAME 10000UL
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+	(void)clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double bench(const char *name, const unsigned long calls_per_frame)
+{
+	struct controller *controller = CONTROLLER_init();
+	const uint8_t *keys;
+	struct input_processor *processor = INPUT_init(&keys);
+	struct timespec start;
+	int nes_state = 1;
+	unsigned long i;
+	double seconds;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAMES * calls_per_frame; i++) {
+		INPUT_poll(processor, &keys);
+		INPUT_process(processor, controller, &nes_state);
+	}
+	seconds = seconds_since(&start);
+	(void)printf("%-16s %10.2f us/frame  (%lu polls a frame)\n", name, seconds * 1e6 / FRAMES, calls_per_frame);
+
+	INPUT_delete(&processor);
+	CONTROLLER_delete(&controller);
+	return seconds;
+}
+
+int main()
+{
+	double per_instruction;
+	double per_frame;
+
+	// Events come from a real window, if there is a display
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow("bench_input", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 256, 240, SDL_WINDOW_SHOWN);
+
+	per_instruction = bench("per instruction", INSTRUCTIONS_PER_FRAME);
+	per_frame = bench("per frame", 1);
+	(void)printf("saved %.2f ms of every 16.64 ms frame\n", (per_instruction - per_frame) * 1e3 / FRAMES);
+
+	if (window != NULL) {
+		SDL_DestroyWindow(window);
+	}
+	SDL_Quit();
+	return 0;
+}
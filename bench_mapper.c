@@ -0,0 +1,99 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  bench_mapper.c
+ *
+ *    Description:  Time taken by a bank switch, for each mapper, written in a
+ *                  tight loop the way a game writes its mapper registers.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:02:17 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "memory.h"
+#include "ppu_memory.h"
+#include "mapper.h"
+
+#define SWITCHES 10000000UL
+#define PRG_SIZE (16 * 0x4000)
+#define CHR_SIZE (32 * 0x2000)
+
+static uint8_t prg[PRG_SIZE];
+static uint8_t chr[CHR_SIZE];
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+	(void)clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Switch between two banks, so that every switch repoints the windows.
+ * MMC1 is loaded one bit per write, and MMC3 takes a select and a data
+ * write.  The byte read back keeps the switches from being optimized away.
+ */
+static void bench(const char *name, const uint8_t number)
+{
+	struct memory *memory = MEM_init();
+	struct ppu_memory *ppu_memory = PPU_MEM_init();
+	struct mapper *mapper = MAPPER_init(number, memory, ppu_memory, prg, PRG_SIZE, chr, CHR_SIZE, 0);
+	struct timespec start;
+	unsigned long i;
+	unsigned long sum = 0;
+	int bit;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SWITCHES; i++) {
+		uint8_t bank = (i & 1) + 1;
+		switch (number) {
+			case 1:
+				for (bit = 0; bit < 5; bit++) {
+					MEM_write(memory, 0xE000, (bank >> bit) & 1);
+				}
+				break;
+			case 4:
+				MEM_write(memory, 0x8000, 6);
+				MEM_write(memory, 0x8001, bank);
+				break;
+			default:
+				MEM_write(memory, 0x8000, bank);
+		}
+		sum += MEM_read(memory, 0x8000) + PPU_MEM_read(ppu_memory, 0x0000);
+	}
+	double time = seconds_since(&start);
+
+	(void)printf("%-6s %6.1f ns per bank switch (%lu)\n", name, time * 1e9 / SWITCHES, sum);
+
+	MAPPER_delete(&mapper);
+	PPU_MEM_delete(&ppu_memory);
+	MEM_delete(&memory);
+}
+
+int main()
+{
+	unsigned long i;
+
+	for (i = 0; i < PRG_SIZE; i++) {
+		prg[i] = i >> 13;
+	}
+	for (i = 0; i < CHR_SIZE; i++) {
+		chr[i] = i >> 10;
+	}
+
+	bench("UxROM", 2);
+	bench("CNROM", 3);
+	bench("MMC1", 1);
+	bench("MMC3", 4);
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  bench_ppu.c
+ *
+ *    Description:  Time taken by the PPU to run a frame with rendering on,
+ *                  dot by dot, a tile at a time, and a line at a time.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:40 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ppu.h"
+#include "ppu_memory.h"
+#include "palette.h"
+
+#define FRAMES 2000UL
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+	(void)clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Run whole frames of random tiles and sprites, with both shown.
+ * The checksum of the last frame keeps the drawing from being optimized
+ * away, and should be the same for every renderer.
+ */
+static void bench(const char *name, const int step, const int scanlines)
+{
+	struct ppu_memory *ppu_memory = PPU_MEM_init();
+	struct ppu *ppu = PPU_init();
+	const uint8_t *pixels = PPU_framebuffer(ppu);
+	struct timespec start;
+	unsigned long frames = step ? FRAMES / 10 : FRAMES;
+	unsigned long sum = 0;
+	unsigned long i;
+	uint32_t dot;
+
+	srand(1);
+	for (i = 0; i < 0x3000; i++) {
+		PPU_MEM_write(ppu_memory, i, rand());
+	}
+	PPU_write_register(ppu, OAMADDR_ADDR, 0);
+	for (i = 0; i < 256; i++) {
+		PPU_write_register(ppu, OAMDATA_ADDR, rand());
+	}
+	(void)PPU_enable_scanline_renderer(ppu, scanlines);
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x1E);
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < frames; i++) {
+		if (step) {
+			for (dot = 0; dot < PPU_DOTS_PER_FRAME; dot++) {
+				(void)PPU_step(ppu, ppu_memory);
+			}
+		} else {
+			(void)PPU_run(ppu, ppu_memory, PPU_DOTS_PER_FRAME);
+		}
+	}
+	double time = seconds_since(&start);
+
+	for (i = 0; i < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; i++) {
+		sum = sum * 31 + pixels[i];
+	}
+	(void)printf("%-10s %8.1f us per frame (%lx)\n", name, time * 1e6 / frames, sum);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+}
+
+/*
+ * Convert a frame of random palette RAM indexes to the given format, with
+ * every emphasis bit set.
+ */
+static void bench_palette(const char *name, const int format)
+{
+	struct palette *palette = PALETTE_init(format);
+	int pitch = PPU_SCREEN_WIDTH * PALETTE_bytes_per_pixel(palette);
+	uint8_t *pixels = malloc(pitch * PPU_SCREEN_HEIGHT);
+	uint8_t framebuffer[PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT];
+	uint8_t palette_ram[PALETTE_RAM_SIZE];
+	uint8_t masks[PPU_SCREEN_HEIGHT];
+	struct timespec start;
+	unsigned long sum = 0;
+	unsigned long i;
+
+	srand(1);
+	for (i = 0; i < sizeof(framebuffer); i++) {
+		framebuffer[i] = rand() % PALETTE_RAM_SIZE;
+	}
+	for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+		palette_ram[i] = rand() % 64;
+	}
+	memset(masks, 0xE0, sizeof(masks));
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < FRAMES; i++) {
+		PALETTE_convert(palette, framebuffer, palette_ram, masks, pixels, pitch);
+	}
+	double time = seconds_since(&start);
+
+	for (i = 0; i < (unsigned long)pitch * PPU_SCREEN_HEIGHT; i++) {
+		sum = sum * 31 + pixels[i];
+	}
+	(void)printf("%-10s %8.1f us per frame (%lx)\n", name, time * 1e6 / FRAMES, sum);
+
+	free(pixels);
+	PALETTE_delete(&palette);
+}
+
+int main()
+{
+	bench("dots", 1, 0);
+	bench("tiles", 0, 0);
+	bench("scanlines", 0, 1);
+	bench_palette("argb8888", PALETTE_ARGB8888);
+	bench_palette("rgb565", PALETTE_RGB565);
+	bench_palette("rgb24", PALETTE_RGB24);
+	return 0;
+}
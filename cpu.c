@@ -18,10 +18,16 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "cpu.h"
 #include "memory.h"
+#include "jit.h"
+
+#if defined(CPU_THREADED) && !defined(__GNUC__)
+#error "CPU_THREADED requires GCC's labels as values"
+#endif
 
 /* 
  * Flags, from left to right:
@@ -39,15 +45,41 @@
 #define Z_FLAG 1<<1
 #define C_FLAG 1<<0
 
+/*
+ * An instruction as decoded from memory.  Instructions are decoded the first
+ * time they are executed and cached by address, see fetch().
+ */
+struct decoded_op {
+	void (*handler)(struct cpu *, struct memory *);
+	uint16_t operand;	/* operand bytes, low byte first */
+	uint8_t opcode;
+	uint8_t valid;
+	uint8_t loop;	/* starts a loop that run_loop may skip, LOOP_* */
+};
+
 struct cpu {
 	uint16_t PC;	/* program counter */
 	uint16_t S;	/* stack pointer */
 	uint8_t A;	/* accumulator */
 	uint8_t X;	/* X index */
 	uint8_t Y;	/* Y index */
-	uint8_t P;	/* processor status flags */
+	uint8_t P;	/* processor status flags, apart from N, Z, C and V */
+
+	/* N, Z, C and V, as the values they are worked out from */
+	uint8_t n_result;	/* N is bit 7 */
+	uint8_t z_result;	/* Z is set when this is 0 */
+	uint8_t c;	/* C, 0 or 1 */
+	uint8_t v_a;	/* V is set when v_a + v_b = v_result overflows */
+	uint8_t v_b;
+	uint8_t v_result;
 
 	uint8_t cycles;	/* Holds the number of cycles needed for the current instruction */
+	uint32_t run_budget;	/* CPU_run stops once this many cycles are used */
+	uint32_t run_cycles;	/* cycles used by CPU_run before the current instruction */
+
+	uint16_t operand;	/* operand bytes of the current instruction */
+	struct decoded_op *code_cache;	/* decoded instructions, indexed by address */
+	struct jit *jit;	/* recompiler for hot ROM code, NULL when disabled */
 };
 
 /* Stack manipulation */
@@ -129,6 +161,24 @@ inline uint8_t CPU_pop8_mem(struct cpu *cpu, struct memory *memory)
 	return val;
 }
 
+/*
+ * Operand fetches.  These return the operand bytes of the current
+ * instruction, which were read from memory when it was decoded.
+ */
+inline uint16_t CPU_pop16_operand(struct cpu *cpu)
+{
+	cpu->PC += 2;
+	return cpu->operand;
+}
+
+inline uint8_t CPU_pop8_operand(struct cpu *cpu)
+{
+	uint8_t val = cpu->operand;
+	cpu->operand >>= 8;
+	cpu->PC++;
+	return val;
+}
+
 /* CPU Instructions */
 
 /* Opcodes are endoded in one of the following bit sequences:
@@ -200,19 +250,19 @@ inline uint16_t imm(struct cpu *cpu)
 	return cpu->PC++;
 }
 
-inline uint16_t zero_pg(struct cpu *cpu, struct memory *memory)
+inline uint16_t zero_pg(struct cpu *cpu)
 {
-	return (uint16_t)CPU_pop8_mem(cpu, memory);
+	return (uint16_t)CPU_pop8_operand(cpu);
 }
 
-inline uint16_t abs_(struct cpu *cpu, struct memory *memory)
+inline uint16_t abs_(struct cpu *cpu)
 {
-	return CPU_pop16_mem(cpu, memory);
+	return CPU_pop16_operand(cpu);
 }
 
 inline uint16_t ind_x(struct cpu *cpu, struct memory *memory)
 {
-	uint8_t addr_of_low = CPU_pop8_mem(cpu, memory) + cpu->X;
+	uint8_t addr_of_low = CPU_pop8_operand(cpu) + cpu->X;
 	uint16_t low = MEM_read(memory, addr_of_low);
 	// Need cast to uint8_t for zero page wrap around
 	uint16_t high = MEM_read(memory, (uint8_t)(addr_of_low + 1))<<8;
@@ -228,7 +278,7 @@ inline uint16_t ind_x(struct cpu *cpu, struct memory *memory)
  */
 inline uint16_t ind_y(struct cpu *cpu, struct memory *memory)
 {
-	uint8_t addr_of_low = CPU_pop8_mem(cpu, memory);
+	uint8_t addr_of_low = CPU_pop8_operand(cpu);
 	uint16_t low = MEM_read(memory, addr_of_low);
 	// Need cast to uint8_t for zero page wrap around
 	uint16_t high = MEM_read(memory, (uint8_t)(addr_of_low + 1))<<8;
@@ -247,8 +297,8 @@ inline uint16_t ind(struct cpu *cpu, struct memory *memory)
 	// Indirect functions with a bug in the 6502, where the high byte of the
 	// destination address is calculated only after individually incrementing
 	// the low byte of the destination address, which might wrap around
-	uint8_t low_byte_of_low_addr = CPU_pop8_mem(cpu, memory);
-	uint16_t high_byte_of_low_addr = CPU_pop8_mem(cpu, memory)<<8;
+	uint8_t low_byte_of_low_addr = CPU_pop8_operand(cpu);
+	uint16_t high_byte_of_low_addr = CPU_pop8_operand(cpu)<<8;
 	uint16_t low = MEM_read(memory, high_byte_of_low_addr | low_byte_of_low_addr);
 	uint16_t high;
 	if (low_byte_of_low_addr == 0xFF) {
@@ -266,9 +316,9 @@ inline uint16_t ind(struct cpu *cpu, struct memory *memory)
  * instruction, the instruction should set the number of cycles after
  * calling this function.
  */
-inline uint16_t abs_y(struct cpu *cpu, struct memory *memory)
+inline uint16_t abs_y(struct cpu *cpu)
 {
-	uint16_t a = CPU_pop16_mem(cpu, memory);
+	uint16_t a = CPU_pop16_operand(cpu);
 	uint16_t sum = a + cpu->Y;
 
 	if (a>>8 != sum>>8) {
@@ -285,9 +335,9 @@ inline uint16_t abs_y(struct cpu *cpu, struct memory *memory)
  * instruction, the instruction should set the number of cycles after
  * calling this function.
  */
-inline uint16_t abs_x(struct cpu *cpu, struct memory *memory)
+inline uint16_t abs_x(struct cpu *cpu)
 {
-	uint16_t a = CPU_pop16_mem(cpu, memory);
+	uint16_t a = CPU_pop16_operand(cpu);
 	uint16_t sum = a + cpu->X;
 
 	if (a>>8 != sum>>8) {
@@ -297,9 +347,9 @@ inline uint16_t abs_x(struct cpu *cpu, struct memory *memory)
 	return sum;
 }
 
-inline uint16_t zero_pg_x(struct cpu *cpu, struct memory *memory)
+inline uint16_t zero_pg_x(struct cpu *cpu)
 {
-	uint16_t addr = (uint16_t)CPU_pop8_mem(cpu, memory);
+	uint16_t addr = (uint16_t)CPU_pop8_operand(cpu);
 	uint16_t zero_pg_addr = addr + cpu->X;
 	// Wrap around to stay within the zero page
 	if (zero_pg_addr >= 0x100) {
@@ -308,9 +358,9 @@ inline uint16_t zero_pg_x(struct cpu *cpu, struct memory *memory)
 	return zero_pg_addr;
 }
 
-inline uint16_t zero_pg_y(struct cpu *cpu, struct memory *memory)
+inline uint16_t zero_pg_y(struct cpu *cpu)
 {
-	uint16_t addr = (uint16_t)CPU_pop8_mem(cpu, memory);
+	uint16_t addr = (uint16_t)CPU_pop8_operand(cpu);
 	uint16_t zero_pg_addr = addr + cpu->Y;
 	// Wrap around to stay within the zero page
 	if (zero_pg_addr >= 0x100) {
@@ -321,6 +371,11 @@ inline uint16_t zero_pg_y(struct cpu *cpu, struct memory *memory)
 
 /*
  * setting/clearing/testing status flags
+ *
+ * N, Z, C and V are not kept in cpu->P.  Instead, the values they come from
+ * are recorded, and the flags are only worked out when something reads
+ * them.  get_status() packs them into the P register for pushes and
+ * debugging, and set_status() unpacks it.
  */
 inline uint8_t status_flag_is_set(const struct cpu *cpu, const uint8_t flag)
 {
@@ -331,6 +386,7 @@ inline uint8_t status_flag_is_set(const struct cpu *cpu, const uint8_t flag)
 	return 0;
 }
 
+/* Only for the flags kept in cpu->P: I, D and B */
 inline void set_status_flag(struct cpu *cpu, const uint8_t flag)
 {
 	cpu->P |= flag;
@@ -344,7 +400,7 @@ inline void clear_status_flag(struct cpu *cpu, const uint8_t flag)
 /* Carry flag */
 inline uint8_t CPU_carry_flag_is_set(const struct cpu *cpu)
 {
-	return status_flag_is_set(cpu, C_FLAG);
+	return cpu->c;
 }
 
 /*
@@ -352,110 +408,79 @@ inline uint8_t CPU_carry_flag_is_set(const struct cpu *cpu)
  */
 inline void CPU_set_carry_flag_on_add(struct cpu *cpu, const uint8_t a, const uint8_t b)
 {
-	/* if carry flag is zero, check if a + b > 0xff.
-	 * Otherwise, check if a + b >= 0xff. */
-	if (CPU_carry_flag_is_set(cpu) == 0) {
-		if (a > 0xff - b) {
-			set_status_flag(cpu, C_FLAG);
-		} else {
-			clear_status_flag(cpu, C_FLAG);
-		}
-	} else {
-		if (a >= 0xff - b) {
-			set_status_flag(cpu, C_FLAG);
-		} else {
-			clear_status_flag(cpu, C_FLAG);
-		}
-	}
+	cpu->c = (a + b + cpu->c) >> 8;
 }
 
 /*
- * Manipulate the carry flag based on an SBC operation
+ * Manipulate the carry flag based on an SBC operation.  The carry is clear
+ * if a - b, less one when the carry is already clear, borrows.
  */
 inline void CPU_set_carry_flag_on_sub(struct cpu *cpu, const uint8_t a, const uint8_t b)
 {
-	/* If carry flag is set:
-	 * 	If a >= b, set the carry flag.
-	 *	Otherwise clear the carry flag.
-	 * If carry flag is not set:
-	 * 	If a > b, set the carry flag.
-	 * 	Otherwise clear the carry flag.
-	 */
-	if (CPU_carry_flag_is_set(cpu) == 1) {
-		if (a < b) {
-			clear_status_flag(cpu, C_FLAG);
-		}
-	} else {
-		if (a > b) {
-			set_status_flag(cpu, C_FLAG);
-		}
-	}
+	cpu->c = (a - b - (1 - cpu->c)) >= 0;
 }
 
 /* Overflow flag */
 inline uint8_t CPU_overflow_flag_is_set(const struct cpu *cpu)
 {
-	return status_flag_is_set(cpu, V_FLAG);
+	return ((cpu->v_a ^ cpu->v_result) & (cpu->v_b ^ cpu->v_result)) >> 7;
 }
 
 /*
- * Manipulate the overflow flag for an ADC operation.
- * Formula found at
+ * Manipulate the overflow flag for an ADC operation.  Only the operands are
+ * recorded; the flag is worked out in CPU_overflow_flag_is_set with the
+ * formula found at
  * http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
  */
 inline void CPU_set_overflow_flag_for_adc(struct cpu *cpu, const uint8_t a, const uint8_t b, const uint8_t result)
 {
-	if (((a^result) & (b^result) & 0x80) != 0)
-	{
-		set_status_flag(cpu, V_FLAG);
-	} else {
-		clear_status_flag(cpu, V_FLAG);
-	}
+	cpu->v_a = a;
+	cpu->v_b = b;
+	cpu->v_result = result;
 }
 
 /*
- * Manipulate the overflow flag for an SBC operation.
- * Formula found at
- * http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
+ * Manipulate the overflow flag for an SBC operation, which is an ADC of the
+ * complement of b.
  */
 inline void CPU_set_overflow_flag_for_sbc(struct cpu *cpu, const uint8_t a, const uint8_t b, const uint8_t result)
 {
-	if (((a^result) & ((0xff-b)^result) & 0x80) != 0)
-	{
-		set_status_flag(cpu, V_FLAG);
-	} else {
-		clear_status_flag(cpu, V_FLAG);
-	}
+	cpu->v_a = a;
+	cpu->v_b = 0xff - b;
+	cpu->v_result = result;
+}
+
+/*
+ * Set or clear the overflow flag directly, with operands that do or do not
+ * overflow.
+ */
+inline void CPU_set_overflow_flag(struct cpu *cpu, const uint8_t set)
+{
+	cpu->v_a = 0;
+	cpu->v_b = 0;
+	cpu->v_result = set ? 0x80 : 0;
 }
 
 /* Zero flag */
 inline uint8_t CPU_zero_flag_is_set(const struct cpu *cpu)
 {
-	return status_flag_is_set(cpu, Z_FLAG);
+	return cpu->z_result == 0;
 }
 
 inline void CPU_set_zero_flag_for_value(struct cpu *cpu, const uint8_t a)
 {
-	if (a == 0) {
-		set_status_flag(cpu, Z_FLAG);
-	} else {
-		clear_status_flag(cpu, Z_FLAG);
-	}
+	cpu->z_result = a;
 }
 
 /* Negative flag */
 inline uint8_t CPU_negative_flag_is_set(const struct cpu *cpu)
 {
-	return status_flag_is_set(cpu, N_FLAG);
+	return cpu->n_result >> 7;
 }
 
 inline void CPU_set_negative_flag_for_value(struct cpu *cpu, const uint8_t a)
 {
-	if ((a & N_FLAG) == N_FLAG) {
-		set_status_flag(cpu, N_FLAG);
-	} else {
-		clear_status_flag(cpu, N_FLAG);
-	}
+	cpu->n_result = a;
 }
 
 /* Break flag */
@@ -470,6 +495,27 @@ inline uint8_t CPU_interrupt_flag_is_set(const struct cpu *cpu)
 	return status_flag_is_set(cpu, I_FLAG);
 }
 
+/* The whole P register */
+static inline uint8_t get_status(const struct cpu *cpu)
+{
+	uint8_t p = cpu->P & ~(N_FLAG | Z_FLAG | C_FLAG | V_FLAG);
+
+	p |= cpu->n_result & N_FLAG;
+	p |= CPU_zero_flag_is_set(cpu)<<1;
+	p |= CPU_overflow_flag_is_set(cpu)<<6;
+	p |= cpu->c;
+	return p;
+}
+
+static inline void set_status(struct cpu *cpu, const uint8_t p)
+{
+	cpu->P = p;
+	cpu->n_result = p & N_FLAG;
+	cpu->z_result = (p & Z_FLAG) ^ Z_FLAG;
+	cpu->c = p & C_FLAG;
+	CPU_set_overflow_flag(cpu, p & V_FLAG);
+}
+
 /* Common functions for executing instructions */
 inline void ora(uint16_t addr, struct cpu *cpu, struct memory *memory)
 {
@@ -503,11 +549,7 @@ inline void asl(uint16_t addr, struct cpu *cpu, struct memory *memory)
 
 	CPU_set_zero_flag_for_value(cpu, new_val);
 	CPU_set_negative_flag_for_value(cpu, new_val);
-	if((val & N_FLAG) == N_FLAG) {
-		cpu->P |= C_FLAG;
-	} else {
-		cpu->P &= ~(C_FLAG);
-	}
+	cpu->c = high_bit_is_set(val);
 }
 
 inline void slo(uint16_t addr, struct cpu *cpu, struct memory *memory)
@@ -522,17 +564,9 @@ inline void bit(uint16_t addr, struct cpu *cpu, struct memory *memory)
 	uint8_t result = cpu->A & val;
 	CPU_set_zero_flag_for_value(cpu, result);
 	
-	if(bit_is_set(val, 7)) {
-		set_status_flag(cpu, N_FLAG);
-	} else {
-		clear_status_flag(cpu, N_FLAG);
-	}
+	CPU_set_negative_flag_for_value(cpu, val);
 
-	if(bit_is_set(val, 6)) {
-		set_status_flag(cpu, V_FLAG);
-	} else {
-		clear_status_flag(cpu, V_FLAG);
-	}
+	CPU_set_overflow_flag(cpu, bit_is_set(val, 6));
 }
 
 inline void rol(uint16_t addr, struct cpu *cpu, struct memory *memory)
@@ -547,12 +581,7 @@ inline void rol(uint16_t addr, struct cpu *cpu, struct memory *memory)
 	}
 
 	/* shift bit 7 into carry flag */
-	if (high_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = high_bit_is_set(val);
 
 	MEM_write(memory, addr, result);
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -577,12 +606,7 @@ inline void ror(uint16_t addr, struct cpu *cpu, struct memory *memory)
 	}
 
 	/* shift bit 0 into carry flag */
-	if (low_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = low_bit_is_set(val);
 
 	MEM_write(memory, addr, result);
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -595,12 +619,7 @@ inline void lsr(uint16_t addr, struct cpu *cpu, struct memory *memory)
 	uint8_t result = val>>1;
 
 	/* shift old bit 0 into the carry flag */
-	if(low_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = low_bit_is_set(val);
 
 	MEM_write(memory, addr, result);
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -657,11 +676,7 @@ inline void aac(uint16_t addr, struct cpu *cpu, struct memory *memory)
 	CPU_set_zero_flag_for_value(cpu, cpu->A);
 	CPU_set_negative_flag_for_value(cpu, cpu->A);
 
-	if(CPU_negative_flag_is_set(cpu)) {
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = CPU_negative_flag_is_set(cpu);
 }
 
 inline void sbc(uint16_t addr, struct cpu *cpu, struct memory *memory)
@@ -726,11 +741,7 @@ inline void lax(uint16_t addr, struct cpu *cpu, struct memory *memory)
 
 inline void compare(uint8_t a, uint8_t b, struct cpu *cpu)
 {
-	if(a >= b) {
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = a >= b;
 
 	CPU_set_zero_flag_for_value(cpu, a-b);
 	CPU_set_negative_flag_for_value(cpu, a-b);
@@ -797,7 +808,7 @@ void cpu_brk(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 7;
 
 	CPU_push16_stack(cpu, memory, cpu->PC + 2);
-	CPU_push8_stack(cpu, memory, cpu->P | B_FLAG | U_FLAG);
+	CPU_push8_stack(cpu, memory, get_status(cpu) | B_FLAG | U_FLAG);
 
 	set_status_flag(cpu, I_FLAG);
 
@@ -823,7 +834,7 @@ void ora_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	ora(addr, cpu, memory);
 }
 
@@ -835,7 +846,7 @@ void asl_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	asl(addr, cpu, memory);
 }
 
@@ -847,7 +858,7 @@ void php(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	CPU_push8_stack(cpu, memory, cpu->P | B_FLAG | U_FLAG);
+	CPU_push8_stack(cpu, memory, get_status(cpu) | B_FLAG | U_FLAG);
 }
 
 void ora_imm(struct cpu *cpu, struct memory *memory)
@@ -871,11 +882,7 @@ void asl_acc(struct cpu *cpu, struct memory *memory)
 
 	CPU_set_zero_flag_for_value(cpu, new_val);
 	CPU_set_negative_flag_for_value(cpu, new_val);
-	if((val & N_FLAG) == N_FLAG) {
-		cpu->P |= C_FLAG;
-	} else {
-		cpu->P &= ~(C_FLAG);
-	}
+	cpu->c = high_bit_is_set(val);
 }
 
 void ora_abs(struct cpu *cpu, struct memory *memory)
@@ -883,7 +890,7 @@ void ora_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	ora(addr, cpu, memory);
 }
 
@@ -892,7 +899,7 @@ void asl_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	asl(addr, cpu, memory);
 }
 
@@ -901,11 +908,12 @@ void asl_abs(struct cpu *cpu, struct memory *memory)
  */
 void bpl_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be handled as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_negative_flag_is_set(cpu) == 0) {
 		cpu->PC += offset;
@@ -927,7 +935,7 @@ void ora_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	ora(addr, cpu, memory);
 }
 
@@ -936,7 +944,7 @@ void asl_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	asl(addr, cpu, memory);
 }
 
@@ -947,7 +955,7 @@ void clc(struct cpu *cpu, struct memory *memory)
 {
 	cpu->cycles = 2;
 
-	cpu->P &= ~C_FLAG;
+	cpu->c = 0;
 	cpu->PC++;
 }
 
@@ -956,7 +964,7 @@ void ora_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	ora(addr, cpu, memory);
 }
 
@@ -965,14 +973,14 @@ void ora_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	ora(addr, cpu, memory);
 }
 
 void asl_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	asl(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -983,7 +991,7 @@ void jsr_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t transfer_addr = abs_(cpu, memory);
+	uint16_t transfer_addr = abs_(cpu);
 	uint16_t next_op_addr = cpu->PC-1;
 	CPU_push16_stack(cpu, memory, next_op_addr);
 	cpu->PC = transfer_addr;
@@ -1003,7 +1011,7 @@ void bit_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	bit(addr, cpu, memory);
 }
 
@@ -1012,7 +1020,7 @@ void and_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	and(addr, cpu, memory);
 }
 
@@ -1021,7 +1029,7 @@ void rol_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	rol(addr, cpu, memory);
 }
 
@@ -1038,7 +1046,7 @@ void plp(struct cpu *cpu, struct memory *memory)
 	} else {
 		val &= ~(B_FLAG);
 	}
-	cpu->P = val | U_FLAG;
+	set_status(cpu, val | U_FLAG);
 }
 
 void and_imm(struct cpu *cpu, struct memory *memory)
@@ -1066,12 +1074,7 @@ void rol_acc(struct cpu *cpu, struct memory *memory)
 	}
 
 	/* shift bit 7 into carry flag */
-	if (high_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = high_bit_is_set(val);
 
 	cpu->A = result;
 
@@ -1084,7 +1087,7 @@ void bit_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	bit(addr, cpu, memory);
 }
 
@@ -1093,7 +1096,7 @@ void and_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	and(addr, cpu, memory);
 }
 
@@ -1102,7 +1105,7 @@ void rol_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	rol(addr, cpu, memory);
 }
 
@@ -1111,11 +1114,12 @@ void rol_abs(struct cpu *cpu, struct memory *memory)
  */
 void bmi_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must ba handled as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_negative_flag_is_set(cpu) == 1) {
 		cpu->PC += offset;
@@ -1137,7 +1141,7 @@ void and_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	and(addr, cpu, memory);
 }
 
@@ -1146,7 +1150,7 @@ void rol_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	rol(addr, cpu, memory);
 }
 
@@ -1155,7 +1159,7 @@ void sec(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 2;
 
 	cpu->PC++;
-	set_status_flag(cpu, C_FLAG);
+	cpu->c = 1;
 }
 
 void and_abs_y(struct cpu *cpu, struct memory *memory)
@@ -1163,7 +1167,7 @@ void and_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	and(addr, cpu, memory);
 }
 
@@ -1172,14 +1176,14 @@ void and_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	and(addr, cpu, memory);
 }
 
 void rol_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	rol(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -1199,7 +1203,7 @@ void rti(struct cpu *cpu, struct memory *memory)
 		val &= ~(B_FLAG);
 	}
 
-	cpu->P = val;
+	set_status(cpu, val);
 	cpu->PC = CPU_pop16_stack(cpu, memory);
 }
 
@@ -1217,7 +1221,7 @@ void eor_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	eor(addr, cpu, memory);
 }
 
@@ -1227,7 +1231,7 @@ void lsr_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	lsr(addr, cpu, memory);
 }
 
@@ -1257,12 +1261,7 @@ void lsr_acc(struct cpu *cpu, struct memory *memory)
 	uint8_t result = val>>1;
 
 	/* shift old bit 0 into the carry flag */
-	if(low_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = low_bit_is_set(val);
 
 	CPU_set_zero_flag_for_value(cpu, result);
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -1272,10 +1271,11 @@ void lsr_acc(struct cpu *cpu, struct memory *memory)
 
 void jmp_abs(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	jmp(addr, cpu);
 }
 
@@ -1284,7 +1284,7 @@ void eor_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	eor(addr, cpu, memory);
 }
 
@@ -1293,7 +1293,7 @@ void lsr_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	lsr(addr, cpu, memory);
 }
 
@@ -1302,11 +1302,12 @@ void lsr_abs(struct cpu *cpu, struct memory *memory)
  */
 void bvc_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be handled as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_overflow_flag_is_set(cpu) == 0) {
 		cpu->PC += offset;
@@ -1328,7 +1329,7 @@ void eor_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint8_t addr = zero_pg_x(cpu, memory);
+	uint8_t addr = zero_pg_x(cpu);
 	eor(addr, cpu, memory);
 }
 
@@ -1337,7 +1338,7 @@ void lsr_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint8_t addr = zero_pg_x(cpu, memory);
+	uint8_t addr = zero_pg_x(cpu);
 	lsr(addr, cpu, memory);
 }
 
@@ -1354,7 +1355,7 @@ void eor_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	eor(addr, cpu, memory);
 }
 
@@ -1363,14 +1364,14 @@ void eor_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	eor(addr, cpu, memory);
 }
 
 void lsr_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	lsr(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -1397,7 +1398,7 @@ void adc_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	adc(addr, cpu, memory);
 }
 
@@ -1406,7 +1407,7 @@ void ror_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	ror(addr, cpu, memory);
 }
 
@@ -1446,12 +1447,7 @@ void ror_acc(struct cpu *cpu, struct memory *memory)
 	}
 
 	/* shift bit 0 into carry flag */
-	if (low_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = low_bit_is_set(val);
 
 	cpu->A = result;
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -1472,7 +1468,7 @@ void adc_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	adc(addr, cpu, memory);
 }
 
@@ -1481,17 +1477,18 @@ void ror_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	ror(addr, cpu, memory);
 }
 
 void bvs_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be handles as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_overflow_flag_is_set(cpu) == 1) {
 		cpu->PC += offset;
@@ -1513,7 +1510,7 @@ void adc_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	adc(addr, cpu, memory);
 }
 
@@ -1522,7 +1519,7 @@ void ror_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	ror(addr, cpu, memory);
 }
 
@@ -1539,7 +1536,7 @@ void adc_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	adc(addr, cpu, memory);
 }
 
@@ -1548,14 +1545,14 @@ void adc_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	adc(addr, cpu, memory);
 }
 
 void ror_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	ror(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -1575,7 +1572,7 @@ void sty_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	sty(addr, cpu, memory);
 }
 
@@ -1584,7 +1581,7 @@ void sta_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	sta(addr, cpu, memory);
 }
 
@@ -1593,7 +1590,7 @@ void stx_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	stx(addr, cpu, memory);
 }
 
@@ -1624,7 +1621,7 @@ void sty_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	sty(addr, cpu, memory);
 }
 
@@ -1633,7 +1630,7 @@ void sta_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	sta(addr, cpu, memory);
 }
 
@@ -1642,17 +1639,18 @@ void stx_abs(struct cpu * cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	stx(addr, cpu, memory);
 }
 
 void bcc_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be treated as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_carry_flag_is_set(cpu) == 0) {
 		cpu->PC += offset;
@@ -1674,7 +1672,7 @@ void sty_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	sty(addr, cpu, memory);
 }
 
@@ -1683,7 +1681,7 @@ void sta_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	sta(addr, cpu, memory);
 }
 
@@ -1692,7 +1690,7 @@ void stx_zero_pg_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_y(cpu, memory);
+	uint16_t addr = zero_pg_y(cpu);
 	stx(addr, cpu, memory);
 }
 
@@ -1710,7 +1708,7 @@ void tya(struct cpu *cpu, struct memory *memory)
 void sta_abs_y(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	sta(addr, cpu, memory);
 
 	cpu->cycles = 5;
@@ -1727,7 +1725,7 @@ void txs(struct cpu *cpu, struct memory *memory)
 void sta_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	sta(addr, cpu, memory);
 
 	cpu->cycles = 5;
@@ -1765,7 +1763,7 @@ void ldy_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	ldy(addr, cpu, memory);
 }
 
@@ -1774,7 +1772,7 @@ void lda_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	lda(addr, cpu, memory);
 }
 
@@ -1783,7 +1781,7 @@ void ldx_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	ldx(addr, cpu, memory);
 }
 
@@ -1823,7 +1821,7 @@ void ldy_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	ldy(addr, cpu, memory);
 }
 
@@ -1832,7 +1830,7 @@ void lda_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	lda(addr, cpu, memory);
 }
 
@@ -1841,17 +1839,18 @@ void ldx_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	ldx(addr, cpu, memory);
 }
 
 void bcs_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be treated as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_carry_flag_is_set(cpu) == 1) {
 		cpu->PC += offset;
@@ -1873,7 +1872,7 @@ void ldy_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	ldy(addr, cpu, memory);
 }
 
@@ -1882,7 +1881,7 @@ void lda_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr =zero_pg_x(cpu, memory);
+	uint16_t addr =zero_pg_x(cpu);
 	lda(addr, cpu, memory);
 }
 
@@ -1891,7 +1890,7 @@ void ldx_zero_pg_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_y(cpu, memory);
+	uint16_t addr = zero_pg_y(cpu);
 	ldx(addr, cpu, memory);
 }
 
@@ -1900,7 +1899,7 @@ void clv(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 2;
 
 	cpu->PC++;
-	clear_status_flag(cpu, V_FLAG);
+	CPU_set_overflow_flag(cpu, 0);
 }
 
 void lda_abs_y(struct cpu *cpu, struct memory *memory)
@@ -1908,7 +1907,7 @@ void lda_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	lda(addr, cpu, memory);
 }
 
@@ -1928,7 +1927,7 @@ void ldy_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	ldy(addr, cpu, memory);
 }
 
@@ -1937,7 +1936,7 @@ void lda_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	lda(addr, cpu, memory);
 }
 
@@ -1946,7 +1945,7 @@ void ldx_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	ldx(addr, cpu, memory);
 }
 
@@ -1973,7 +1972,7 @@ void cpy_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	cpy(addr, cpu, memory);
 }
 
@@ -1982,7 +1981,7 @@ void cmp_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	cmp(addr, cpu, memory);
 }
 
@@ -1991,7 +1990,7 @@ void dec_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	dec(addr, cpu, memory);
 }
 
@@ -2029,7 +2028,7 @@ void cpy_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	cpy(addr, cpu, memory);
 }
 
@@ -2038,7 +2037,7 @@ void cmp_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	cmp(addr, cpu, memory);
 }
 
@@ -2047,17 +2046,18 @@ void dec_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	dec(addr, cpu, memory);
 }
 
 void bne_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be treated as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_zero_flag_is_set(cpu) == 0) {
 		cpu->PC += offset;
@@ -2079,7 +2079,7 @@ void cmp_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	cmp(addr, cpu, memory);
 }
 
@@ -2088,7 +2088,7 @@ void dec_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	dec(addr, cpu, memory);
 }
 
@@ -2105,7 +2105,7 @@ void cmp_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	cmp(addr, cpu, memory);
 }
 
@@ -2114,14 +2114,14 @@ void cmp_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	cmp(addr, cpu, memory);
 }
 
 void dec_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	dec(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -2150,7 +2150,7 @@ void cpx_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	cpx(addr, cpu, memory);
 }
 
@@ -2159,7 +2159,7 @@ void sbc_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	sbc(addr, cpu, memory);
 }
 
@@ -2168,7 +2168,7 @@ void inc_zero_pg(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	inc(addr, cpu, memory);
 }
 
@@ -2202,7 +2202,7 @@ void cpx_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	cpx(addr, cpu, memory);
 }
 
@@ -2211,7 +2211,7 @@ void sbc_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	sbc(addr, cpu, memory);
 }
 
@@ -2220,17 +2220,18 @@ void inc_abs(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	inc(addr, cpu, memory);
 }
 
 void beq_r(struct cpu *cpu, struct memory *memory)
 {
+	(void)memory;
 	cpu->cycles = 2;
 
 	cpu->PC++;
 	/* Offset must be treated as a signed number */
-	int8_t offset = (int8_t)CPU_pop8_mem(cpu, memory);
+	int8_t offset = (int8_t)CPU_pop8_operand(cpu);
 
 	if(CPU_zero_flag_is_set(cpu) == 1) {
 		cpu->PC += offset;
@@ -2252,7 +2253,7 @@ void sbc_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	sbc(addr, cpu, memory);
 }
 
@@ -2261,7 +2262,7 @@ void inc_zero_pg_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	inc(addr, cpu, memory);
 }
 
@@ -2278,7 +2279,7 @@ void sbc_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	sbc(addr, cpu, memory);
 }
 
@@ -2287,14 +2288,14 @@ void sbc_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	sbc(addr, cpu, memory);
 }
 
 void inc_abs_x(struct cpu *cpu, struct memory *memory)
 {
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	inc(addr, cpu, memory);
 
 	cpu->cycles = 7;
@@ -2361,7 +2362,7 @@ void slo_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	slo(addr, cpu, memory);
 }
 
@@ -2369,7 +2370,7 @@ void slo_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	slo(addr, cpu, memory);
 }
 
@@ -2377,7 +2378,7 @@ void slo_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	slo(addr, cpu, memory);
 }
 
@@ -2385,7 +2386,7 @@ void slo_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	slo(addr, cpu, memory);
 }
 
@@ -2393,7 +2394,7 @@ void slo_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	slo(addr, cpu, memory);
 }
 
@@ -2401,7 +2402,7 @@ void rla_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	rla(addr, cpu, memory);
 }
 
@@ -2409,7 +2410,7 @@ void rla_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	rla(addr, cpu, memory);
 }
 
@@ -2433,7 +2434,7 @@ void rla_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	rla(addr, cpu, memory);
 }
 
@@ -2441,7 +2442,7 @@ void rla_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	rla(addr, cpu, memory);
 }
 
@@ -2449,7 +2450,7 @@ void rla_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	rla(addr, cpu, memory);
 }
 
@@ -2457,7 +2458,7 @@ void sre_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	sre(addr, cpu, memory);
 }
 
@@ -2465,7 +2466,7 @@ void sre_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	sre(addr, cpu, memory);
 }
 
@@ -2489,7 +2490,7 @@ void sre_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	sre(addr, cpu, memory);
 }
 
@@ -2497,7 +2498,7 @@ void sre_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	sre(addr, cpu, memory);
 }
 
@@ -2505,7 +2506,7 @@ void sre_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	sre(addr, cpu, memory);
 }
 
@@ -2513,7 +2514,7 @@ void rra_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	rra(addr, cpu, memory);
 }
 
@@ -2521,7 +2522,7 @@ void rra_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	rra(addr, cpu, memory);
 }
 
@@ -2545,7 +2546,7 @@ void rra_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	rra(addr, cpu, memory);
 }
 
@@ -2553,7 +2554,7 @@ void rra_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	rra(addr, cpu, memory);
 }
 
@@ -2561,7 +2562,7 @@ void rra_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	rra(addr, cpu, memory);
 }
 
@@ -2569,7 +2570,7 @@ void sax_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	sax(addr, cpu, memory);
 }
 
@@ -2577,7 +2578,7 @@ void sax_zero_pg_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_y(cpu, memory);
+	uint16_t addr = zero_pg_y(cpu);
 	sax(addr, cpu, memory);
 }
 
@@ -2593,7 +2594,7 @@ void sax_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	sax(addr, cpu, memory);
 }
 
@@ -2601,7 +2602,7 @@ void lax_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 3;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	lax(addr, cpu, memory);
 }
 
@@ -2609,7 +2610,7 @@ void lax_zero_pg_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_y(cpu, memory);
+	uint16_t addr = zero_pg_y(cpu);
 	lax(addr, cpu, memory);
 }
 
@@ -2633,7 +2634,7 @@ void lax_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 4;
 	
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	lax(addr, cpu, memory);
 }
 
@@ -2641,7 +2642,7 @@ void lax_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 4;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	lax(addr, cpu, memory);
 }
 
@@ -2657,7 +2658,7 @@ void dcp_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	dcp(addr, cpu, memory);
 }
 
@@ -2665,7 +2666,7 @@ void dcp_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	dcp(addr, cpu, memory);
 }
 
@@ -2689,7 +2690,7 @@ void dcp_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	dcp(addr, cpu, memory);
 }
 
@@ -2697,7 +2698,7 @@ void dcp_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	dcp(addr, cpu, memory);
 }
 
@@ -2705,7 +2706,7 @@ void dcp_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	dcp(addr, cpu, memory);
 }
 
@@ -2713,7 +2714,7 @@ void isc_zero_pg(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg(cpu, memory);
+	uint16_t addr = zero_pg(cpu);
 	isc(addr, cpu, memory);
 }
 
@@ -2721,7 +2722,7 @@ void isc_zero_pg_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = zero_pg_x(cpu, memory);
+	uint16_t addr = zero_pg_x(cpu);
 	isc(addr, cpu, memory);
 }
 
@@ -2745,7 +2746,7 @@ void isc_abs(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 6;
 
 	cpu->PC++;
-	uint16_t addr = abs_(cpu, memory);
+	uint16_t addr = abs_(cpu);
 	isc(addr, cpu, memory);
 }
 
@@ -2753,7 +2754,7 @@ void isc_abs_x(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	isc(addr, cpu, memory);
 }
 
@@ -2761,7 +2762,7 @@ void isc_abs_y(struct cpu *cpu, struct memory *memory) {
 	cpu->cycles = 7;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	isc(addr, cpu, memory);
 }
 
@@ -2776,12 +2777,7 @@ void alr_imm(struct cpu *cpu, struct memory *memory) {
 	uint8_t result = val>>1;
 
 	/* shift old bit 0 into the carry flag */
-	if(low_bit_is_set(val))
-	{
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = low_bit_is_set(val);
 
 	CPU_set_zero_flag_for_value(cpu, result);
 	CPU_set_negative_flag_for_value(cpu, result);
@@ -2819,18 +2815,10 @@ void arr_imm(struct cpu *cpu, struct memory *memory)
 	CPU_set_zero_flag_for_value(cpu, result);
 
 	// Set the carry flag
-	if (bit_is_set(result, 5)) {
-		set_status_flag(cpu, C_FLAG);
-	} else {
-		clear_status_flag(cpu, C_FLAG);
-	}
+	cpu->c = bit_is_set(result, 5);
 
 	// Set the overflow flag
-	if (bit_is_set(result, 5) ^ bit_is_set(result, 4)) {
-		set_status_flag(cpu, V_FLAG);
-	} else {
-		clear_status_flag(cpu, V_FLAG);
-	}
+	CPU_set_overflow_flag(cpu, bit_is_set(result, 5) ^ bit_is_set(result, 4));
 }
 
 void axs_imm(struct cpu *cpu, struct memory *memory)
@@ -2850,7 +2838,7 @@ void shy_abs_x(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = abs_x(cpu, memory);
+	uint16_t addr = abs_x(cpu);
 	uint8_t high = (uint8_t)(addr >> 8); 
 	uint8_t result = cpu->Y & (high + 1);
 	MEM_write(memory, addr, result);
@@ -2861,7 +2849,7 @@ void shx_abs_y(struct cpu *cpu, struct memory *memory)
 	cpu->cycles = 5;
 
 	cpu->PC++;
-	uint16_t addr = abs_y(cpu, memory);
+	uint16_t addr = abs_y(cpu);
 	uint8_t high = (uint8_t)(addr >> 8); 
 	uint8_t result = cpu->X & (high + 1);
 	MEM_write(memory, addr, result);
@@ -2894,6 +2882,493 @@ static void (* const pf[]) (struct cpu *, struct memory *) = {
 /* 0xF0 */	&beq_r, &sbc_ind_y, NULL, &isc_ind_y, &nop_2_bytes_4_cycles, &sbc_zero_pg_x, &inc_zero_pg_x, &isc_zero_pg_x, &sed, &sbc_abs_y, &nop_1_bytes_2_cycles, &isc_abs_y, &nop_3_bytes_4_cycles, &sbc_abs_x, &inc_abs_x, &isc_abs_x
 };
 
+/*
+ * Length in bytes of each instruction, opcode included.
+ */
+static const uint8_t op_length[] = {
+/* 0x00 */	1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0x10 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+/* 0x20 */	3, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0x30 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+/* 0x40 */	1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0x50 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+/* 0x60 */	1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0x70 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+/* 0x80 */	2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 3, 3, 3, 3,
+/* 0x90 */	2, 2, 1, 1, 2, 2, 2, 2, 1, 3, 1, 1, 3, 3, 3, 1,
+/* 0xA0 */	2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0xB0 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 1, 3, 3, 3, 3,
+/* 0xC0 */	2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0xD0 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+/* 0xE0 */	2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+/* 0xF0 */	2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3
+};
+
+/*
+ * Only code in RAM, save RAM and cartridge ROM is cached.  Anything else
+ * would be code run out of I/O registers, which have to be read every time.
+ */
+static inline int is_cacheable(const uint16_t addr)
+{
+	return addr < 0x2000 || addr >= 0x6000;
+}
+
+/*
+ * Idle loops
+ * ==========
+ *
+ * Games spend much of each frame waiting for vertical blank or the NMI
+ * handler, in loops like
+ *
+ *	wait:	LDA $2002		wait:	LDA frame_done		wait:	JMP wait
+ *		BPL wait			BEQ wait
+ *
+ * A loop that only reads memory that is stable (see MEM_read_is_stable) and
+ * writes nothing does the same thing every time round, once it has been
+ * round once.  run_idle_loop goes round twice, and if the second time left
+ * the cpu as the first did, adds the cycles for as many more times round as
+ * the budget allows instead of running them.  The run then ends on the same
+ * instruction and cycle as it would have.
+ */
+#define IDLE_LOOP_MAX_LENGTH 5	/* instructions, including the branch back */
+
+#define LOOP_NONE 0
+#define LOOP_IDLE 1	/* an idle loop */
+#define LOOP_COPY 2	/* a copy loop, see below */
+
+#define IDLE_NONE 0	/* not allowed in an idle loop */
+#define IDLE_NO_READ 1	/* immediate or implied */
+#define IDLE_READ 2	/* reads the zero page or absolute address */
+#define IDLE_BRANCH 3	/* branch or jump, which must go back to the start */
+
+static int idle_kind(const uint8_t opcode)
+{
+	switch (opcode) {
+		case 0xA9: case 0xA2: case 0xA0:	// LDA, LDX, LDY #
+		case 0xC9: case 0xE0: case 0xC0:	// CMP, CPX, CPY #
+		case 0x29: case 0x09: case 0x49:	// AND, ORA, EOR #
+		case 0xEA:				// NOP
+			return IDLE_NO_READ;
+		case 0xA5: case 0xAD: case 0xA6: case 0xAE: case 0xA4: case 0xAC:
+		case 0xC5: case 0xCD: case 0xE4: case 0xEC: case 0xC4: case 0xCC:
+		case 0x25: case 0x2D: case 0x05: case 0x0D: case 0x45: case 0x4D:
+		case 0x24: case 0x2C:			// BIT
+			return IDLE_READ;
+		case 0x10: case 0x30: case 0x50: case 0x70:
+		case 0x90: case 0xB0: case 0xD0: case 0xF0:
+		case 0x4C:				// JMP abs
+			return IDLE_BRANCH;
+	}
+	return IDLE_NONE;
+}
+
+/*
+ * Does an idle loop start at the given address?  Only code in host memory is
+ * looked at, so looking has no side effects.  With check_reads, the loop
+ * must also only read memory that is stable right now.
+ */
+static int is_idle_loop(struct memory *memory, const uint16_t start, const int check_reads)
+{
+	uint16_t addr = start;
+	int i;
+
+	for (i = 0; i < IDLE_LOOP_MAX_LENGTH; i++) {
+		const uint8_t *code = MEM_host_pointer(memory, addr, 1);
+		uint8_t length;
+		uint16_t operand;
+
+		if (code == NULL || idle_kind(code[0]) == IDLE_NONE) {
+			return 0;
+		}
+		length = op_length[code[0]];
+		code = MEM_host_pointer(memory, addr, length);
+		if (code == NULL) {
+			return 0;
+		}
+		operand = length == 3 ? code[1] | (code[2]<<8) : code[1];
+
+		switch (idle_kind(code[0])) {
+			case IDLE_BRANCH:
+				if (code[0] == 0x4C) {
+					return operand == start;
+				}
+				return (uint16_t)(addr + 2 + (int8_t)operand) == start;
+			case IDLE_READ:
+				if (check_reads && MEM_read_is_stable(memory, operand) == 0) {
+					return 0;
+				}
+				break;
+		}
+		addr += length;
+	}
+	return 0;
+}
+
+/*
+ * Copy loops
+ * ==========
+ *
+ * Nametables and palettes are uploaded by loops that store to PPUDATA a byte
+ * at a time, like
+ *
+ *	copy:	LDA table,X		copy:	LDA (src),Y
+ *		STA $2007			STA $2007
+ *		INX				INY
+ *		CPX #32				BNE copy
+ *		BNE copy
+ *
+ * The index register says how many more times round the loop goes, and so
+ * which bytes are stored.  run_copy_loop goes round once, then hands the
+ * bytes for as many more times round as the budget allows, bar the one that
+ * leaves the loop, to MEM_write_ppu_data at once.  That is only done if they
+ * are in host memory and the PPU would not draw anything meanwhile.  The run
+ * then carries on from the start of the loop as it would have.
+ */
+#define COPY_LOOP_MAX_LENGTH 5	/* instructions, including the branch back */
+
+struct copy_loop {
+	uint8_t load;	/* LDA abs,X, LDA abs,Y or LDA (zp),Y */
+	uint16_t operand;
+	uint16_t increment;	/* address of the INX or INY */
+	uint8_t end;	/* index value that leaves the loop */
+};
+
+/*
+ * Does a copy loop start at the given address?  Like is_idle_loop, only code
+ * in host memory is looked at.
+ */
+static int is_copy_loop(struct memory *memory, const uint16_t start, struct copy_loop *loop)
+{
+	const uint8_t *code = MEM_host_pointer(memory, start, 3);
+	uint16_t addr;
+	uint8_t increment;
+	uint8_t compare;
+
+	if (code == NULL) {
+		return 0;
+	}
+	switch (code[0]) {
+		case 0xBD:		// LDA abs,X ... INX, CPX #
+			increment = 0xE8;
+			compare = 0xE0;
+			break;
+		case 0xB9: case 0xB1:	// LDA abs,Y or (zp),Y ... INY, CPY #
+			increment = 0xC8;
+			compare = 0xC0;
+			break;
+		default:
+			return 0;
+	}
+	loop->load = code[0];
+	loop->operand = op_length[code[0]] == 3 ? code[1] | (code[2]<<8) : code[1];
+	addr = start + op_length[code[0]];
+
+	// STA $2007, then the increment
+	code = MEM_host_pointer(memory, addr, 4);
+	if (code == NULL || code[0] != 0x8D || code[1] != 0x07 || code[2] != 0x20 || code[3] != increment) {
+		return 0;
+	}
+	loop->increment = addr + 3;
+	addr += 4;
+
+	// Maybe a compare, then BNE back to the start
+	loop->end = 0;
+	code = MEM_host_pointer(memory, addr, 2);
+	if (code != NULL && code[0] == compare) {
+		loop->end = code[1];
+		addr += 2;
+		code = MEM_host_pointer(memory, addr, 2);
+	}
+	return code != NULL && code[0] == 0xD0 && (uint16_t)(addr + 2 + (int8_t)code[1]) == start;
+}
+
+static void decode(struct cpu *cpu, struct memory *memory, struct decoded_op *op)
+{
+	struct copy_loop copy;
+	uint8_t length;
+
+	op->opcode = MEM_read(memory, cpu->PC);
+	op->handler = pf[op->opcode];
+	op->operand = 0;
+
+	length = op_length[op->opcode];
+	if (length > 1) {
+		op->operand = MEM_read(memory, cpu->PC + 1);
+	}
+	if (length > 2) {
+		op->operand |= MEM_read(memory, cpu->PC + 2)<<8;
+	}
+
+	if (is_idle_loop(memory, cpu->PC, 0)) {
+		op->loop = LOOP_IDLE;
+	} else if (is_copy_loop(memory, cpu->PC, &copy)) {
+		op->loop = LOOP_COPY;
+	} else {
+		op->loop = LOOP_NONE;
+	}
+
+	if (is_cacheable(cpu->PC)) {
+		// Have writes to this code reported back to CPU_invalidate_code
+		MEM_watch_code(memory, cpu->PC);
+		MEM_watch_code(memory, cpu->PC + length - 1);
+		op->valid = 1;
+	}
+}
+
+/*
+ * Get the decoded instruction at PC, decoding it first if it is not cached.
+ * The operand is loaded for the CPU_pop*_operand functions.
+ */
+static inline const struct decoded_op *fetch(struct cpu *cpu, struct memory *memory)
+{
+	struct decoded_op *op = &cpu->code_cache[cpu->PC];
+
+	if (op->valid == 0) {
+		decode(cpu, memory, op);
+	}
+	cpu->operand = op->operand;
+	return op;
+}
+
+static inline int same_state(const struct cpu *a, const struct cpu *b)
+{
+	return a->PC == b->PC && a->S == b->S && a->A == b->A && a->X == b->X &&
+		a->Y == b->Y && a->P == b->P && a->n_result == b->n_result &&
+		a->z_result == b->z_result && a->c == b->c && a->v_a == b->v_a &&
+		a->v_b == b->v_b && a->v_result == b->v_result;
+}
+
+/*
+ * Run the idle loop at PC, skipping it if it is stuck, as described above.
+ * regs are the registers being run, which the threaded interpreter keeps
+ * apart from cpu.  Returns the cycles used by the run so far.
+ */
+static uint32_t run_idle_loop(struct cpu *regs, struct cpu *cpu, struct memory *memory, uint32_t cycles)
+{
+	const uint16_t start = regs->PC;
+	struct cpu before;
+	uint32_t loop_cycles = 0;
+	int round;
+	int i;
+
+	if (is_idle_loop(memory, start, 1) == 0) {
+		return cycles;
+	}
+
+	for (round = 0; round < 2; round++) {
+		before = *regs;
+		loop_cycles = cycles;
+		for (i = 0; i < IDLE_LOOP_MAX_LENGTH; i++) {
+			const struct decoded_op *op = fetch(regs, memory);
+			op->handler(regs, memory);
+			cycles += regs->cycles;
+			cpu->run_cycles = cycles;
+			if (cycles >= cpu->run_budget) {
+				return cycles;
+			}
+			if (idle_kind(op->opcode) == IDLE_BRANCH) {
+				break;
+			}
+		}
+		if (regs->PC != start) {
+			// Left the loop
+			return cycles;
+		}
+		loop_cycles = cycles - loop_cycles;
+	}
+
+	if (same_state(&before, regs)) {
+		cycles += (cpu->run_budget - cycles) / loop_cycles * loop_cycles;
+		cpu->run_cycles = cycles;
+	}
+	return cycles;
+}
+
+/*
+ * Run the copy loop at PC, as described above.  Takes the same arguments as
+ * run_idle_loop.
+ */
+static uint32_t run_copy_loop(struct cpu *regs, struct cpu *cpu, struct memory *memory, uint32_t cycles)
+{
+	const uint16_t start = regs->PC;
+	struct copy_loop loop;
+	const uint8_t *src;
+	uint8_t *index;
+	uint16_t base;
+	uint32_t round_cycles;
+	uint32_t copy_cycles = 0;
+	unsigned int count;
+	int crosses;
+	int i;
+
+	if (is_copy_loop(memory, start, &loop) == 0) {
+		return cycles;
+	}
+	index = loop.load == 0xBD ? &regs->X : &regs->Y;
+	base = loop.operand;
+	if (loop.load == 0xB1) {
+		base = MEM_read(memory, loop.operand) | (MEM_read(memory, (uint8_t)(loop.operand + 1))<<8);
+	}
+
+	// Once round, for what it costs when the load does not cross a page
+	crosses = (base & 0xFF) + *index > 0xFF;
+	round_cycles = cycles;
+	for (i = 0; i < COPY_LOOP_MAX_LENGTH; i++) {
+		const struct decoded_op *op = fetch(regs, memory);
+		op->handler(regs, memory);
+		cycles += regs->cycles;
+		cpu->run_cycles = cycles;
+		if (cycles >= cpu->run_budget) {
+			return cycles;
+		}
+		if (op->opcode == 0xD0) {
+			break;
+		}
+	}
+	if (regs->PC != start) {
+		// Left the loop
+		return cycles;
+	}
+	round_cycles = cycles - round_cycles - crosses;
+
+	// Times round that fit in the budget, before the index reaches the
+	// end or wraps around
+	for (count = 0; *index + count + 1 < 0x100 && *index + count + 1 != loop.end; count++) {
+		uint32_t next = round_cycles + ((base & 0xFF) + *index + count > 0xFF);
+
+		if (cycles + copy_cycles + next >= cpu->run_budget) {
+			break;
+		}
+		copy_cycles += next;
+	}
+	if (count == 0) {
+		return cycles;
+	}
+	src = MEM_host_pointer(memory, base + *index, count);
+	if (src == NULL || MEM_write_ppu_data(memory, src, count, copy_cycles) == 0) {
+		return cycles;
+	}
+	cycles += copy_cycles;
+	cpu->run_cycles = cycles;
+
+	// The last of those times round loaded the last byte, and then the
+	// increment, compare and branch set the flags and go back to the start
+	*index += count - 1;
+	regs->A = src[count - 1];
+	regs->PC = loop.increment;
+	for (i = 0; i < COPY_LOOP_MAX_LENGTH && regs->PC != start; i++) {
+		fetch(regs, memory)->handler(regs, memory);
+	}
+	return cycles;
+}
+
+/*
+ * Run the loop at PC, of the kind it was decoded as.  Kept out of line, or
+ * run_threaded would flatten a copy of both kinds into every opcode.
+ */
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static uint32_t run_loop(struct cpu *regs, struct cpu *cpu, struct memory *memory, uint32_t cycles)
+{
+	if (regs->code_cache[regs->PC].loop == LOOP_COPY) {
+		return run_copy_loop(regs, cpu, memory, cycles);
+	}
+	return run_idle_loop(regs, cpu, memory, cycles);
+}
+
+#ifdef __GNUC__
+/*
+ * Direct-threaded dispatch, using GCC's labels as values.
+ *
+ * Every opcode gets its own label, and every label ends by fetching the next
+ * opcode and jumping straight to that opcode's label.  This replicates the
+ * indirect branch once per opcode instead of funnelling all of them through
+ * the single call site in CPU_step, which the branch predictor handles much
+ * better.  The handlers are called directly (pf[] is const, so pf[0x6D] folds
+ * to &adc_abs) and flattened into this function, which lets the compiler keep
+ * the registers of the local copy below in host registers for the whole run.
+ *
+ * Instructions are executed until at least cycle_budget cycles have been
+ * used, or CPU_stop_run is called.  The number of cycles actually used is
+ * returned.
+ */
+#define OPCODE(n) op_##n: pf[n](&regs, memory); NEXT_OPCODE();
+#define OPCODES(h) OPCODE(h##0) OPCODE(h##1) OPCODE(h##2) OPCODE(h##3) \
+	OPCODE(h##4) OPCODE(h##5) OPCODE(h##6) OPCODE(h##7) \
+	OPCODE(h##8) OPCODE(h##9) OPCODE(h##A) OPCODE(h##B) \
+	OPCODE(h##C) OPCODE(h##D) OPCODE(h##E) OPCODE(h##F)
+#define LABELS(h) &&op_##h##0, &&op_##h##1, &&op_##h##2, &&op_##h##3, \
+	&&op_##h##4, &&op_##h##5, &&op_##h##6, &&op_##h##7, \
+	&&op_##h##8, &&op_##h##9, &&op_##h##A, &&op_##h##B, \
+	&&op_##h##C, &&op_##h##D, &&op_##h##E, &&op_##h##F
+
+#ifdef DEBUG_CPU
+#define TRACE_OPCODE() (void)printf("%04x  %02x A:%02x X:%02x Y:%02x P:%02x SP:%02x\n", regs.PC, op->opcode, regs.A, regs.X, regs.Y, get_status(&regs), regs.S)
+#else
+#define TRACE_OPCODE()
+#endif
+
+#define NEXT_OPCODE() \
+	do { \
+		cycles += regs.cycles; \
+		cpu->run_cycles = cycles; \
+		if (cycles >= cpu->run_budget) { \
+			goto done; \
+		} \
+		op = fetch(&regs, memory); \
+		if (op->loop != LOOP_NONE) { \
+			cycles = run_loop(&regs, cpu, memory, cycles); \
+			if (cycles >= cpu->run_budget) { \
+				goto done; \
+			} \
+			op = fetch(&regs, memory); \
+		} \
+		TRACE_OPCODE(); \
+		goto *labels[op->opcode]; \
+	} while (0)
+
+__attribute__((flatten, unused))
+static uint32_t run_threaded(struct cpu *cpu, struct memory *memory, const uint32_t cycle_budget)
+{
+	static const void * const labels[] = {
+		LABELS(0x0), LABELS(0x1), LABELS(0x2), LABELS(0x3),
+		LABELS(0x4), LABELS(0x5), LABELS(0x6), LABELS(0x7),
+		LABELS(0x8), LABELS(0x9), LABELS(0xA), LABELS(0xB),
+		LABELS(0xC), LABELS(0xD), LABELS(0xE), LABELS(0xF)
+	};
+	struct cpu regs;
+	uint32_t cycles = 0;
+	const struct decoded_op *op;
+
+	if (cycle_budget == 0) {
+		return 0;
+	}
+	cpu->run_budget = cycle_budget;
+	regs = *cpu;
+
+	op = fetch(&regs, memory);
+	TRACE_OPCODE();
+	goto *labels[op->opcode];
+
+	OPCODES(0x0) OPCODES(0x1) OPCODES(0x2) OPCODES(0x3)
+	OPCODES(0x4) OPCODES(0x5) OPCODES(0x6) OPCODES(0x7)
+	OPCODES(0x8) OPCODES(0x9) OPCODES(0xA) OPCODES(0xB)
+	OPCODES(0xC) OPCODES(0xD) OPCODES(0xE) OPCODES(0xF)
+
+done:
+	*cpu = regs;
+	cpu->run_cycles = 0;
+	return cycles;
+}
+
+#undef NEXT_OPCODE
+#undef TRACE_OPCODE
+#undef LABELS
+#undef OPCODES
+#undef OPCODE
+#endif
+
 /* Public functions */
 
 struct cpu *CPU_init(struct memory *memory)
@@ -2913,9 +3388,16 @@ struct cpu *CPU_init(struct memory *memory)
 	cpu->X = 0;
 	cpu->Y = 0;
 	// break flag is not set on init
-	cpu->P = 0x24;
+	set_status(cpu, 0x24);
 
 	cpu->cycles = 0;
+	cpu->run_budget = 0;
+	cpu->run_cycles = 0;
+
+	cpu->operand = 0;
+	cpu->code_cache = calloc(0x10000, sizeof(struct decoded_op));
+	cpu->jit = NULL;
+	MEM_attach_cpu(memory, cpu);
 
 	return cpu;
 }
@@ -2931,21 +3413,196 @@ struct cpu *CPU_init_to_address(struct memory *memory, uint16_t addr)
 
 void CPU_delete(struct cpu **cpu)
 {
+	if ((*cpu)->jit != NULL) {
+		JIT_delete(&(*cpu)->jit);
+	}
+	free((*cpu)->code_cache);
 	free(*cpu);
 	*cpu = NULL;
 }
 
-int CPU_step(struct cpu *cpu, struct memory *memory)
+/*
+ * Execute one instruction with the pf[] table.
+ */
+static inline int step(struct cpu *cpu, struct memory *memory)
 {
-	/* Get opcode at PC */
-	uint8_t opcode = MEM_read(memory, cpu->PC);
+	/* Get instruction at PC */
+	const struct decoded_op *op = fetch(cpu, memory);
 #ifdef DEBUG_CPU
-	(void)printf("%04x  %02x A:%02x X:%02x Y:%02x P:%02x SP:%02x\n", cpu->PC, opcode, cpu->A, cpu->X, cpu->Y, cpu->P, cpu->S);
+	(void)printf("%04x  %02x A:%02x X:%02x Y:%02x P:%02x SP:%02x\n", cpu->PC, op->opcode, cpu->A, cpu->X, cpu->Y, get_status(cpu), cpu->S);
 #endif
-	pf[opcode](cpu, memory);
+	op->handler(cpu, memory);
 	return cpu->cycles;
 }
 
+/*
+ * Run compiled blocks where there are any, and interpret everything else.
+ * Blocks are only run when they fit in what is left of the budget, so the
+ * run ends on the same instruction, with the same cycle count, as it would
+ * in the interpreter.
+ */
+// Has the instruction at the address been decoded as the start of a loop?
+static inline int starts_loop(const struct cpu *cpu, const uint16_t addr)
+{
+	return cpu->code_cache[addr].valid != 0 && cpu->code_cache[addr].loop != LOOP_NONE;
+}
+
+static uint32_t run_jit(struct cpu *cpu, struct memory *memory, const uint32_t cycle_budget)
+{
+	uint32_t cycles = 0;
+	const struct jit_block *block;
+	struct jit_state state;
+
+	state.memory = memory;
+	cpu->run_budget = cycle_budget;
+	while (cycles < cpu->run_budget) {
+		if (starts_loop(cpu, cpu->PC)) {
+			cycles = run_loop(cpu, cpu, memory, cycles);
+			if (cycles >= cpu->run_budget) {
+				break;
+			}
+		}
+		block = JIT_lookup(cpu->jit, memory, cpu->PC, cpu->run_budget - cycles);
+		if (block == NULL) {
+			cycles += step(cpu, memory);
+			cpu->run_cycles = cycles;
+			continue;
+		}
+
+		// P is only packed and unpacked around a run of blocks
+		state.A = cpu->A;
+		state.X = cpu->X;
+		state.Y = cpu->Y;
+		state.P = get_status(cpu);
+		state.PC = cpu->PC;
+		do {
+			cycles += JIT_execute(block, &state);
+			cpu->run_cycles = cycles;
+			if (cycles >= cpu->run_budget || starts_loop(cpu, state.PC)) {
+				break;
+			}
+			block = JIT_lookup(cpu->jit, memory, state.PC, cpu->run_budget - cycles);
+		} while (block != NULL);
+		cpu->A = state.A;
+		cpu->X = state.X;
+		cpu->Y = state.Y;
+		set_status(cpu, state.P);
+		cpu->PC = state.PC;
+	}
+	cpu->run_cycles = 0;
+	return cycles;
+}
+
+int CPU_step(struct cpu *cpu, struct memory *memory)
+{
+#ifdef CPU_THREADED
+	/* A budget of one cycle executes exactly one instruction */
+	return run_threaded(cpu, memory, 1);
+#else
+	return step(cpu, memory);
+#endif
+}
+
+uint32_t CPU_run(struct cpu *cpu, struct memory *memory, uint32_t cycle_budget)
+{
+	if (cpu->jit != NULL) {
+		return run_jit(cpu, memory, cycle_budget);
+	}
+#ifdef CPU_THREADED
+	return run_threaded(cpu, memory, cycle_budget);
+#else
+	uint32_t cycles = 0;
+
+	cpu->run_budget = cycle_budget;
+	while (cycles < cpu->run_budget) {
+		if (starts_loop(cpu, cpu->PC)) {
+			cycles = run_loop(cpu, cpu, memory, cycles);
+			if (cycles >= cpu->run_budget) {
+				break;
+			}
+		}
+		cycles += step(cpu, memory);
+		cpu->run_cycles = cycles;
+	}
+	cpu->run_cycles = 0;
+	return cycles;
+#endif
+}
+
+int CPU_enable_jit(struct cpu *cpu, const int enable)
+{
+	if (enable && cpu->jit == NULL) {
+		cpu->jit = JIT_init();
+	} else if (!enable && cpu->jit != NULL) {
+		JIT_delete(&cpu->jit);
+	}
+	return cpu->jit != NULL;
+}
+
+uint8_t CPU_get_status(struct cpu *cpu)
+{
+	return get_status(cpu);
+}
+
+uint32_t CPU_run_cycles(struct cpu *cpu)
+{
+	return cpu->run_cycles;
+}
+
+void CPU_stop_run(struct cpu *cpu)
+{
+	cpu->run_budget = 0;
+}
+
+void CPU_invalidate_code(struct cpu *cpu, const uint16_t addr)
+{
+	// An instruction is up to 3 bytes long, so the write may have changed
+	// one that starts up to 2 bytes earlier.
+	if (addr < 0x2000) {
+		// Code in internal RAM is cached under each mirror it ran from
+		uint16_t base_addr = addr % 0x0800;
+		int i;
+		for (i = 0; i < 4; i++) {
+			uint16_t mirror = base_addr + i * 0x0800;
+			cpu->code_cache[mirror].valid = 0;
+			cpu->code_cache[(uint16_t)(mirror - 1)].valid = 0;
+			cpu->code_cache[(uint16_t)(mirror - 2)].valid = 0;
+		}
+	} else {
+		cpu->code_cache[addr].valid = 0;
+		cpu->code_cache[(uint16_t)(addr - 1)].valid = 0;
+		cpu->code_cache[(uint16_t)(addr - 2)].valid = 0;
+
+		if (cpu->jit != NULL) {
+			JIT_invalidate(cpu->jit, addr);
+		}
+	}
+}
+
+void CPU_invalidate_page(struct cpu *cpu, const uint8_t page)
+{
+	uint16_t addr = page << 8;
+	int i;
+
+	// Instructions starting up to 2 bytes before the page reach into it
+	for (i = -2; i < MEM_PAGE_SIZE; i++) {
+		cpu->code_cache[(uint16_t)(addr + i)].valid = 0;
+	}
+
+	if (cpu->jit != NULL) {
+		JIT_invalidate_page(cpu->jit, page);
+	}
+}
+
+void CPU_flush_code_cache(struct cpu *cpu)
+{
+	memset(cpu->code_cache, 0, 0x10000 * sizeof(struct decoded_op));
+
+	if (cpu->jit != NULL) {
+		JIT_flush(cpu->jit);
+	}
+}
+
 /*
  * NMI handler does 3 things:
  * 1. Push CPU status reg onto the stack, with the blank flag cleared
@@ -2955,7 +3612,7 @@ int CPU_step(struct cpu *cpu, struct memory *memory)
 void CPU_handle_nmi(struct cpu *cpu, struct memory *memory)
 {
 	/* 1 */
-	CPU_push8_stack(cpu, memory, cpu->P & ~B_FLAG);
+	CPU_push8_stack(cpu, memory, get_status(cpu) & ~B_FLAG);
 	/* 2 */
 	CPU_push16_stack(cpu, memory, cpu->PC);
 	/* 3 */
@@ -2968,6 +3625,25 @@ void CPU_handle_nmi(struct cpu *cpu, struct memory *memory)
 #endif
 }
 
+int CPU_handle_irq(struct cpu *cpu, struct memory *memory)
+{
+	if (CPU_interrupt_flag_is_set(cpu) != 0) {
+		return 0;
+	}
+
+	CPU_push16_stack(cpu, memory, cpu->PC);
+	CPU_push8_stack(cpu, memory, (get_status(cpu) | U_FLAG) & ~(B_FLAG));
+	set_status_flag(cpu, I_FLAG);
+
+	uint16_t low = MEM_read(memory, MEM_BRK_VECTOR);
+	uint16_t high = MEM_read(memory, MEM_BRK_VECTOR + 1);
+	cpu->PC = (high<<8) | low;
+#ifdef DEBUG_CPU
+	(void)printf("IRQ set PC to %#x\n", cpu->PC);
+#endif
+	return 1;
+}
+
 void CPU_reset(struct cpu *cpu, struct memory *memory)
 {
 	/* initialize PC to 2-byte address at the reset vector */
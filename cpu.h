@@ -23,7 +23,9 @@
 
 /*
  * Initialize the cpu with default starting values.
- * Memory must be initialized before passing into this function.
+ * Memory must be initialized before passing into this function.  The cpu
+ * attaches itself to the memory, so that writes to code it has decoded are
+ * reported back to CPU_invalidate_code.
  */
 extern struct cpu *CPU_init(struct memory *);
 
@@ -44,11 +46,71 @@ extern void CPU_delete(struct cpu **);
  */
 extern int CPU_step(struct cpu *, struct memory *);
 
+/*
+ * Perform instructions until at least the given number of cycles have been
+ * used, or until CPU_stop_run is called.  Returns the number of cycles used,
+ * which can overshoot the budget by part of the last instruction.
+ */
+extern uint32_t CPU_run(struct cpu *, struct memory *, uint32_t);
+
+/*
+ * Turn the recompiler for hot ROM code on or off.  It is off by default, and
+ * is only available on x86-64.  CPU_run results are the same either way, so
+ * it can be turned off to compare against the interpreter.  Returns whether
+ * it is on.
+ */
+extern int CPU_enable_jit(struct cpu *, const int);
+
+/*
+ * Return the number of cycles the current CPU_run has used before the
+ * instruction being executed, or 0 outside of a run.  Memory mapped devices
+ * add this to the time the run started at to find the current time.
+ * Compiled blocks are counted as a whole, so within one it is the count at
+ * the start of the block.
+ */
+extern uint32_t CPU_run_cycles(struct cpu *);
+
+/*
+ * End the current CPU_run at the next instruction boundary.  For events that
+ * become pending in the middle of a run, e.g. from a memory mapped register.
+ */
+extern void CPU_stop_run(struct cpu *);
+
+/*
+ * Drop any decoded instructions that include the byte at the given address.
+ * Called by memory when code is overwritten.
+ */
+extern void CPU_invalidate_code(struct cpu *, const uint16_t);
+
+/*
+ * Drop any decoded instructions that include bytes of the given 256 byte
+ * page, and compiled code reading it.  Called by memory when a bank is
+ * switched out of the page.
+ */
+extern void CPU_invalidate_page(struct cpu *, const uint8_t);
+
+/*
+ * Drop all decoded instructions.
+ */
+extern void CPU_flush_code_cache(struct cpu *);
+
+/*
+ * Return the processor status register, P.  The flags are only worked out
+ * when needed, so the cpu does not keep P up to date itself.
+ */
+extern uint8_t CPU_get_status(struct cpu *);
+
 /*
  * Interrupt handler
  */
 extern void CPU_handle_nmi(struct cpu *, struct memory *);
 
+/*
+ * Take a maskable interrupt through the vector at 0xFFFE.  Returns 0, and
+ * does nothing, while the interrupt flag is set.
+ */
+extern int CPU_handle_irq(struct cpu *, struct memory *);
+
 /*
  * Soft (button) reset handler
  */
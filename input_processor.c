@@ -15,20 +15,31 @@
  * =====================================================================================
  */
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <SDL2/SDL.h>
 
 #include "input_processor.h"
 
+/*
+ * INPUT_poll and INPUT_process run on different threads, and only pass on
+ * the keys and the NES state, through atomics.
+ */
 struct input_processor {
 	SDL_Event event;
+	atomic_uint keys;	// controller byte as of the last poll
+	atomic_int nes_state;	// 0 to quit, 2 to reset, 1 to run on
 };
 
 struct input_processor *INPUT_init(const uint8_t **keypresses)
 {
+	struct input_processor *processor = malloc(sizeof(struct input_processor));
+
 	// SDL_Init(SDL_INIT_VIDEO);
 	*keypresses = SDL_GetKeyboardState(NULL);
+	atomic_init(&processor->keys, 0);
+	atomic_init(&processor->nes_state, 1);
 
-	return malloc(sizeof(struct input_processor));
+	return processor;
 }
 
 void INPUT_delete(struct input_processor **processor)
@@ -42,29 +53,42 @@ uint8_t process_input(const uint8_t *state)
 	return state[SDL_SCANCODE_Z]<<7 | state[SDL_SCANCODE_X]<<6 | state[SDL_SCANCODE_Q]<<5 | state[SDL_SCANCODE_W]<<4 | state[SDL_SCANCODE_UP]<<3 | state[SDL_SCANCODE_DOWN]<<2 | state[SDL_SCANCODE_LEFT]<<1 | state[SDL_SCANCODE_RIGHT]<<0;
 }
 
-void INPUT_process(struct input_processor *processor, struct controller *controller, int *nes_state, const uint8_t **keys)
+void INPUT_poll(struct input_processor *processor, const uint8_t **keys)
 {
+	int running = 1;
+
 	// Handle keyboard input and quit event
-	if (SDL_PollEvent(&processor->event) != 0) {
+	while (SDL_PollEvent(&processor->event) != 0) {
 		switch (processor->event.type) {
 			case SDL_QUIT:
-				*nes_state = 0;
+				atomic_store(&processor->nes_state, 0);
 				break;
 			case SDL_KEYDOWN:
 				switch (processor->event.key.keysym.sym) {
 					case SDLK_ESCAPE:
 					case SDLK_q:
-						*nes_state = 0;
+						atomic_store(&processor->nes_state, 0);
 						break;
 					case SDLK_r:
-						*nes_state = 2;
+						// Unless quitting
+						(void)atomic_compare_exchange_strong(&processor->nes_state, &running, 2);
+						running = 1;
 						break;
 				}
-				CONTROLLER_set_keys(controller, process_input(*keys));
-				break;
-			case SDL_KEYUP:
-				CONTROLLER_set_keys(controller, process_input(*keys));
 				break;
 		}
 	}
+	atomic_store(&processor->keys, process_input(*keys));
+}
+
+void INPUT_process(struct input_processor *processor, struct controller *controller, int *nes_state)
+{
+	int reset = 2;
+
+	*nes_state = atomic_load(&processor->nes_state);
+	if (*nes_state == 2) {
+		// Reset once, unless a quit came since
+		(void)atomic_compare_exchange_strong(&processor->nes_state, &reset, 1);
+	}
+	CONTROLLER_set_keys(controller, atomic_load(&processor->keys));
 }
@@ -28,6 +28,18 @@ extern struct input_processor *INPUT_init(const uint8_t **);
 
 extern void INPUT_delete(struct input_processor **);
 
-extern void INPUT_process(struct input_processor *, struct controller *, int *, const uint8_t **);
+/*
+ * Handle all pending SDL events, and note the keys held now.  Like all SDL
+ * event handling, call it from the thread that made the window.
+ */
+extern void INPUT_poll(struct input_processor *, const uint8_t **);
+
+/*
+ * Set the controller to the keys noted by the last INPUT_poll, and the NES
+ * state to 0 to quit, 2 to reset, or 1 otherwise.  It can be called from
+ * another thread than INPUT_poll, the one that runs the NES.  Call it once a
+ * frame.
+ */
+extern void INPUT_process(struct input_processor *, struct controller *, int *);
 
 #endif
@@ -0,0 +1,1215 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  jit.c
+ *
+ *    Description:  x86-64 dynamic recompiler for hot basic blocks of
+ *                  cartridge ROM code.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 02:05:31 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Blocks are compiled from straight line code in ROM at 0x8000 - 0xFFFF,
+ * and end at the first branch or jump, or before the first instruction that
+ * is not supported here.  Unsupported instructions include everything that
+ * touches the stack, interrupts, indirect addressing, and any access that
+ * might reach the PPU, APU or controller registers at 0x2000 - 0x401F.
+ * Those are left to the interpreter, which takes over at the end of the
+ * block.
+ *
+ * Cycles are counted exactly as in the interpreter: the fixed cost of each
+ * instruction is summed when compiling, and the generated code only adds the
+ * page crossing and branch taken cycles.
+ *
+ * Register use in the generated code:
+ *
+ * 	rbx	struct jit_state *
+ * 	rbp	cycles added at run time
+ * 	r12	P
+ * 	r13	A
+ * 	r14	X
+ * 	r15	Y
+ *
+ * The guest registers are kept zero-extended, and all live in callee-saved
+ * registers so that MEM_write can be called directly.
+ *
+ * The code buffer is never writable and executable at once: the pages a
+ * block is emitted into are made writable for the emitting only, and are
+ * executable again before the block can run.
+ */
+
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCK_CODE 8192
+#define JIT_MAX_BLOCK_INSTRUCTIONS 32
+#define JIT_HOT_THRESHOLD 32
+#define JIT_ROM_ADDR 0x8000
+#define JIT_ROM_SIZE 0x8000
+
+#ifdef MAP_JIT
+#define JIT_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT)
+#else
+#define JIT_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+#endif
+
+#define N_FLAG 1<<7
+#define V_FLAG 1<<6
+#define D_FLAG 1<<3
+#define I_FLAG 1<<2
+#define Z_FLAG 1<<1
+#define C_FLAG 1<<0
+#define ALL_FLAGS 0xFF
+
+/* x86-64 registers */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+#define REG_P R12
+#define REG_A R13
+#define REG_X R14
+#define REG_Y R15
+
+enum block_state {
+	BLOCK_COLD,
+	BLOCK_COMPILED,
+	BLOCK_NONE
+};
+
+struct jit_block {
+	uint32_t (*code)(struct jit_state *);
+	uint16_t max_cycles;
+	uint8_t heat;
+	uint8_t state;
+};
+
+struct jit {
+	uint8_t *code;
+	uint8_t *code_end;
+	struct jit_block blocks[JIT_ROM_SIZE];
+
+	// ROM pages holding compiled code
+	uint8_t rom_pages[JIT_ROM_SIZE >> 8];
+
+	// Pages that compiled code reads straight from host memory
+	uint8_t read_pages[0x100];
+};
+
+/*
+ * Supported instructions
+ */
+enum op {
+	OP_NONE,
+	OP_LDA, OP_LDX, OP_LDY, OP_STA, OP_STX, OP_STY,
+	OP_ORA, OP_AND, OP_EOR, OP_ADC, OP_SBC,
+	OP_CMP, OP_CPX, OP_CPY, OP_BIT,
+	OP_INC, OP_DEC, OP_ASL, OP_LSR, OP_ROL, OP_ROR,
+	OP_INX, OP_INY, OP_DEX, OP_DEY,
+	OP_TAX, OP_TAY, OP_TXA, OP_TYA,
+	OP_CLC, OP_SEC, OP_CLI, OP_SEI, OP_CLV, OP_CLD, OP_SED, OP_NOP,
+	OP_BPL, OP_BMI, OP_BVC, OP_BVS, OP_BCC, OP_BCS, OP_BNE, OP_BEQ,
+	OP_JMP
+};
+
+enum mode {
+	MODE_IMP,
+	MODE_ACC,
+	MODE_IMM,
+	MODE_ZP,
+	MODE_ZPX,
+	MODE_ZPY,
+	MODE_ABS,
+	MODE_ABX,
+	MODE_ABY,
+	MODE_REL
+};
+
+static const uint8_t mode_length[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 2};
+
+struct op_info {
+	uint8_t op;
+	uint8_t mode;
+	uint8_t cycles;
+};
+
+/* Cycle counts are the ones used by the handlers in cpu.c */
+static const struct op_info ops[256] = {
+	[0xA9] = {OP_LDA, MODE_IMM, 2}, [0xA5] = {OP_LDA, MODE_ZP, 3},
+	[0xB5] = {OP_LDA, MODE_ZPX, 4}, [0xAD] = {OP_LDA, MODE_ABS, 4},
+	[0xBD] = {OP_LDA, MODE_ABX, 4}, [0xB9] = {OP_LDA, MODE_ABY, 4},
+	[0xA2] = {OP_LDX, MODE_IMM, 2}, [0xA6] = {OP_LDX, MODE_ZP, 3},
+	[0xB6] = {OP_LDX, MODE_ZPY, 4}, [0xAE] = {OP_LDX, MODE_ABS, 4},
+	[0xBE] = {OP_LDX, MODE_ABY, 4},
+	[0xA0] = {OP_LDY, MODE_IMM, 2}, [0xA4] = {OP_LDY, MODE_ZP, 3},
+	[0xB4] = {OP_LDY, MODE_ZPX, 4}, [0xAC] = {OP_LDY, MODE_ABS, 4},
+	[0xBC] = {OP_LDY, MODE_ABX, 4},
+	[0x85] = {OP_STA, MODE_ZP, 3}, [0x95] = {OP_STA, MODE_ZPX, 4},
+	[0x8D] = {OP_STA, MODE_ABS, 4}, [0x9D] = {OP_STA, MODE_ABX, 5},
+	[0x99] = {OP_STA, MODE_ABY, 5},
+	[0x86] = {OP_STX, MODE_ZP, 3}, [0x96] = {OP_STX, MODE_ZPY, 4},
+	[0x8E] = {OP_STX, MODE_ABS, 4},
+	[0x84] = {OP_STY, MODE_ZP, 3}, [0x94] = {OP_STY, MODE_ZPX, 4},
+	[0x8C] = {OP_STY, MODE_ABS, 4},
+	[0x09] = {OP_ORA, MODE_IMM, 2}, [0x05] = {OP_ORA, MODE_ZP, 3},
+	[0x15] = {OP_ORA, MODE_ZPX, 4}, [0x0D] = {OP_ORA, MODE_ABS, 4},
+	[0x1D] = {OP_ORA, MODE_ABX, 4}, [0x19] = {OP_ORA, MODE_ABY, 4},
+	[0x29] = {OP_AND, MODE_IMM, 2}, [0x25] = {OP_AND, MODE_ZP, 3},
+	[0x35] = {OP_AND, MODE_ZPX, 4}, [0x2D] = {OP_AND, MODE_ABS, 4},
+	[0x3D] = {OP_AND, MODE_ABX, 4}, [0x39] = {OP_AND, MODE_ABY, 4},
+	[0x49] = {OP_EOR, MODE_IMM, 2}, [0x45] = {OP_EOR, MODE_ZP, 3},
+	[0x55] = {OP_EOR, MODE_ZPX, 4}, [0x4D] = {OP_EOR, MODE_ABS, 4},
+	[0x5D] = {OP_EOR, MODE_ABX, 4}, [0x59] = {OP_EOR, MODE_ABY, 4},
+	[0x69] = {OP_ADC, MODE_IMM, 2}, [0x65] = {OP_ADC, MODE_ZP, 3},
+	[0x75] = {OP_ADC, MODE_ZPX, 4}, [0x6D] = {OP_ADC, MODE_ABS, 4},
+	[0x7D] = {OP_ADC, MODE_ABX, 4}, [0x79] = {OP_ADC, MODE_ABY, 4},
+	[0xE9] = {OP_SBC, MODE_IMM, 2}, [0xE5] = {OP_SBC, MODE_ZP, 3},
+	[0xF5] = {OP_SBC, MODE_ZPX, 4}, [0xED] = {OP_SBC, MODE_ABS, 4},
+	[0xFD] = {OP_SBC, MODE_ABX, 4}, [0xF9] = {OP_SBC, MODE_ABY, 4},
+	[0xC9] = {OP_CMP, MODE_IMM, 2}, [0xC5] = {OP_CMP, MODE_ZP, 3},
+	[0xD5] = {OP_CMP, MODE_ZPX, 4}, [0xCD] = {OP_CMP, MODE_ABS, 4},
+	[0xDD] = {OP_CMP, MODE_ABX, 4}, [0xD9] = {OP_CMP, MODE_ABY, 4},
+	[0xE0] = {OP_CPX, MODE_IMM, 2}, [0xE4] = {OP_CPX, MODE_ZP, 3},
+	[0xEC] = {OP_CPX, MODE_ABS, 4},
+	[0xC0] = {OP_CPY, MODE_IMM, 2}, [0xC4] = {OP_CPY, MODE_ZP, 3},
+	[0xCC] = {OP_CPY, MODE_ABS, 4},
+	[0x24] = {OP_BIT, MODE_ZP, 3}, [0x2C] = {OP_BIT, MODE_ABS, 4},
+	[0xE6] = {OP_INC, MODE_ZP, 5}, [0xF6] = {OP_INC, MODE_ZPX, 6},
+	[0xEE] = {OP_INC, MODE_ABS, 6}, [0xFE] = {OP_INC, MODE_ABX, 7},
+	[0xC6] = {OP_DEC, MODE_ZP, 5}, [0xD6] = {OP_DEC, MODE_ZPX, 6},
+	[0xCE] = {OP_DEC, MODE_ABS, 6}, [0xDE] = {OP_DEC, MODE_ABX, 7},
+	[0x0A] = {OP_ASL, MODE_ACC, 2}, [0x06] = {OP_ASL, MODE_ZP, 5},
+	[0x16] = {OP_ASL, MODE_ZPX, 6}, [0x0E] = {OP_ASL, MODE_ABS, 6},
+	[0x1E] = {OP_ASL, MODE_ABX, 7},
+	[0x4A] = {OP_LSR, MODE_ACC, 2}, [0x46] = {OP_LSR, MODE_ZP, 5},
+	[0x56] = {OP_LSR, MODE_ZPX, 6}, [0x4E] = {OP_LSR, MODE_ABS, 6},
+	[0x5E] = {OP_LSR, MODE_ABX, 7},
+	[0x2A] = {OP_ROL, MODE_ACC, 2}, [0x26] = {OP_ROL, MODE_ZP, 5},
+	[0x36] = {OP_ROL, MODE_ZPX, 6}, [0x2E] = {OP_ROL, MODE_ABS, 6},
+	[0x3E] = {OP_ROL, MODE_ABX, 7},
+	[0x6A] = {OP_ROR, MODE_ACC, 2}, [0x66] = {OP_ROR, MODE_ZP, 5},
+	[0x76] = {OP_ROR, MODE_ZPX, 6}, [0x6E] = {OP_ROR, MODE_ABS, 6},
+	[0x7E] = {OP_ROR, MODE_ABX, 7},
+	[0xE8] = {OP_INX, MODE_IMP, 2}, [0xC8] = {OP_INY, MODE_IMP, 2},
+	[0xCA] = {OP_DEX, MODE_IMP, 2}, [0x88] = {OP_DEY, MODE_IMP, 2},
+	[0xAA] = {OP_TAX, MODE_IMP, 2}, [0xA8] = {OP_TAY, MODE_IMP, 2},
+	[0x8A] = {OP_TXA, MODE_IMP, 2}, [0x98] = {OP_TYA, MODE_IMP, 2},
+	[0x18] = {OP_CLC, MODE_IMP, 2}, [0x38] = {OP_SEC, MODE_IMP, 2},
+	[0x58] = {OP_CLI, MODE_IMP, 2}, [0x78] = {OP_SEI, MODE_IMP, 2},
+	[0xB8] = {OP_CLV, MODE_IMP, 2}, [0xD8] = {OP_CLD, MODE_IMP, 2},
+	[0xF8] = {OP_SED, MODE_IMP, 2}, [0xEA] = {OP_NOP, MODE_IMP, 2},
+	[0x10] = {OP_BPL, MODE_REL, 2}, [0x30] = {OP_BMI, MODE_REL, 2},
+	[0x50] = {OP_BVC, MODE_REL, 2}, [0x70] = {OP_BVS, MODE_REL, 2},
+	[0x90] = {OP_BCC, MODE_REL, 2}, [0xB0] = {OP_BCS, MODE_REL, 2},
+	[0xD0] = {OP_BNE, MODE_REL, 2}, [0xF0] = {OP_BEQ, MODE_REL, 2},
+	[0x4C] = {OP_JMP, MODE_ABS, 3}
+};
+
+enum access {
+	ACCESS_NONE,
+	ACCESS_READ,
+	ACCESS_WRITE,
+	ACCESS_RMW
+};
+
+struct insn {
+	uint16_t pc;
+	uint16_t operand;
+	uint8_t op;
+	uint8_t mode;
+	uint8_t cycles;
+	// Flags that are read later, so must be computed
+	uint8_t live_flags;
+};
+
+/* Where the 6502 carry comes from after an instruction */
+enum carry {
+	CARRY_HOST,
+	CARRY_INVERTED,
+	CARRY_EDX
+};
+
+struct emitter {
+	uint8_t *p;
+};
+
+static enum access access_for_op(const uint8_t op, const uint8_t mode)
+{
+	switch (op) {
+	case OP_STA: case OP_STX: case OP_STY:
+		return ACCESS_WRITE;
+	case OP_INC: case OP_DEC: case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+		return mode == MODE_ACC ? ACCESS_NONE : ACCESS_RMW;
+	case OP_LDA: case OP_LDX: case OP_LDY: case OP_ORA: case OP_AND:
+	case OP_EOR: case OP_ADC: case OP_SBC: case OP_CMP: case OP_CPX:
+	case OP_CPY: case OP_BIT:
+		return mode == MODE_IMM ? ACCESS_NONE : ACCESS_READ;
+	default:
+		return ACCESS_NONE;
+	}
+}
+
+static uint8_t flags_written(const uint8_t op)
+{
+	switch (op) {
+	case OP_ADC: case OP_SBC:
+		return N_FLAG | Z_FLAG | C_FLAG | V_FLAG;
+	case OP_CMP: case OP_CPX: case OP_CPY:
+	case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+		return N_FLAG | Z_FLAG | C_FLAG;
+	case OP_BIT:
+		return N_FLAG | Z_FLAG | V_FLAG;
+	case OP_STA: case OP_STX: case OP_STY: case OP_NOP: case OP_JMP:
+	case OP_BPL: case OP_BMI: case OP_BVC: case OP_BVS:
+	case OP_BCC: case OP_BCS: case OP_BNE: case OP_BEQ:
+		return 0;
+	case OP_CLC: case OP_SEC:
+		return C_FLAG;
+	case OP_CLV:
+		return V_FLAG;
+	case OP_CLI: case OP_SEI:
+		return I_FLAG;
+	case OP_CLD: case OP_SED:
+		return D_FLAG;
+	default:
+		return N_FLAG | Z_FLAG;
+	}
+}
+
+static uint8_t flags_read(const uint8_t op)
+{
+	switch (op) {
+	case OP_ADC: case OP_SBC: case OP_ROL: case OP_ROR:
+	case OP_BCC: case OP_BCS:
+		return C_FLAG;
+	case OP_BPL: case OP_BMI:
+		return N_FLAG;
+	case OP_BVC: case OP_BVS:
+		return V_FLAG;
+	case OP_BNE: case OP_BEQ:
+		return Z_FLAG;
+	default:
+		return 0;
+	}
+}
+
+static int is_block_end(const uint8_t op)
+{
+	return op >= OP_BPL;
+}
+
+/*
+ * Writes are compiled as calls to MEM_write, but only for internal and save
+ * RAM, which never hold compiled code and have no side effects.
+ */
+static int is_plain_ram(const uint32_t low, const uint32_t high)
+{
+	return (high < 0x2000) || (low >= 0x6000 && high < 0x8000);
+}
+
+/*
+ * The addresses the instruction's operand might be at.
+ */
+static void operand_range(const struct insn *insn, uint32_t *low, uint32_t *len)
+{
+	*low = insn->operand;
+	*len = 1;
+	if (insn->mode == MODE_ZPX || insn->mode == MODE_ZPY) {
+		// Wraps around within the zero page
+		*low = 0;
+		*len = 0x100;
+	} else if (insn->mode == MODE_ABX || insn->mode == MODE_ABY) {
+		*len = 0x100;
+	}
+}
+
+/*
+ * Check that every address the instruction might access can be compiled.
+ */
+static int can_access(struct memory *memory, const struct insn *insn)
+{
+	enum access access = access_for_op(insn->op, insn->mode);
+	uint32_t low;
+	uint32_t len;
+
+	if (access == ACCESS_NONE) {
+		return 1;
+	}
+
+	operand_range(insn, &low, &len);
+
+	if (access != ACCESS_WRITE && MEM_host_pointer(memory, low, len) == NULL) {
+		return 0;
+	}
+	if (access != ACCESS_READ && !is_plain_ram(low, low + len - 1)) {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Decode the instruction at pc.  Returns 0 if it can not be compiled.
+ */
+static int decode_insn(struct memory *memory, const uint16_t pc, struct insn *insn)
+{
+	const struct op_info *info = &ops[MEM_read(memory, pc)];
+	uint8_t length = mode_length[info->mode];
+
+	if (info->op == OP_NONE || (uint32_t)pc + length > 0x10000) {
+		return 0;
+	}
+
+	insn->pc = pc;
+	insn->op = info->op;
+	insn->mode = info->mode;
+	insn->cycles = info->cycles;
+	insn->operand = 0;
+	if (length > 1) {
+		insn->operand = MEM_read(memory, pc + 1);
+	}
+	if (length > 2) {
+		insn->operand |= MEM_read(memory, pc + 2)<<8;
+	}
+
+	return can_access(memory, insn);
+}
+
+/*
+ * Machine code emitters
+ */
+static void emit8(struct emitter *e, const uint8_t b)
+{
+	*e->p++ = b;
+}
+
+static void emit16(struct emitter *e, const uint16_t v)
+{
+	memcpy(e->p, &v, 2);
+	e->p += 2;
+}
+
+static void emit32(struct emitter *e, const uint32_t v)
+{
+	memcpy(e->p, &v, 4);
+	e->p += 4;
+}
+
+static void emit64(struct emitter *e, const uint64_t v)
+{
+	memcpy(e->p, &v, 8);
+	e->p += 8;
+}
+
+/*
+ * REX prefix.  Byte operations always get one, so that registers 4 - 7 are
+ * spl, bpl, sil and dil rather than ah, ch, dh and bh.
+ */
+static void emit_rex(struct emitter *e, const int w, const int reg, const int index, const int base, const int force)
+{
+	uint8_t rex = 0x40 | (w<<3) | ((reg>>3)<<2) | ((index>>3)<<1) | (base>>3);
+	if (rex != 0x40 || force) {
+		emit8(e, rex);
+	}
+}
+
+static void emit_modrm_rr(struct emitter *e, const int reg, const int rm)
+{
+	emit8(e, 0xC0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+/* op rm, reg, for 8 or 32 bit opcodes */
+static void emit_op_rr(struct emitter *e, const uint8_t opcode, const int reg, const int rm, const int byte_op)
+{
+	emit_rex(e, 0, reg, 0, rm, byte_op);
+	emit8(e, opcode);
+	emit_modrm_rr(e, reg, rm);
+}
+
+/* 32 bit op rm, imm32, where ext is the /digit of opcode 0x81 */
+static void emit_op_ri32(struct emitter *e, const int ext, const int rm, const uint32_t imm)
+{
+	emit_rex(e, 0, 0, 0, rm, 0);
+	emit8(e, 0x81);
+	emit_modrm_rr(e, ext, rm);
+	emit32(e, imm);
+}
+
+/* 8 bit op rm, imm8, where ext is the /digit of opcode 0x80 */
+static void emit_op_ri8(struct emitter *e, const int ext, const int rm, const uint8_t imm)
+{
+	emit_rex(e, 0, 0, 0, rm, 1);
+	emit8(e, 0x80);
+	emit_modrm_rr(e, ext, rm);
+	emit8(e, imm);
+}
+
+/* 8 bit shift or rotate by one, or inc/dec, with ext as the /digit */
+static void emit_op_r8(struct emitter *e, const uint8_t opcode, const int ext, const int rm)
+{
+	emit_rex(e, 0, 0, 0, rm, 1);
+	emit8(e, opcode);
+	emit_modrm_rr(e, ext, rm);
+}
+
+static void emit_movzx8(struct emitter *e, const int dst, const int src)
+{
+	emit_rex(e, 0, dst, 0, src, 1);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit_modrm_rr(e, dst, src);
+}
+
+static void emit_mov32(struct emitter *e, const int dst, const int src)
+{
+	emit_op_rr(e, 0x89, src, dst, 0);
+}
+
+static void emit_mov_imm32(struct emitter *e, const int reg, const uint32_t imm)
+{
+	emit_rex(e, 0, 0, 0, reg, 0);
+	emit8(e, 0xB8 + (reg & 7));
+	emit32(e, imm);
+}
+
+static void emit_mov_imm64(struct emitter *e, const int reg, const uint64_t imm)
+{
+	emit_rex(e, 1, 0, 0, reg, 0);
+	emit8(e, 0xB8 + (reg & 7));
+	emit64(e, imm);
+}
+
+/* movzx reg, byte [rbx + disp] */
+static void emit_load_state(struct emitter *e, const int reg, const uint8_t disp)
+{
+	emit_rex(e, 0, reg, 0, RBX, 0);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit8(e, 0x40 | ((reg & 7)<<3) | RBX);
+	emit8(e, disp);
+}
+
+/* mov byte [rbx + disp], reg */
+static void emit_store_state(struct emitter *e, const int reg, const uint8_t disp)
+{
+	emit_rex(e, 0, reg, 0, RBX, 1);
+	emit8(e, 0x88);
+	emit8(e, 0x40 | ((reg & 7)<<3) | RBX);
+	emit8(e, disp);
+}
+
+/* mov word [rbx + 4], pc */
+static void emit_store_pc(struct emitter *e, const uint16_t pc)
+{
+	emit8(e, 0x66);
+	emit8(e, 0xC7);
+	emit8(e, 0x43);
+	emit8(e, 4);
+	emit16(e, pc);
+}
+
+/* bt r12d, 0, to load the 6502 carry into the host carry */
+static void emit_load_carry(struct emitter *e)
+{
+	emit8(e, 0x41);
+	emit8(e, 0x0F);
+	emit8(e, 0xBA);
+	emit8(e, 0xE4);
+	emit8(e, 0);
+}
+
+static uint8_t index_register(const uint8_t mode)
+{
+	return (mode == MODE_ZPX || mode == MODE_ABX) ? REG_X : REG_Y;
+}
+
+/*
+ * Load the operand of a read or read-modify-write instruction into eax.
+ * Uses rcx.
+ */
+static void emit_read(struct emitter *e, struct memory *memory, const struct insn *insn)
+{
+	uint8_t index = index_register(insn->mode);
+
+	switch (insn->mode) {
+	case MODE_IMM:
+		emit_mov_imm32(e, RAX, insn->operand);
+		return;
+	case MODE_ZP:
+	case MODE_ABS:
+		emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)MEM_host_pointer(memory, insn->operand, 1));
+		// movzx eax, byte [rax]
+		emit8(e, 0x0F);
+		emit8(e, 0xB6);
+		emit8(e, 0x00);
+		return;
+	case MODE_ZPX:
+	case MODE_ZPY:
+		emit_mov32(e, RCX, index);
+		emit_op_ri8(e, 0, RCX, insn->operand);
+		emit_movzx8(e, RCX, RCX);
+		emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)MEM_host_pointer(memory, 0, 0x100));
+		index = RCX;
+		break;
+	default:
+		emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)MEM_host_pointer(memory, insn->operand, 0x100));
+		break;
+	}
+
+	// movzx eax, byte [rax + index]
+	emit_rex(e, 0, 0, index, 0, 0);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit8(e, 0x04);
+	emit8(e, ((index & 7)<<3) | RAX);
+}
+
+/*
+ * Reads with absolute indexed addressing take a cycle more when the index
+ * crosses a page.
+ */
+static void emit_page_cross_penalty(struct emitter *e, const struct insn *insn)
+{
+	uint8_t low = insn->operand & 0xFF;
+
+	if (low == 0) {
+		return;
+	}
+	// mov ecx, index; add cl, low; adc ebp, 0
+	emit_mov32(e, RCX, index_register(insn->mode));
+	emit_op_ri8(e, 0, RCX, low);
+	emit8(e, 0x83);
+	emit8(e, 0xD5);
+	emit8(e, 0x00);
+}
+
+/*
+ * Call MEM_write with the address of the instruction and the value in reg.
+ */
+static void emit_write(struct emitter *e, const struct insn *insn, const int reg)
+{
+	emit_mov32(e, RDX, reg);
+
+	switch (insn->mode) {
+	case MODE_ZPX:
+	case MODE_ZPY:
+		emit_mov32(e, RSI, index_register(insn->mode));
+		emit_op_ri8(e, 0, RSI, insn->operand);
+		emit_movzx8(e, RSI, RSI);
+		break;
+	case MODE_ABX:
+	case MODE_ABY:
+		emit_mov32(e, RSI, index_register(insn->mode));
+		emit_op_ri32(e, 0, RSI, insn->operand);
+		break;
+	default:
+		emit_mov_imm32(e, RSI, insn->operand);
+		break;
+	}
+
+	// mov rdi, [rbx + 8]
+	emit8(e, 0x48);
+	emit8(e, 0x8B);
+	emit8(e, 0x7B);
+	emit8(e, 8);
+	emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)&MEM_write);
+	// call rax
+	emit8(e, 0xFF);
+	emit8(e, 0xD0);
+}
+
+/* Set the flags in mask from reg, leaving the rest of P alone */
+static void emit_merge_flags(struct emitter *e, const int reg, const uint8_t mask)
+{
+	emit_op_ri32(e, 4, REG_P, ~(uint32_t)mask);
+	emit_op_ri32(e, 4, reg, mask);
+	emit_op_rr(e, 0x09, reg, REG_P, 0);
+}
+
+/* Move one host flag into its 6502 position, and or it into edi */
+static void emit_flag_bit(struct emitter *e, const uint8_t shift, const uint8_t mask)
+{
+	emit_mov32(e, RSI, RCX);
+	if (shift != 0) {
+		// shr esi, shift
+		emit8(e, 0xC1);
+		emit8(e, 0xEE);
+		emit8(e, shift);
+	}
+	emit_op_ri32(e, 4, RSI, mask);
+	emit_op_rr(e, 0x09, RSI, RDI, 0);
+}
+
+/*
+ * Copy N, Z, C and V from the host flags into P, for the flags in mask that
+ * are used later.  The host flags are those of the last arithmetic
+ * instruction, which has the same N and Z as the 6502.  Uses rcx, rsi and
+ * rdi.
+ */
+static void emit_flags(struct emitter *e, const uint8_t mask, const enum carry carry)
+{
+	if (mask == 0) {
+		return;
+	}
+
+	// pushfq; pop rcx; xor edi, edi
+	emit8(e, 0x9C);
+	emit8(e, 0x59);
+	emit_op_rr(e, 0x31, RDI, RDI, 0);
+
+	// SF and CF are in the same bits as N and C
+	if (mask & (N_FLAG)) {
+		emit_flag_bit(e, 0, N_FLAG);
+	}
+	// ZF is bit 6 and OF bit 11
+	if (mask & (Z_FLAG)) {
+		emit_flag_bit(e, 5, Z_FLAG);
+	}
+	if (mask & (V_FLAG)) {
+		emit_flag_bit(e, 5, V_FLAG);
+	}
+	if (mask & (C_FLAG)) {
+		if (carry == CARRY_HOST) {
+			emit_flag_bit(e, 0, C_FLAG);
+		} else {
+			if (carry == CARRY_INVERTED) {
+				// mov esi, ecx; not esi
+				emit_mov32(e, RSI, RCX);
+				emit8(e, 0xF7);
+				emit8(e, 0xD6);
+			} else {
+				emit_mov32(e, RSI, RDX);
+			}
+			emit_op_ri32(e, 4, RSI, C_FLAG);
+			emit_op_rr(e, 0x09, RSI, RDI, 0);
+		}
+	}
+
+	emit_merge_flags(e, RDI, mask);
+}
+
+/* test reg, reg for the N and Z of a register */
+static void emit_test8(struct emitter *e, const int reg)
+{
+	emit_op_rr(e, 0x84, reg, reg, 1);
+}
+
+static void emit_load(struct emitter *e, struct memory *memory, const struct insn *insn, const int reg)
+{
+	emit_read(e, memory, insn);
+	emit_mov32(e, reg, RAX);
+	if (insn->live_flags) {
+		emit_test8(e, RAX);
+		emit_flags(e, insn->live_flags, CARRY_HOST);
+	}
+}
+
+static void emit_compare(struct emitter *e, struct memory *memory, const struct insn *insn, const int reg)
+{
+	emit_read(e, memory, insn);
+	emit_op_rr(e, 0x38, RAX, reg, 1);
+	emit_flags(e, insn->live_flags, CARRY_INVERTED);
+}
+
+static void emit_transfer(struct emitter *e, const struct insn *insn, const int dst, const int src)
+{
+	emit_mov32(e, dst, src);
+	if (insn->live_flags) {
+		emit_test8(e, dst);
+		emit_flags(e, insn->live_flags, CARRY_HOST);
+	}
+}
+
+static void emit_inc_dec_register(struct emitter *e, const struct insn *insn, const int ext, const int reg)
+{
+	emit_op_r8(e, 0xFE, ext, reg);
+	emit_flags(e, insn->live_flags, CARRY_HOST);
+}
+
+/*
+ * Shifts, rotates, INC and DEC, on A or memory.  ext is the /digit of the
+ * x86 instruction, with opcode 0xD0 for shifts and 0xFE for INC and DEC.
+ */
+static void emit_modify(struct emitter *e, struct memory *memory, const struct insn *insn, const uint8_t opcode, const int ext)
+{
+	int reg = RAX;
+	int rotate = (insn->op == OP_ROL || insn->op == OP_ROR);
+
+	if (insn->mode == MODE_ACC) {
+		reg = REG_A;
+	} else {
+		emit_read(e, memory, insn);
+	}
+
+	if (rotate) {
+		emit_load_carry(e);
+	}
+	emit_op_r8(e, opcode, ext, reg);
+	if (rotate && insn->live_flags) {
+		// rcl and rcr leave SF and ZF alone, so keep CF and test
+		// setc dl
+		emit8(e, 0x0F);
+		emit8(e, 0x92);
+		emit8(e, 0xC2);
+		emit_test8(e, reg);
+	}
+	emit_flags(e, insn->live_flags, rotate ? CARRY_EDX : CARRY_HOST);
+
+	if (insn->mode != MODE_ACC) {
+		emit_write(e, insn, RAX);
+	}
+}
+
+static void emit_set_flag(struct emitter *e, const uint8_t flag)
+{
+	emit_op_ri32(e, 1, REG_P, flag);
+}
+
+static void emit_clear_flag(struct emitter *e, const uint8_t flag)
+{
+	emit_op_ri32(e, 4, REG_P, ~(uint32_t)flag);
+}
+
+/*
+ * Conditional branches end the block.  The PC of the next instruction is
+ * stored, and replaced by the target if the branch is taken.
+ */
+static void emit_branch(struct emitter *e, const struct insn *insn, const uint8_t flag, const int taken_if_set)
+{
+	uint16_t next = insn->pc + 2;
+	uint16_t target = next + (int8_t)insn->operand;
+	uint8_t *skip;
+
+	emit_store_pc(e, next);
+	// test r12d, flag
+	emit8(e, 0x41);
+	emit8(e, 0xF7);
+	emit8(e, 0xC4);
+	emit32(e, flag);
+	// jz or jnz over the taken path
+	emit8(e, taken_if_set ? 0x74 : 0x75);
+	skip = e->p;
+	emit8(e, 0);
+
+	emit_store_pc(e, target);
+	// inc ebp
+	emit8(e, 0xFF);
+	emit8(e, 0xC5);
+
+	*skip = (uint8_t)(e->p - skip - 1);
+}
+
+static void emit_insn(struct emitter *e, struct memory *memory, const struct insn *insn)
+{
+	if (access_for_op(insn->op, insn->mode) == ACCESS_READ && (insn->mode == MODE_ABX || insn->mode == MODE_ABY)) {
+		emit_page_cross_penalty(e, insn);
+	}
+
+	switch (insn->op) {
+	case OP_LDA: emit_load(e, memory, insn, REG_A); break;
+	case OP_LDX: emit_load(e, memory, insn, REG_X); break;
+	case OP_LDY: emit_load(e, memory, insn, REG_Y); break;
+	case OP_STA: emit_write(e, insn, REG_A); break;
+	case OP_STX: emit_write(e, insn, REG_X); break;
+	case OP_STY: emit_write(e, insn, REG_Y); break;
+	case OP_ORA:
+	case OP_AND:
+	case OP_EOR:
+		emit_read(e, memory, insn);
+		emit_op_rr(e, insn->op == OP_ORA ? 0x08 : (insn->op == OP_AND ? 0x20 : 0x30), RAX, REG_A, 1);
+		emit_flags(e, insn->live_flags, CARRY_HOST);
+		break;
+	case OP_ADC:
+		emit_read(e, memory, insn);
+		emit_load_carry(e);
+		emit_op_rr(e, 0x10, RAX, REG_A, 1);
+		emit_flags(e, insn->live_flags, CARRY_HOST);
+		break;
+	case OP_SBC:
+		// The 6502 carry is the inverse of the x86 borrow
+		emit_read(e, memory, insn);
+		emit_load_carry(e);
+		emit8(e, 0xF5);
+		emit_op_rr(e, 0x18, RAX, REG_A, 1);
+		emit_flags(e, insn->live_flags, CARRY_INVERTED);
+		break;
+	case OP_CMP: emit_compare(e, memory, insn, REG_A); break;
+	case OP_CPX: emit_compare(e, memory, insn, REG_X); break;
+	case OP_CPY: emit_compare(e, memory, insn, REG_Y); break;
+	case OP_BIT:
+		emit_read(e, memory, insn);
+		if (insn->live_flags) {
+			// N and V are bits 7 and 6 of the operand, Z is from A & operand
+			emit_op_rr(e, 0x84, RAX, REG_A, 1);
+			// setz dl; movzx edx, dl; add edx, edx
+			emit8(e, 0x0F);
+			emit8(e, 0x94);
+			emit8(e, 0xC2);
+			emit_movzx8(e, RDX, RDX);
+			emit_op_rr(e, 0x01, RDX, RDX, 0);
+			emit_op_ri32(e, 4, RAX, N_FLAG | V_FLAG);
+			emit_op_rr(e, 0x09, RDX, RAX, 0);
+			emit_merge_flags(e, RAX, insn->live_flags);
+		}
+		break;
+	case OP_INC: emit_modify(e, memory, insn, 0xFE, 0); break;
+	case OP_DEC: emit_modify(e, memory, insn, 0xFE, 1); break;
+	case OP_ASL: emit_modify(e, memory, insn, 0xD0, 4); break;
+	case OP_LSR: emit_modify(e, memory, insn, 0xD0, 5); break;
+	case OP_ROL: emit_modify(e, memory, insn, 0xD0, 2); break;
+	case OP_ROR: emit_modify(e, memory, insn, 0xD0, 3); break;
+	case OP_INX: emit_inc_dec_register(e, insn, 0, REG_X); break;
+	case OP_INY: emit_inc_dec_register(e, insn, 0, REG_Y); break;
+	case OP_DEX: emit_inc_dec_register(e, insn, 1, REG_X); break;
+	case OP_DEY: emit_inc_dec_register(e, insn, 1, REG_Y); break;
+	case OP_TAX: emit_transfer(e, insn, REG_X, REG_A); break;
+	case OP_TAY: emit_transfer(e, insn, REG_Y, REG_A); break;
+	case OP_TXA: emit_transfer(e, insn, REG_A, REG_X); break;
+	case OP_TYA: emit_transfer(e, insn, REG_A, REG_Y); break;
+	case OP_CLC: emit_clear_flag(e, C_FLAG); break;
+	case OP_SEC: emit_set_flag(e, C_FLAG); break;
+	case OP_CLI: emit_clear_flag(e, I_FLAG); break;
+	case OP_SEI: emit_set_flag(e, I_FLAG); break;
+	case OP_CLV: emit_clear_flag(e, V_FLAG); break;
+	case OP_CLD: emit_clear_flag(e, D_FLAG); break;
+	case OP_SED: emit_set_flag(e, D_FLAG); break;
+	case OP_NOP: break;
+	case OP_BPL: emit_branch(e, insn, N_FLAG, 0); break;
+	case OP_BMI: emit_branch(e, insn, N_FLAG, 1); break;
+	case OP_BVC: emit_branch(e, insn, V_FLAG, 0); break;
+	case OP_BVS: emit_branch(e, insn, V_FLAG, 1); break;
+	case OP_BCC: emit_branch(e, insn, C_FLAG, 0); break;
+	case OP_BCS: emit_branch(e, insn, C_FLAG, 1); break;
+	case OP_BNE: emit_branch(e, insn, Z_FLAG, 0); break;
+	case OP_BEQ: emit_branch(e, insn, Z_FLAG, 1); break;
+	case OP_JMP: emit_store_pc(e, insn->operand); break;
+	}
+}
+
+static void emit_prologue(struct emitter *e)
+{
+	// push rbx; push rbp; push r12; push r13; push r14; push r15
+	emit8(e, 0x53);
+	emit8(e, 0x55);
+	emit8(e, 0x41);
+	emit8(e, 0x54);
+	emit8(e, 0x41);
+	emit8(e, 0x55);
+	emit8(e, 0x41);
+	emit8(e, 0x56);
+	emit8(e, 0x41);
+	emit8(e, 0x57);
+	// sub rsp, 8 to keep calls 16 byte aligned
+	emit8(e, 0x48);
+	emit8(e, 0x83);
+	emit8(e, 0xEC);
+	emit8(e, 0x08);
+	// mov rbx, rdi; xor ebp, ebp
+	emit8(e, 0x48);
+	emit8(e, 0x89);
+	emit8(e, 0xFB);
+	emit_op_rr(e, 0x31, RBP, RBP, 0);
+
+	emit_load_state(e, REG_A, 0);
+	emit_load_state(e, REG_X, 1);
+	emit_load_state(e, REG_Y, 2);
+	emit_load_state(e, REG_P, 3);
+}
+
+static void emit_epilogue(struct emitter *e, const uint32_t cycles)
+{
+	emit_store_state(e, REG_A, 0);
+	emit_store_state(e, REG_X, 1);
+	emit_store_state(e, REG_Y, 2);
+	emit_store_state(e, REG_P, 3);
+
+	// mov eax, ebp; add eax, cycles
+	emit_mov32(e, RAX, RBP);
+	emit8(e, 0x05);
+	emit32(e, cycles);
+
+	// add rsp, 8; pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret
+	emit8(e, 0x48);
+	emit8(e, 0x83);
+	emit8(e, 0xC4);
+	emit8(e, 0x08);
+	emit8(e, 0x41);
+	emit8(e, 0x5F);
+	emit8(e, 0x41);
+	emit8(e, 0x5E);
+	emit8(e, 0x41);
+	emit8(e, 0x5D);
+	emit8(e, 0x41);
+	emit8(e, 0x5C);
+	emit8(e, 0x5D);
+	emit8(e, 0x5B);
+	emit8(e, 0xC3);
+}
+
+/*
+ * Work out which flags each instruction has to compute.  A flag that is
+ * overwritten before anything reads it is dead, and the flags are all live
+ * at the end of the block.
+ */
+static void find_live_flags(struct insn *insns, const int count)
+{
+	uint8_t live = ALL_FLAGS;
+	int i;
+
+	for (i = count - 1; i >= 0; i--) {
+		uint8_t written = flags_written(insns[i].op);
+		insns[i].live_flags = written & live;
+		live = (live & ~written) | flags_read(insns[i].op);
+	}
+}
+
+/*
+ * Set the protection of the code buffer pages overlapping [start, end), to
+ * writable or executable.  Returns 0 on failure.
+ */
+static int protect(uint8_t *start, uint8_t *end, const int writable)
+{
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t first = (uintptr_t)start & ~(page - 1);
+	uintptr_t last = ((uintptr_t)end + page - 1) & ~(page - 1);
+	int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+
+	return mprotect((void *)first, last - first, prot) == 0;
+}
+
+static void compile(struct jit *jit, struct memory *memory, const uint16_t pc, struct jit_block *block)
+{
+	struct insn insns[JIT_MAX_BLOCK_INSTRUCTIONS];
+	struct emitter e;
+	uint32_t addr = pc;
+	uint32_t cycles = 0;
+	uint32_t max_cycles = 0;
+	int count = 0;
+	int i;
+
+	while (count < JIT_MAX_BLOCK_INSTRUCTIONS && addr < 0x10000) {
+		struct insn *insn = &insns[count];
+		if (decode_insn(memory, addr, insn) == 0) {
+			break;
+		}
+		addr += mode_length[insn->mode];
+		count++;
+		if (is_block_end(insn->op)) {
+			break;
+		}
+	}
+
+	if (count == 0) {
+		block->state = BLOCK_NONE;
+		return;
+	}
+
+	if (jit->code + JIT_CODE_SIZE - jit->code_end < JIT_MAX_BLOCK_CODE) {
+		JIT_flush(jit);
+	}
+
+	find_live_flags(insns, count);
+
+	if (protect(jit->code_end, jit->code_end + JIT_MAX_BLOCK_CODE, 1) == 0) {
+		block->state = BLOCK_NONE;
+		return;
+	}
+
+	e.p = jit->code_end;
+	emit_prologue(&e);
+	for (i = 0; i < count; i++) {
+		emit_insn(&e, memory, &insns[i]);
+		cycles += insns[i].cycles;
+		max_cycles += insns[i].cycles;
+		if (access_for_op(insns[i].op, insns[i].mode) == ACCESS_READ &&
+				(insns[i].mode == MODE_ABX || insns[i].mode == MODE_ABY)) {
+			max_cycles++;
+		}
+		if (insns[i].mode == MODE_REL) {
+			max_cycles++;
+		}
+	}
+	if (!is_block_end(insns[count - 1].op)) {
+		emit_store_pc(&e, addr);
+	}
+	emit_epilogue(&e, cycles);
+	if (protect(jit->code_end, e.p, 0) == 0) {
+		block->state = BLOCK_NONE;
+		return;
+	}
+
+	block->code = (uint32_t (*)(struct jit_state *))jit->code_end;
+	block->max_cycles = max_cycles;
+	block->state = BLOCK_COMPILED;
+	jit->code_end = e.p;
+
+	// Have writes to the compiled code reported back through
+	// CPU_invalidate_code
+	for (i = pc >> 8; i <= (int)((addr - 1) >> 8); i++) {
+		jit->rom_pages[i - (JIT_ROM_ADDR >> 8)] = 1;
+		MEM_watch_code(memory, i << 8);
+	}
+
+	// Reads have the host memory of the banks mapped now built in, so
+	// have bank switches of those pages reported back through
+	// CPU_invalidate_page
+	for (i = 0; i < count; i++) {
+		uint32_t low, len, page;
+
+		if (access_for_op(insns[i].op, insns[i].mode) == ACCESS_NONE ||
+				access_for_op(insns[i].op, insns[i].mode) == ACCESS_WRITE) {
+			continue;
+		}
+		operand_range(&insns[i], &low, &len);
+		for (page = low >> 8; page <= (low + len - 1) >> 8; page++) {
+			jit->read_pages[page] = 1;
+			MEM_watch_reads(memory, page << 8);
+		}
+	}
+}
+
+struct jit *JIT_init()
+{
+	struct jit *jit = malloc(sizeof(struct jit));
+
+	// Executable from the start, and never writable at the same time.
+	// Where mapping executable memory is refused, the interpreter runs
+	// everything.
+	jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, JIT_MAP_FLAGS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		free(jit);
+		return NULL;
+	}
+	JIT_flush(jit);
+
+	return jit;
+}
+
+void JIT_delete(struct jit **jit)
+{
+	(void)munmap((*jit)->code, JIT_CODE_SIZE);
+	free(*jit);
+	*jit = NULL;
+}
+
+const struct jit_block *JIT_lookup(struct jit *jit, struct memory *memory, const uint16_t pc, const uint32_t cycle_budget)
+{
+	struct jit_block *block;
+
+	if (pc < JIT_ROM_ADDR) {
+		return NULL;
+	}
+
+	block = &jit->blocks[pc - JIT_ROM_ADDR];
+	if (block->state == BLOCK_COLD) {
+		if (++block->heat < JIT_HOT_THRESHOLD) {
+			return NULL;
+		}
+		compile(jit, memory, pc, block);
+	}
+
+	if (block->state != BLOCK_COMPILED || block->max_cycles > cycle_budget) {
+		return NULL;
+	}
+	return block;
+}
+
+uint32_t JIT_execute(const struct jit_block *block, struct jit_state *state)
+{
+	return block->code(state);
+}
+
+void JIT_invalidate(struct jit *jit, const uint16_t addr)
+{
+	// Blocks can span pages and are rarely overwritten, so drop them all
+	if (addr >= JIT_ROM_ADDR && jit->rom_pages[(addr - JIT_ROM_ADDR) >> 8] != 0) {
+		JIT_flush(jit);
+	}
+}
+
+void JIT_invalidate_page(struct jit *jit, const uint8_t page)
+{
+	if (jit->read_pages[page] != 0) {
+		JIT_flush(jit);
+	} else {
+		JIT_invalidate(jit, page << 8);
+	}
+}
+
+void JIT_flush(struct jit *jit)
+{
+	memset(jit->blocks, 0, sizeof(jit->blocks));
+	memset(jit->rom_pages, 0, sizeof(jit->rom_pages));
+	memset(jit->read_pages, 0, sizeof(jit->read_pages));
+	jit->code_end = jit->code;
+}
+
+#else
+
+/* No recompiler for this host; the interpreter runs everything. */
+
+struct jit *JIT_init()
+{
+	return NULL;
+}
+
+void JIT_delete(struct jit **jit)
+{
+	*jit = NULL;
+}
+
+const struct jit_block *JIT_lookup(struct jit *jit, struct memory *memory, const uint16_t pc, const uint32_t cycle_budget)
+{
+	(void)jit;
+	(void)memory;
+	(void)pc;
+	(void)cycle_budget;
+	return NULL;
+}
+
+uint32_t JIT_execute(const struct jit_block *block, struct jit_state *state)
+{
+	(void)block;
+	(void)state;
+	return 0;
+}
+
+void JIT_invalidate(struct jit *jit, const uint16_t addr)
+{
+	(void)jit;
+	(void)addr;
+}
+
+void JIT_invalidate_page(struct jit *jit, const uint8_t page)
+{
+	(void)jit;
+	(void)page;
+}
+
+void JIT_flush(struct jit *jit)
+{
+	(void)jit;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  jit.h
+ *
+ *    Description:  Public interface to the x86-64 dynamic recompiler, which
+ *                  translates hot basic blocks of cartridge ROM code into
+ *                  native code.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 02:05:31 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include "memory.h"
+
+struct jit;
+struct jit_block;
+
+/*
+ * Registers passed in and out of a compiled block.  The generated code
+ * addresses these fields by offset, so their order must not change.
+ */
+struct jit_state {
+	uint8_t A;			// offset 0
+	uint8_t X;			// offset 1
+	uint8_t Y;			// offset 2
+	uint8_t P;			// offset 3
+	uint16_t PC;			// offset 4
+	struct memory *memory;		// offset 8
+};
+
+/*
+ * Create a recompiler.  Returns NULL when the host is not x86-64, or
+ * executable memory cannot be allocated.
+ */
+extern struct jit *JIT_init();
+
+/*
+ * Delete a recompiler and all of its compiled code.
+ */
+extern void JIT_delete(struct jit **);
+
+/*
+ * Return the compiled block starting at the given address, or NULL if the
+ * interpreter should execute the next instruction instead.  Addresses are
+ * counted each time they are looked up, and compiled once they are hot.
+ * Blocks that could use more than the given number of cycles are not
+ * returned, so that runs end on the same instruction as in the interpreter.
+ */
+extern const struct jit_block *JIT_lookup(struct jit *, struct memory *, const uint16_t, const uint32_t);
+
+/*
+ * Run a compiled block, updating the registers in the state.  Returns the
+ * number of cycles used.
+ */
+extern uint32_t JIT_execute(const struct jit_block *, struct jit_state *);
+
+/*
+ * Drop compiled blocks that include the byte at the given address.
+ */
+extern void JIT_invalidate(struct jit *, const uint16_t);
+
+/*
+ * Drop compiled blocks that include the given page, or read straight from it,
+ * because a different bank has been mapped there.
+ */
+extern void JIT_invalidate_page(struct jit *, const uint8_t);
+
+/*
+ * Drop all compiled blocks.
+ */
+extern void JIT_flush(struct jit *);
+
+#endif
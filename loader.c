@@ -17,33 +17,103 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define LOADER_MMAP
+#endif
 
 #include "loader.h"
 
-int LOADER_load_file(struct memory *mem, struct ppu_memory *ppu_mem, char *filename)
+#define HEADER_SIZE 16
+#define TRAINER_SIZE 512
+#define PRG_BANK_SIZE 0x4000
+#define CHR_BANK_SIZE 0x2000
+
+/*
+ * The whole file is mapped read only, and the mapper's banks point straight
+ * into it.  Pages are only read in from disk as the game touches them, and
+ * are shared between emulators running the same file.
+ */
+struct cartridge {
+	uint8_t *file;
+	size_t size;
+	struct mapper *mapper;
+};
+
+/*
+ * Map the file into memory, or read it all where mmap is not available.
+ * Returns NULL on failure.
+ */
+static uint8_t *map_file(const char *filename, size_t *size)
 {
+#ifdef LOADER_MMAP
+	struct stat st;
+	void *file;
+	int fd = open(filename, O_RDONLY);
+
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+		(void)close(fd);
+		return NULL;
+	}
+	*size = st.st_size;
+	file = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void)close(fd);
+	return file != MAP_FAILED ? file : NULL;
+#else
 	/* Open file in binary mode (needed for Windows) */
 	FILE *nes_file = fopen(filename, "rb");
+	uint8_t *file;
+	long length;
 
 	if (nes_file == NULL) {
-		(void)printf("Input file not found!\n");
-		return 0;
+		return NULL;
 	}
+	(void)fseek(nes_file, 0, SEEK_END);
+	length = ftell(nes_file);
+	(void)fseek(nes_file, 0, SEEK_SET);
+	file = length >= HEADER_SIZE ? malloc(length) : NULL;
+	if (file != NULL && fread(file, 1, length, nes_file) != (size_t)length) {
+		free(file);
+		file = NULL;
+	}
+	(void)fclose(nes_file);
+	*size = length;
+	return file;
+#endif
+}
+
+static void unmap_file(uint8_t *file, const size_t size)
+{
+#ifdef LOADER_MMAP
+	(void)munmap(file, size);
+#else
+	(void)size;
+	free(file);
+#endif
+}
 
-	/* Get the file header */
-	uint8_t header[16];
-	int bytes_read;
-	if ((bytes_read = fread(header, sizeof(uint8_t), 16, nes_file)) != 16) {
-		(void)printf("Only read %d bytes from file header!\n", bytes_read);
-		(void)fclose(nes_file);
-		return 0;
+struct cartridge *LOADER_load_file(struct memory *mem, struct ppu_memory *ppu_mem, char *filename)
+{
+	size_t size;
+	uint8_t *file = map_file(filename, &size);
+
+	if (file == NULL) {
+		(void)printf("Input file not found!\n");
+		return NULL;
 	}
-	
+
 	/* Ensure proper file format */
+	uint8_t *header = file;
 	if(strncmp((char *)header, "NES", 3) != 0) {
 		(void)printf("File is not an NES file!\n");	
-		(void)fclose(nes_file);
-		return 0;
+		unmap_file(file, size);
+		return NULL;
 	}
 
 	/* Number of memory banks */
@@ -55,6 +125,10 @@ int LOADER_load_file(struct memory *mem, struct ppu_memory *ppu_mem, char *filen
 	(void)printf("Number of 8 kb vrom banks: %d\n", num_8kb_vrom_banks);
 	(void)printf("Number of 8 kb ram banks: %d\n", num_8kb_ram_banks);
 
+	/* Name table mirroring, for mappers that do not switch it */
+	uint8_t mirroring = header[6] & 1;
+	(void)printf("Vertical mirroring: %d\n", mirroring);
+
 	/* Battery backed RAM? */
 	uint8_t battery_backed_ram_present = ((header[6] & (1<<1)) != 0);
 	(void)printf("Battery backed ram present: %d\n", battery_backed_ram_present);
@@ -63,24 +137,54 @@ int LOADER_load_file(struct memory *mem, struct ppu_memory *ppu_mem, char *filen
 	uint8_t trainer_present = ((header[6] & (1<<2)) != 0);
 	(void)printf("Trainer present: %d\n", trainer_present);
 
-	/* memory mapper type */
-	uint8_t mapper = (header[7] &= ~15) | (header[6]>>4);
+	/* memory mapper type, high nibble in byte 7 and low nibble in byte 6 */
+	uint8_t mapper = (header[7] & 0xF0) | (header[6] >> 4);
 	(void)printf("Memory mapper type: %d\n", mapper);
-	PPU_MEM_set_mirroring(ppu_mem, mapper);
+	if (MAPPER_supported(mapper) == 0) {
+		(void)printf("Memory mapper %d is not supported!\n", mapper);
+		unmap_file(file, size);
+		return NULL;
+	}
 
-	/* Load 512 byte trainer, if present in file */
-	if(trainer_present != 0) {
-		MEM_load_trainer(mem, nes_file);
+	/* The trainer, then the PRG banks, then the CHR banks */
+	size_t prg_offset = HEADER_SIZE + (trainer_present != 0 ? TRAINER_SIZE : 0);
+	uint32_t prg_size = num_16kb_rom_banks * PRG_BANK_SIZE;
+	uint32_t chr_size = num_8kb_vrom_banks * CHR_BANK_SIZE;
+	if (size < prg_offset + prg_size + chr_size) {
+		(void)printf("File is missing ROM banks!\n");
+		unmap_file(file, size);
+		return NULL;
 	}
 
-	/* Load the 16 kb ROM bank(s) into shared memory */
-	MEM_load_rom(mem, num_16kb_rom_banks, nes_file);
+	/* Copy the 512 byte trainer, if present in file */
+	if(trainer_present != 0) {
+		MEM_load_trainer(mem, file + HEADER_SIZE);
+	}
 
-	/* Load 8 kb VROM bank into PPU memory, if present */
-	if(num_8kb_vrom_banks == 1) {
-		PPU_MEM_load_vrom(ppu_mem, nes_file);
+	/* The mapper switches the ROM banks into memory */
+	struct cartridge *cart = malloc(sizeof(struct cartridge));
+	cart->file = file;
+	cart->size = size;
+	cart->mapper = MAPPER_init(mapper, mem, ppu_mem, file + prg_offset, prg_size,
+			file + prg_offset + prg_size, chr_size, mirroring);
+	if (cart->mapper == NULL) {
+		(void)printf("Could not map %d ROM banks!\n", num_16kb_rom_banks);
+		unmap_file(file, size);
+		free(cart);
+		return NULL;
 	}
+	return cart;
+}
 
-	(void)fclose(nes_file);
-	return 1;
+struct mapper *LOADER_mapper(const struct cartridge *cart)
+{
+	return cart->mapper;
+}
+
+void LOADER_delete(struct cartridge **cart)
+{
+	MAPPER_delete(&(*cart)->mapper);
+	unmap_file((*cart)->file, (*cart)->size);
+	free(*cart);
+	*cart = NULL;
 }
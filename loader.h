@@ -21,10 +21,24 @@
 
 #include "memory.h"
 #include "ppu_memory.h"
+#include "mapper.h"
+
+struct cartridge;
+
+/*
+ * Load the specified file, and map its ROM banks into CPU and PPU memory
+ * through the cartridge's mapper.  Returns NULL on failure.
+ */
+extern struct cartridge *LOADER_load_file(struct memory *, struct ppu_memory *, char *filename);
+
+/*
+ * Return the cartridge's mapper.
+ */
+extern struct mapper *LOADER_mapper(const struct cartridge *);
 
 /*
- * Load the specified file into CPU and PPU memory.  Returns 1 on success, 0 otherwise.
+ * Delete a cartridge, after the emulator has stopped using its memory.
  */
-extern int LOADER_load_file(struct memory *, struct ppu_memory *, char *filename);
+extern void LOADER_delete(struct cartridge **);
 
 #endif
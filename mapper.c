@@ -0,0 +1,405 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  mapper.c
+ *
+ *    Description:  NROM, MMC1, UxROM, CNROM and MMC3 cartridge mappers
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 04:48:12 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mapper.h"
+
+#define PRG_ADDR 0x8000
+#define PRG_WINDOW_SIZE 0x2000
+#define PRG_WINDOWS 4
+#define CHR_WINDOW_SIZE 0x0400
+#define CHR_WINDOWS 8
+#define NO_BANK 0xFFFFFFFF
+
+#define NROM 0
+#define MMC1 1
+#define UXROM 2
+#define CNROM 3
+#define MMC3 4
+
+struct mapper {
+	uint8_t number;
+	struct memory *mem;
+	struct ppu_memory *ppu_mem;
+
+	uint8_t *prg;
+	uint32_t prg_banks;		// in 8 kB windows
+	uint8_t *chr;			// NULL for CHR RAM
+	uint32_t chr_banks;		// in 1 kB windows
+
+	// Bank in each window, so that rewriting a register is free
+	uint32_t prg_window[PRG_WINDOWS];
+	uint32_t chr_window[CHR_WINDOWS];
+
+	// MMC1
+	uint8_t shift;
+	uint8_t shift_count;
+	uint8_t control;
+	uint8_t chr_bank_0;
+	uint8_t chr_bank_1;
+	uint8_t prg_bank;
+
+	// MMC3
+	uint8_t bank_select;
+	uint8_t bank_registers[8];
+	uint8_t irq_latch;
+	uint8_t irq_counter;
+	uint8_t irq_reload;
+	uint8_t irq_enabled;
+	uint8_t irq_pending;
+};
+
+static void write_register(void *, const uint16_t, const uint8_t);
+
+int MAPPER_supported(const uint8_t number)
+{
+	return number <= MMC3;
+}
+
+/*
+ * Point an 8 kB PRG window at the given 8 kB bank.  Banks past the end wrap
+ * around, as the unused high bank lines do on a cartridge.
+ */
+static void map_prg(struct mapper *mapper, const uint8_t window, uint32_t bank)
+{
+	bank %= mapper->prg_banks;
+	if (mapper->prg_window[window] == bank) {
+		return;
+	}
+	mapper->prg_window[window] = bank;
+	MEM_map_pages(mapper->mem, (PRG_ADDR + window * PRG_WINDOW_SIZE) >> 8,
+		PRG_WINDOW_SIZE / MEM_PAGE_SIZE, mapper->prg + bank * PRG_WINDOW_SIZE, NULL);
+}
+
+/*
+ * Point a 1 kB CHR window at the given 1 kB bank.  Nothing is switched for
+ * CHR RAM.
+ */
+static void map_chr(struct mapper *mapper, const uint8_t window, uint32_t bank)
+{
+	if (mapper->chr == NULL) {
+		return;
+	}
+	bank %= mapper->chr_banks;
+	if (mapper->chr_window[window] == bank) {
+		return;
+	}
+	// The PPU has to draw what it has reached with the old bank
+	MEM_sync_ppu(mapper->mem);
+	mapper->chr_window[window] = bank;
+	PPU_MEM_map_chr(mapper->ppu_mem, window, mapper->chr + bank * CHR_WINDOW_SIZE);
+}
+
+/* 16 kB PRG bank, in two windows */
+static void map_prg_16k(struct mapper *mapper, const uint8_t window, const uint32_t bank)
+{
+	map_prg(mapper, window, bank * 2);
+	map_prg(mapper, window + 1, bank * 2 + 1);
+}
+
+/* CHR bank of the given number of 1 kB windows */
+static void map_chr_banks(struct mapper *mapper, const uint8_t window, const uint8_t count, const uint32_t bank)
+{
+	uint8_t i;
+
+	for (i = 0; i < count; i++) {
+		map_chr(mapper, window + i, bank * count + i);
+	}
+}
+
+/*
+ * MMC1
+ */
+static void mmc1_update(struct mapper *mapper)
+{
+	// Control bits 0-1: one screen low, one screen high, vertical, horizontal
+	static const uint8_t mirroring[4] = {
+		PPU_MEM_MIRROR_SINGLE_LOW,
+		PPU_MEM_MIRROR_SINGLE_HIGH,
+		PPU_MEM_MIRROR_VERTICAL,
+		PPU_MEM_MIRROR_HORIZONTAL
+	};
+	uint8_t prg_bank = mapper->prg_bank & 0x0F;
+	uint32_t last_bank = mapper->prg_banks / 2 - 1;
+
+	MEM_sync_ppu(mapper->mem);
+	PPU_MEM_set_mirroring(mapper->ppu_mem, mirroring[mapper->control & 3]);
+
+	switch ((mapper->control >> 2) & 3) {
+		case 0:
+		case 1:
+			// 32 kB, ignoring the low bit
+			map_prg_16k(mapper, 0, prg_bank & ~1);
+			map_prg_16k(mapper, 2, prg_bank | 1);
+			break;
+		case 2:
+			// First bank fixed at 0x8000
+			map_prg_16k(mapper, 0, 0);
+			map_prg_16k(mapper, 2, prg_bank);
+			break;
+		case 3:
+			// Last bank fixed at 0xC000
+			map_prg_16k(mapper, 0, prg_bank);
+			map_prg_16k(mapper, 2, last_bank);
+			break;
+	}
+
+	if ((mapper->control & 0x10) == 0) {
+		// 8 kB, ignoring the low bit
+		map_chr_banks(mapper, 0, 4, mapper->chr_bank_0 & ~1);
+		map_chr_banks(mapper, 4, 4, mapper->chr_bank_0 | 1);
+	} else {
+		map_chr_banks(mapper, 0, 4, mapper->chr_bank_0);
+		map_chr_banks(mapper, 4, 4, mapper->chr_bank_1);
+	}
+}
+
+/*
+ * Registers are loaded one bit at a time, low bit first.  The fifth write
+ * picks the register from bits 13 and 14 of its address.
+ */
+static void mmc1_write(struct mapper *mapper, const uint16_t addr, const uint8_t val)
+{
+	if ((val & 0x80) != 0) {
+		// Reset, and fix the last bank at 0xC000
+		mapper->shift = 0;
+		mapper->shift_count = 0;
+		mapper->control |= 0x0C;
+		mmc1_update(mapper);
+		return;
+	}
+
+	mapper->shift |= (val & 1) << mapper->shift_count;
+	mapper->shift_count++;
+	if (mapper->shift_count < 5) {
+		return;
+	}
+
+	switch ((addr >> 13) & 3) {
+		case 0:
+			mapper->control = mapper->shift;
+			break;
+		case 1:
+			mapper->chr_bank_0 = mapper->shift;
+			break;
+		case 2:
+			mapper->chr_bank_1 = mapper->shift;
+			break;
+		case 3:
+			mapper->prg_bank = mapper->shift;
+			break;
+	}
+	mapper->shift = 0;
+	mapper->shift_count = 0;
+	mmc1_update(mapper);
+}
+
+/*
+ * MMC3
+ */
+static void mmc3_update(struct mapper *mapper)
+{
+	uint8_t *r = mapper->bank_registers;
+	uint32_t second_last = mapper->prg_banks - 2;
+	uint8_t inversion = (mapper->bank_select & 0x80) != 0 ? 4 : 0;
+
+	// Bit 6 swaps 0x8000 with the fixed, second last bank at 0xC000
+	if ((mapper->bank_select & 0x40) == 0) {
+		map_prg(mapper, 0, r[6]);
+		map_prg(mapper, 2, second_last);
+	} else {
+		map_prg(mapper, 0, second_last);
+		map_prg(mapper, 2, r[6]);
+	}
+	map_prg(mapper, 1, r[7]);
+	map_prg(mapper, 3, mapper->prg_banks - 1);
+
+	// Two 2 kB banks and four 1 kB banks, halves swapped by bit 7
+	map_chr(mapper, 0 ^ inversion, r[0] & ~1);
+	map_chr(mapper, 1 ^ inversion, r[0] | 1);
+	map_chr(mapper, 2 ^ inversion, r[1] & ~1);
+	map_chr(mapper, 3 ^ inversion, r[1] | 1);
+	map_chr(mapper, 4 ^ inversion, r[2]);
+	map_chr(mapper, 5 ^ inversion, r[3]);
+	map_chr(mapper, 6 ^ inversion, r[4]);
+	map_chr(mapper, 7 ^ inversion, r[5]);
+}
+
+/*
+ * Registers are picked by the 8 kB window and whether the address is even
+ * or odd.
+ */
+static void mmc3_write(struct mapper *mapper, const uint16_t addr, const uint8_t val)
+{
+	uint8_t odd = addr & 1;
+
+	switch ((addr >> 13) & 3) {
+		case 0:
+			if (odd == 0) {
+				mapper->bank_select = val;
+			} else {
+				mapper->bank_registers[mapper->bank_select & 7] = val;
+			}
+			mmc3_update(mapper);
+			break;
+		case 1:
+			// Odd is save RAM protection, which is not emulated
+			if (odd == 0) {
+				MEM_sync_ppu(mapper->mem);
+				PPU_MEM_set_mirroring(mapper->ppu_mem, (val & 1) != 0 ?
+					PPU_MEM_MIRROR_HORIZONTAL : PPU_MEM_MIRROR_VERTICAL);
+			}
+			break;
+		case 2:
+			// The counter is clocked up to now first, and the next IRQ
+			// moves, so the CPU run ends
+			MEM_sync_ppu(mapper->mem);
+			MEM_stop_run(mapper->mem);
+			if (odd == 0) {
+				mapper->irq_latch = val;
+			} else {
+				mapper->irq_counter = 0;
+				mapper->irq_reload = 1;
+			}
+			break;
+		case 3:
+			MEM_sync_ppu(mapper->mem);
+			MEM_stop_run(mapper->mem);
+			mapper->irq_enabled = odd;
+			// Disabling also acknowledges a pending IRQ
+			if (odd == 0) {
+				mapper->irq_pending = 0;
+			}
+			break;
+	}
+}
+
+static void write_register(void *data, const uint16_t addr, const uint8_t val)
+{
+	struct mapper *mapper = data;
+
+#ifdef DEBUG_MAPPER
+	(void)printf("Mapper %d register write %#x to %#x\n", mapper->number, val, addr);
+#endif
+	switch (mapper->number) {
+		case MMC1:
+			mmc1_write(mapper, addr, val);
+			break;
+		case UXROM:
+			map_prg_16k(mapper, 0, val);
+			break;
+		case CNROM:
+			map_chr_banks(mapper, 0, 8, val);
+			break;
+		case MMC3:
+			mmc3_write(mapper, addr, val);
+			break;
+		default:
+			// NROM has no registers
+			break;
+	}
+}
+
+struct mapper *MAPPER_init(const uint8_t number, struct memory *mem, struct ppu_memory *ppu_mem,
+		uint8_t *prg, const uint32_t prg_size, uint8_t *chr, const uint32_t chr_size, const uint8_t mirroring)
+{
+	struct mapper *mapper;
+	int i;
+
+	if (MAPPER_supported(number) == 0 || prg_size < 2 * PRG_WINDOW_SIZE) {
+		return NULL;
+	}
+
+	mapper = calloc(1, sizeof(struct mapper));
+	mapper->number = number;
+	mapper->mem = mem;
+	mapper->ppu_mem = ppu_mem;
+	mapper->prg = prg;
+	mapper->prg_banks = prg_size / PRG_WINDOW_SIZE;
+	if (chr_size >= CHR_WINDOWS * CHR_WINDOW_SIZE) {
+		mapper->chr = chr;
+		mapper->chr_banks = chr_size / CHR_WINDOW_SIZE;
+		PPU_MEM_load_chr_rom(ppu_mem, chr, mapper->chr_banks * CHR_WINDOW_SIZE);
+	}
+	for (i = 0; i < PRG_WINDOWS; i++) {
+		mapper->prg_window[i] = NO_BANK;
+	}
+	for (i = 0; i < CHR_WINDOWS; i++) {
+		mapper->chr_window[i] = NO_BANK;
+	}
+
+	// ROM is read directly, and writes go to the registers
+	for (i = PRG_ADDR >> 8; i <= 0xFF; i++) {
+		MEM_set_page_handlers(mem, i, NULL, write_register, mapper);
+	}
+	PPU_MEM_set_mirroring(ppu_mem, mirroring);
+
+	// Power on banks: first PRG banks at 0x8000, last at 0xC000
+	map_prg_16k(mapper, 0, 0);
+	map_prg_16k(mapper, 2, mapper->prg_banks / 2 - 1);
+	map_chr_banks(mapper, 0, 8, 0);
+	if (number == MMC1) {
+		mapper->control = 0x0C;
+		mmc1_update(mapper);
+	} else if (number == MMC3) {
+		mmc3_update(mapper);
+	}
+
+	return mapper;
+}
+
+void MAPPER_clock_scanline(struct mapper *mapper)
+{
+	if (mapper->number != MMC3) {
+		return;
+	}
+
+	if (mapper->irq_counter == 0 || mapper->irq_reload != 0) {
+		mapper->irq_counter = mapper->irq_latch;
+		mapper->irq_reload = 0;
+	} else {
+		mapper->irq_counter--;
+	}
+	if (mapper->irq_counter == 0 && mapper->irq_enabled != 0) {
+		mapper->irq_pending = 1;
+	}
+}
+
+int MAPPER_irq(const struct mapper *mapper)
+{
+	return mapper->irq_pending;
+}
+
+unsigned int MAPPER_lines_to_irq(const struct mapper *mapper)
+{
+	if (mapper->number != MMC3 || mapper->irq_enabled == 0 || mapper->irq_pending != 0) {
+		return 0;
+	}
+
+	// The first clock after a reload only loads the latch
+	if (mapper->irq_counter == 0 || mapper->irq_reload != 0) {
+		return mapper->irq_latch + 1;
+	}
+	return mapper->irq_counter;
+}
+
+void MAPPER_delete(struct mapper **mapper)
+{
+	free(*mapper);
+	*mapper = NULL;
+}
@@ -0,0 +1,94 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  mapper.h
+ *
+ *    Description:  Public interface to the cartridge mappers, which switch
+ *                  banks of PRG ROM into CPU memory and banks of CHR into PPU
+ *                  memory.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 04:48:12 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include <stdint.h>
+#include "memory.h"
+#include "ppu_memory.h"
+
+struct mapper;
+
+/*
+ * Banks
+ * =====
+ *
+ * PRG ROM is switched in 8 kB windows at 0x8000, 0xA000, 0xC000 and 0xE000,
+ * and CHR in 1 kB windows from 0x0000 to 0x1FFF of PPU memory.  Larger banks
+ * are made of consecutive windows.  A bank switch only repoints the windows at
+ * the ROM image, nothing is copied.  Writes to 0x8000 - 0xFFFF go to the
+ * mapper's registers.
+ *
+ * Supported mappers:
+ * 0 - NROM, 16 or 32 kB PRG, 8 kB CHR
+ * 1 - MMC1 (SxROM), 16/32 kB PRG and 4/8 kB CHR banks, switched mirroring
+ * 2 - UxROM, 16 kB PRG bank at 0x8000, last bank fixed at 0xC000
+ * 3 - CNROM, 8 kB CHR bank
+ * 4 - MMC3 (TxROM), 8 kB PRG and 1/2 kB CHR banks, switched mirroring and
+ *     the scanline IRQ
+ */
+
+/*
+ * Return 1 if the mapper number is supported, 0 otherwise.
+ */
+extern int MAPPER_supported(const uint8_t);
+
+/*
+ * Create a mapper and map its power on banks into memory.  The PRG and CHR
+ * data must outlive the mapper.  A CHR size of 0 means the cartridge has CHR
+ * RAM instead, which is left as it is.  The mirroring is the one in the file
+ * header, for mappers that do not switch it.  Returns NULL for unsupported
+ * mappers.
+ */
+extern struct mapper *MAPPER_init(const uint8_t, struct memory *, struct ppu_memory *,
+		uint8_t *, const uint32_t, uint8_t *, const uint32_t, const uint8_t);
+
+/*
+ * IRQs
+ * ====
+ *
+ * The MMC3 counts the lines the PPU renders, by the rise of PPU address line
+ * A12 as the PPU moves on from background to sprite fetches, and holds the
+ * CPU's IRQ line low once its counter reaches 0.  The PPU counts those lines
+ * in PPU_rendered_lines, which the caller passes on here one at a time.
+ */
+
+/*
+ * Clock the scanline counter, for one line rendered by the PPU.
+ */
+extern void MAPPER_clock_scanline(struct mapper *);
+
+/*
+ * Return 1 while the mapper holds the IRQ line low.
+ */
+extern int MAPPER_irq(const struct mapper *);
+
+/*
+ * Return the number of lines the PPU has to render before the mapper raises
+ * an IRQ, or 0 if none is coming without another register write.
+ */
+extern unsigned int MAPPER_lines_to_irq(const struct mapper *);
+
+/*
+ * Delete a mapper.  The PRG and CHR data are not freed.
+ */
+extern void MAPPER_delete(struct mapper **);
+
+#endif
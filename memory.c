@@ -15,36 +15,135 @@
  * =====================================================================================
  */
 #include <stdlib.h>
+#include <string.h>
 
 #include "memory.h"
+#include "cpu.h"
+#include "ppu_oam_memory.h"
 
-#define MEM_SIZE 0xFFFF
 #define MEM_ROM_LOW_BANK_ADDR 0x8000
 #define MEM_ROM_HIGH_BANK_ADDR 0xC000
 #define MIRROR_ADDR 0x2000
 #define MIRROR_SIZE 0x0800
 #define VRAM_REG_ADDR 0x2000
 #define VRAM_REG_MIRROR_SIZE 8
+#define IO_REG_SIZE 0x20
+#define SRAM_ADDR 0x6000
+#define SRAM_SIZE 0x2000
+#define PRG_SIZE 0x8000
+#define NUM_PAGES 0x100
 
+/*
+ * Handlers for one 256 byte page of the address space, called when the page
+ * has no host memory pointer.
+ */
+struct page {
+	MEM_read_handler read_handler;
+	MEM_write_handler write_handler;
+	void *read_data;	/* passed to read_handler */
+	void *write_data;	/* passed to write_handler */
+	uint8_t *code;	/* write pointer, while writes are watched for code */
+	MEM_write_handler unwatched_handler;	/* write_handler, while watched */
+	void *unwatched_data;
+};
+
+/*
+ * Only the memory that exists is stored.  Mirrors are pages that point at the
+ * same storage.
+ */
 struct memory {
-	uint8_t memory[MEM_SIZE];
+	uint8_t ram[MIRROR_SIZE];
+	uint8_t ppu_registers[VRAM_REG_MIRROR_SIZE];	/* while no PPU is attached */
+	uint8_t io_registers[IO_REG_SIZE];
+	uint8_t sram[SRAM_SIZE];
+	uint8_t prg[PRG_SIZE];
+
 	struct controller *controller;
 	struct ppu *ppu;
+	struct cpu *cpu;
+	MEM_sync_handler ppu_sync;
+	void *ppu_sync_data;	/* passed to ppu_sync */
+	MEM_sync_handler oam_dma;
+	void *oam_dma_data;	/* passed to oam_dma */
+
+	// Host memory for each page, or NULL to call the page's handler.  Kept
+	// apart from the handlers, so that lookups and bank switches touch as
+	// little memory as possible.
+	uint8_t *read[NUM_PAGES];
+	uint8_t *write[NUM_PAGES];
+	struct page pages[NUM_PAGES];
+
+	// Pages holding code that the cpu has decoded.  Writes to them are
+	// reported to the cpu.
+	uint8_t code_pages[NUM_PAGES];
+
+	// Pages that compiled code reads straight from host memory.  Remapping
+	// them is reported to the cpu.
+	uint8_t read_pages[NUM_PAGES];
 };
 
-struct memory *MEM_init()
+static uint8_t read_ppu(void *, const uint16_t);
+static void write_ppu(void *, const uint16_t, const uint8_t);
+static uint8_t read_io(void *, const uint16_t);
+static void write_io(void *, const uint16_t, const uint8_t);
+static uint8_t read_unmapped(void *, const uint16_t);
+static void write_unmapped(void *, const uint16_t, const uint8_t);
+static void write_code(void *, const uint16_t, const uint8_t);
+
+/*
+ * Power on layout: RAM and its mirrors, save RAM and ROM are mapped directly,
+ * and the PPU and I/O registers go through handlers.
+ */
+static void map_default_pages(struct memory *mem)
 {
-	struct memory *mem = malloc(sizeof(struct memory));
+	int i;
+
+	for (i = 0; i < NUM_PAGES; i++) {
+		uint16_t addr = i * MEM_PAGE_SIZE;
 
-	/* clear the allocated memory */
-	uint8_t *mem_ptr = NULL;
-	for(mem_ptr = mem->memory; mem_ptr < mem->memory + MEM_SIZE; mem_ptr++)
-	{
-		*mem_ptr = 0;
+		if (addr < MIRROR_ADDR) {
+			uint8_t *host = &mem->ram[addr % MIRROR_SIZE];
+			MEM_set_page_handlers(mem, i, NULL, NULL, mem);
+			MEM_map_page(mem, i, host, host);
+		} else if (addr < IO_REG_ADDR) {
+			MEM_set_page_handlers(mem, i, read_ppu, write_ppu, mem);
+			MEM_map_page(mem, i, NULL, NULL);
+		} else if (addr == IO_REG_ADDR) {
+			MEM_set_page_handlers(mem, i, read_io, write_io, mem);
+			MEM_map_page(mem, i, NULL, NULL);
+		} else if (addr < SRAM_ADDR) {
+			MEM_set_page_handlers(mem, i, read_unmapped, write_unmapped, mem);
+			MEM_map_page(mem, i, NULL, NULL);
+		} else if (addr < MEM_ROM_LOW_BANK_ADDR) {
+			uint8_t *host = &mem->sram[addr - SRAM_ADDR];
+			MEM_set_page_handlers(mem, i, NULL, NULL, mem);
+			MEM_map_page(mem, i, host, host);
+		} else {
+			uint8_t *host = &mem->prg[addr - MEM_ROM_LOW_BANK_ADDR];
+			MEM_set_page_handlers(mem, i, NULL, NULL, mem);
+			MEM_map_page(mem, i, host, host);
+		}
 	}
-	
+}
+
+struct memory *MEM_init()
+{
+	struct memory *mem = calloc(1, sizeof(struct memory));
+
 	mem->controller = NULL;
 	mem->ppu = NULL;
+	mem->cpu = NULL;
+	mem->ppu_sync = NULL;
+	mem->ppu_sync_data = NULL;
+	mem->oam_dma = NULL;
+	mem->oam_dma_data = NULL;
+
+	int i;
+	for (i = 0; i < NUM_PAGES; i++) {
+		mem->code_pages[i] = 0;
+		mem->read_pages[i] = 0;
+	}
+	map_default_pages(mem);
 
 	return mem;
 }
@@ -59,38 +158,310 @@ void MEM_attach_ppu(struct memory *mem, struct ppu *ppu)
 	mem->ppu = ppu;
 }
 
+void MEM_set_ppu_sync(struct memory *mem, MEM_sync_handler sync, void *data)
+{
+	mem->ppu_sync = sync;
+	mem->ppu_sync_data = data;
+}
+
+void MEM_sync_ppu(struct memory *mem)
+{
+	if (mem->ppu_sync != NULL) {
+		mem->ppu_sync(mem->ppu_sync_data);
+	}
+}
+
+void MEM_stop_run(struct memory *mem)
+{
+	if (mem->cpu != NULL) {
+		CPU_stop_run(mem->cpu);
+	}
+}
+
+void MEM_set_oam_dma(struct memory *mem, MEM_sync_handler dma, void *data)
+{
+	mem->oam_dma = dma;
+	mem->oam_dma_data = data;
+}
+
+void MEM_attach_cpu(struct memory *mem, struct cpu *cpu)
+{
+	mem->cpu = cpu;
+}
+
+/*
+ * Switch a page that is written directly over to write_code.  Handlers check
+ * code_pages themselves.
+ */
+static void watch_page(struct memory *mem, const uint8_t index)
+{
+	struct page *page = &mem->pages[index];
+
+	mem->code_pages[index] = 1;
+	if (mem->write[index] != NULL) {
+		page->code = mem->write[index];
+		mem->write[index] = NULL;
+		page->unwatched_handler = page->write_handler;
+		page->unwatched_data = page->write_data;
+		page->write_handler = write_code;
+		page->write_data = mem;
+	}
+}
+
+/* Give a page that was switched over to write_code its own handler back */
+static void unwatch_page(struct memory *mem, const uint8_t index)
+{
+	struct page *page = &mem->pages[index];
+
+	if (page->code != NULL) {
+		page->write_handler = page->unwatched_handler;
+		page->write_data = page->unwatched_data;
+		page->code = NULL;
+	}
+}
+
+void MEM_watch_code(struct memory *mem, uint16_t addr)
+{
+	if (addr < MIRROR_ADDR) {
+		// Code in RAM can be overwritten through any of the mirrors
+		uint8_t base_page = (addr % MIRROR_SIZE) >> 8;
+		int i;
+		for (i = 0; i < MIRROR_ADDR / MIRROR_SIZE; i++) {
+			watch_page(mem, base_page + i * (MIRROR_SIZE >> 8));
+		}
+	} else {
+		watch_page(mem, addr >> 8);
+	}
+}
+
+void MEM_watch_reads(struct memory *mem, uint16_t addr)
+{
+	mem->read_pages[addr >> 8] = 1;
+}
+
+void MEM_map_page(struct memory *mem, const uint8_t index, uint8_t *read, uint8_t *write)
+{
+	// Code decoded from the old bank, or reading it, no longer matches
+	// memory
+	if ((mem->code_pages[index] != 0 || mem->read_pages[index] != 0) && read != mem->read[index]) {
+		mem->code_pages[index] = 0;
+		mem->read_pages[index] = 0;
+		CPU_invalidate_page(mem->cpu, index);
+	}
+
+	unwatch_page(mem, index);
+	mem->read[index] = read;
+	mem->write[index] = write;
+	if (write != NULL && mem->code_pages[index] != 0) {
+		watch_page(mem, index);
+	}
+}
+
+/*
+ * Point count page pointers at consecutive pages of host memory, or at NULL.
+ */
+static inline void map_pointers(uint8_t **pointers, const uint16_t count, uint8_t *host)
+{
+	uint16_t i;
+
+	if (host == NULL) {
+		for (i = 0; i < count; i++) {
+			pointers[i] = NULL;
+		}
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		pointers[i] = host + i * MEM_PAGE_SIZE;
+	}
+}
+
+void MEM_map_pages(struct memory *mem, const uint8_t first, const uint16_t count, uint8_t *read, uint8_t *write)
+{
+	uint16_t i;
+	uint8_t watched = 0;
+
+	for (i = 0; i < count; i++) {
+		watched |= mem->code_pages[first + i] | mem->read_pages[first + i];
+	}
+	if (watched != 0) {
+		// Decoded code needs the checks in MEM_map_page
+		for (i = 0; i < count; i++) {
+			MEM_map_page(mem, first + i,
+				read != NULL ? read + i * MEM_PAGE_SIZE : NULL,
+				write != NULL ? write + i * MEM_PAGE_SIZE : NULL);
+		}
+		return;
+	}
+
+	// Otherwise a bank switch is only a run of pointer stores
+	map_pointers(&mem->read[first], count, read);
+	map_pointers(&mem->write[first], count, write);
+}
+
+void MEM_set_page_handlers(struct memory *mem, const uint8_t index, MEM_read_handler read_handler, MEM_write_handler write_handler, void *data)
+{
+	struct page *page = &mem->pages[index];
+
+	page->read_handler = read_handler;
+	page->read_data = data;
+	if (page->code != NULL) {
+		// Writes stay watched, and go to the handler once unwatched
+		page->unwatched_handler = write_handler;
+		page->unwatched_data = data;
+		return;
+	}
+	page->write_handler = write_handler;
+	page->write_data = data;
+}
+
 void MEM_delete(struct memory **mem)
 {
 	(*mem)->controller = NULL;
 	(*mem)->ppu = NULL;
+	(*mem)->cpu = NULL;
 	free(*mem);
 	*mem = NULL;
 }
 
-void write_mirrored_ppu_registers(struct memory *mem, const uint16_t base_addr, const uint8_t val)
+/*
+ * Page handlers
+ */
+static uint8_t read_ppu(void *data, const uint16_t addr)
+{
+	struct memory *mem = data;
+
+	// The 8 registers are mirrored every 8 bytes up to $3FFF
+	if (mem->ppu != NULL) {
+		uint16_t base_addr = (addr % VRAM_REG_MIRROR_SIZE) + VRAM_REG_ADDR;
+		if (mem->ppu_sync != NULL) {
+			mem->ppu_sync(mem->ppu_sync_data);
+		}
+		return PPU_read_register(mem->ppu, base_addr);
+	}
+	return mem->ppu_registers[addr % VRAM_REG_MIRROR_SIZE];
+}
+
+static void write_ppu(void *data, const uint16_t addr, const uint8_t val)
 {
+	struct memory *mem = data;
+
+	/* Calculate the base PPU register address */
+	uint16_t base_addr = (addr % VRAM_REG_MIRROR_SIZE) + VRAM_REG_ADDR;
+
+	if (mem->ppu != NULL) {
+		if (mem->ppu_sync != NULL) {
+			mem->ppu_sync(mem->ppu_sync_data);
+		}
+		PPU_write_register(mem->ppu, base_addr, val);
+		// Turning NMIs or rendering on or off moves the next NMI or the
+		// next line the mapper counts, and the control, mask and sprites
+		// move the next PPUSTATUS change, any of which the current CPU
+		// run may already be past
+		if ((base_addr == PPUCTRL_ADDR || base_addr == PPUMASK_ADDR || base_addr == OAMDATA_ADDR) && mem->cpu != NULL) {
+			CPU_stop_run(mem->cpu);
+		}
+	} else {
+		mem->ppu_registers[base_addr - VRAM_REG_ADDR] = val;
+	}
+}
+
+static uint8_t read_io(void *data, const uint16_t addr)
+{
+	struct memory *mem = data;
+
+	// special case for reading the address to which the controller is
+	// attached
+	if ((addr == MEM_CONTROLLER_REG_ADDR) && (mem->controller != NULL)) {
+		return CONTROLLER_read(mem->controller);
+	}
+	if (addr - IO_REG_ADDR < IO_REG_SIZE) {
+		return mem->io_registers[addr - IO_REG_ADDR];
+	}
+	return 0;
+}
+
+/*
+ * Copy the page at the given page number into OAM in one go, straight from
+ * host memory when the page is mapped, which RAM and ROM always are.
+ */
+static void oam_dma(struct memory *mem, const uint8_t page)
+{
+	const uint8_t *src = MEM_host_pointer(mem, page << 8, PPU_OAM_SIZE);
+	uint8_t buffer[PPU_OAM_SIZE];
 	int i;
-	for(i = 0; i < 1024; i++) {
-		mem->memory[base_addr + i * VRAM_REG_MIRROR_SIZE] = val;
+
+	if (src == NULL) {
+		for (i = 0; i < PPU_OAM_SIZE; i++) {
+			buffer[i] = MEM_read(mem, (page << 8) | i);
+		}
+		src = buffer;
+	}
+
+	if (mem->ppu_sync != NULL) {
+		mem->ppu_sync(mem->ppu_sync_data);
+	}
+	PPU_write_oam_dma(mem->ppu, src);
+
+	if (mem->oam_dma != NULL) {
+		mem->oam_dma(mem->oam_dma_data);
+	}
+	if (mem->cpu != NULL) {
+		CPU_stop_run(mem->cpu);
 	}
 }
 
+static void write_io(void *data, const uint16_t addr, const uint8_t val)
+{
+	struct memory *mem = data;
+
+	if (addr - IO_REG_ADDR < IO_REG_SIZE) {
+		mem->io_registers[addr - IO_REG_ADDR] = val;
+	}
+
+	if (addr == MEM_OAM_DMA_ADDR && mem->ppu != NULL) {
+		oam_dma(mem, val);
+	}
+
+	// Writes to a controller
+	if (addr == MEM_CONTROLLER_REG_ADDR && mem->controller != NULL) {
+		CONTROLLER_write(mem->controller, val);
+	}
+}
+
+/* nothing is attached to the expansion area */
+static uint8_t read_unmapped(void *data, const uint16_t addr)
+{
+	(void)data;
+	(void)addr;
+	return 0;
+}
+
+static void write_unmapped(void *data, const uint16_t addr, const uint8_t val)
+{
+	(void)data;
+	(void)addr;
+	(void)val;
+}
+
+/* write to a page that was mapped directly, but holds decoded code */
+static void write_code(void *data, const uint16_t addr, const uint8_t val)
+{
+	struct memory *mem = data;
+
+	mem->pages[addr >> 8].code[addr & 0xFF] = val;
+	CPU_invalidate_code(mem->cpu, addr);
+}
+
 uint8_t MEM_read(struct memory *mem, const uint16_t addr)
 {
+	const uint8_t *host = mem->read[addr >> 8];
 	uint8_t val;
 
-	if ((addr == MEM_CONTROLLER_REG_ADDR) && (mem->controller != NULL)) {
-		// special case for reading the address to which the controller is
-		// attached
-		val = CONTROLLER_read(mem->controller);
-	} else if ((addr >= VRAM_REG_ADDR) && (addr < IO_REG_ADDR) && (mem->ppu != NULL)) {
-		// Special case for when the PPU is attached.  Reducing the
-		// address to (base address + 8) should bypass the mirroring
-		// altogether.
-		uint16_t base_addr = (addr % VRAM_REG_MIRROR_SIZE) + VRAM_REG_ADDR;
-		val = PPU_read_register(mem->ppu, base_addr);
+	if (host != NULL) {
+		val = host[addr & 0xFF];
 	} else {
-		val = mem->memory[addr];
+		const struct page *page = &mem->pages[addr >> 8];
+		val = page->read_handler(page->read_data, addr);
 	}
 #ifdef DEBUG_MEM
 	(void)printf("Read data %#x from address %#x\n", val, addr);
@@ -98,87 +469,75 @@ uint8_t MEM_read(struct memory *mem, const uint16_t addr)
 	return val;
 }
 
-void MEM_write(struct memory *mem, const uint16_t addr, const uint8_t val)
+int MEM_read_is_stable(struct memory *mem, const uint16_t addr)
 {
-#ifdef DEBUG_MEM
-	(void)printf("Writing data %#x into address %#x\n", val, addr);
-#endif
-	/* write to mirrored RAM */
-	if (addr < MIRROR_ADDR)
-	{
-		uint16_t base_addr = addr % MIRROR_SIZE; 
-		mem->memory[base_addr] = val;
-		mem->memory[base_addr + 1 * MIRROR_SIZE] = val;
-		mem->memory[base_addr + 2 * MIRROR_SIZE] = val;
-		mem->memory[base_addr + 3 * MIRROR_SIZE] = val;
-	}
-	/* write to mirrored VRAM */
-	else if ((addr >= VRAM_REG_ADDR) && (addr < IO_REG_ADDR))
-	{
-		/* Calculate the base PPU register address */
-		uint16_t base_addr = (addr % VRAM_REG_MIRROR_SIZE) + VRAM_REG_ADDR;
-
-		// If the PPU is attached, update its registers and bypass the
-		// mirrored memory altogether.
-		if (mem->ppu != NULL) {
-			PPU_write_register(mem->ppu, base_addr, val);
-		} else {
-			write_mirrored_ppu_registers(mem, base_addr, val);
-		}
-	} 
-	/* all other writes */
-	else
-	{
-		mem->memory[addr] = val;
-
-		// Writes to a controller
-		if (addr == MEM_CONTROLLER_REG_ADDR && mem->controller != NULL) {
-			CONTROLLER_write(mem->controller, val);
-		}
+	if (mem->read[addr >> 8] != NULL) {
+		return 1;
 	}
+	// PPUSTATUS and its mirrors
+	if (addr >= VRAM_REG_ADDR && addr < IO_REG_ADDR && addr % VRAM_REG_MIRROR_SIZE == PPUSTATUS_ADDR - VRAM_REG_ADDR) {
+		return mem->ppu == NULL || PPU_status_is_stable(mem->ppu);
+	}
+	return 0;
 }
 
-void MEM_load_trainer(struct memory *mem, FILE *nes_file)
+uint8_t *MEM_host_pointer(struct memory *mem, const uint16_t addr, const uint32_t len)
 {
-	uint8_t *mem_ptr = mem->memory + 0x7000;
-	uint8_t data;
+	uint32_t first = addr >> 8;
+	uint32_t last = (addr + len - 1) >> 8;
+	uint32_t i;
 
-	int i = 0;
-	while(i < 512) {
-		(void)fread(&data, sizeof(uint8_t), 1, nes_file);
-		*mem_ptr = data;
-		mem_ptr++;
-		i++;
+	if (last >= NUM_PAGES) {
+		return NULL;
 	}
+	// Every page must be read directly, and follow on from the last
+	for (i = first; i <= last; i++) {
+		if (mem->read[i] == NULL) {
+			return NULL;
+		}
+		if (i > first && mem->read[i] != mem->read[i - 1] + MEM_PAGE_SIZE) {
+			return NULL;
+		}
+	}
+	return mem->read[first] + (addr & 0xFF);
 }
 
-void MEM_load_rom(struct memory *mem, uint8_t num_banks, FILE *nes_file)
+void MEM_write(struct memory *mem, const uint16_t addr, const uint8_t val)
 {
-	uint8_t data;
-	uint32_t mem_addr;
-	uint32_t mem_end;
+	uint8_t *host = mem->write[addr >> 8];
 
-	(void)printf("Loading %d ROM banks\n", num_banks);
-
-	// This is only correct for 1 or 2 memory banks.
-	if (num_banks == 2) {
-		mem_addr = MEM_ROM_LOW_BANK_ADDR;
+#ifdef DEBUG_MEM
+	(void)printf("Writing data %#x into address %#x\n", val, addr);
+#endif
+	if (host != NULL) {
+		host[addr & 0xFF] = val;
 	} else {
-		mem_addr = MEM_ROM_HIGH_BANK_ADDR;
+		const struct page *page = &mem->pages[addr >> 8];
+		page->write_handler(page->write_data, addr, val);
 	}
+}
 
-	mem_end = mem_addr + (num_banks * 0x4000) - 1;
-	while (mem_addr <= mem_end) {
-		(void)fread(&data, sizeof(uint8_t), 1, nes_file);
-		MEM_write(mem, mem_addr, data);
-		mem_addr++;
+int MEM_write_ppu_data(struct memory *mem, const uint8_t *data, const uint16_t len, const uint32_t cycles)
+{
+	if (mem->ppu == NULL) {
+		return 0;
+	}
+	if (mem->ppu_sync != NULL) {
+		mem->ppu_sync(mem->ppu_sync_data);
 	}
+	// The PPU runs three dots to each CPU cycle
+	return PPU_write_data(mem->ppu, data, len, cycles * 3);
+}
+
+void MEM_load_trainer(struct memory *mem, const uint8_t *trainer)
+{
+	memcpy(mem->sram + (0x7000 - SRAM_ADDR), trainer, 512);
 }
 
 void MEM_print_test_status(struct memory *mem)
 {
-	uint8_t code = mem->memory[0x6000];
-	uint8_t *a = &(mem->memory[0x6004]);
+	uint8_t code = mem->sram[0];
+	uint8_t *a = &(mem->sram[4]);
 	(void)printf("%#x: ", code);
 	while(*a != 0) {
 		(void)printf("%c", *a);
@@ -31,9 +31,27 @@
 #define MEM_RESET_VECTOR 0xFFFC
 #define MEM_BRK_VECTOR 0xFFFE
 #define IO_REG_ADDR 0x4000
+#define MEM_OAM_DMA_ADDR 0x4014
 #define MEM_CONTROLLER_REG_ADDR 0x4016
 
+#define MEM_PAGE_SIZE 0x0100
+
 struct memory;
+struct cpu;
+
+/*
+ * Handlers for the pages of the address space that are not plain memory.
+ * They are passed the data given to MEM_set_page_handlers, and the full
+ * address.
+ */
+typedef uint8_t (*MEM_read_handler)(void *, const uint16_t);
+typedef void (*MEM_write_handler)(void *, const uint16_t, const uint8_t);
+
+/*
+ * Called before the attached PPU's registers are accessed, with the data
+ * given to MEM_set_ppu_sync.  Also the type of the OAM DMA handler.
+ */
+typedef void (*MEM_sync_handler)(void *);
 /*
  * General
  * =======
@@ -149,6 +167,73 @@ extern void MEM_attach_controller(struct memory *, struct controller *);
  */
 extern void MEM_attach_ppu(struct memory *, struct ppu *);
 
+/*
+ * Set the function that brings the attached PPU up to the current time.  The
+ * PPU is only run when something can see the difference, so it may be behind
+ * the CPU until one of its registers is read or written.
+ */
+extern void MEM_set_ppu_sync(struct memory *, MEM_sync_handler, void *);
+
+/*
+ * Bring the PPU up to the current time, for changes that it would see
+ * outside its registers, e.g. a mapper switching CHR banks or mirroring.
+ */
+extern void MEM_sync_ppu(struct memory *);
+
+/*
+ * End the attached CPU's current run, e.g. after a register write that
+ * moves an event the run may already be past.
+ */
+extern void MEM_stop_run(struct memory *);
+
+/*
+ * Set the function called after a write to $4014 has copied a page into the
+ * attached PPU's OAM.  The copy is done at once, but the real DMA halts the
+ * CPU for 513 or 514 cycles, which is left to this function to charge.  The
+ * CPU's run is stopped after the write, so the stall can start as it ends.
+ */
+extern void MEM_set_oam_dma(struct memory *, MEM_sync_handler, void *);
+
+/*
+ * Attach a CPU, for MEM_watch_code.
+ */
+extern void MEM_attach_cpu(struct memory *, struct cpu *);
+
+/*
+ * Report writes to the page holding the given address back to the attached
+ * CPU, because it has cached decoded instructions from that page.
+ */
+extern void MEM_watch_code(struct memory *, uint16_t);
+
+/*
+ * Report remapping of the page holding the given address back to the
+ * attached CPU, because it has compiled code that reads the page's host
+ * memory directly.
+ */
+extern void MEM_watch_reads(struct memory *, uint16_t);
+
+/*
+ * The address space is split into 256 pages of MEM_PAGE_SIZE bytes, each
+ * looked up in a table on every access.  Point the given page at host
+ * memory, so that reads and writes go straight to it.  Either pointer can be
+ * NULL, for the page's handler to be called instead.  This is how mappers
+ * switch banks.
+ */
+extern void MEM_map_page(struct memory *, const uint8_t, uint8_t *, uint8_t *);
+
+/*
+ * MEM_map_page for the given number of pages, starting at the given page,
+ * onto consecutive host memory.  e.g. an 8 kB bank is 32 pages.
+ */
+extern void MEM_map_pages(struct memory *, const uint8_t, const uint16_t, uint8_t *, uint8_t *);
+
+/*
+ * Set the handlers called for accesses to the given page that are not
+ * mapped to host memory.  This is how I/O registers, mapper registers, cheats
+ * and debuggers hook accesses.
+ */
+extern void MEM_set_page_handlers(struct memory *, const uint8_t, MEM_read_handler, MEM_write_handler, void *);
+
 /*
  * Delete a memory struct
  */
@@ -159,6 +244,23 @@ extern void MEM_delete(struct memory **);
  */
 extern uint8_t MEM_read(struct memory *, const uint16_t);
 
+/*
+ * Return a pointer to the bytes at the given address, for the given length,
+ * if they are mapped to contiguous host memory for reads.  Otherwise NULL,
+ * and MEM_read must be used.
+ */
+extern uint8_t *MEM_host_pointer(struct memory *, const uint16_t, const uint32_t);
+
+/*
+ * Return whether reading the given address again and again reads the same
+ * value and has the same effect as reading it once, until something else
+ * writes to memory.  True for host memory.  Also true for PPUSTATUS, which
+ * only changes at the dots given by PPU_next_status_change, so it is stable
+ * in between as long as those are scheduled, except while sprite 0 can hit
+ * (see PPU_status_is_stable).  The CPU uses this to skip idle loops.
+ */
+extern int MEM_read_is_stable(struct memory *, const uint16_t);
+
 /* 
  * Writes to memory during CPU execution should be delegated to this function
  * for proper mirroring.
@@ -170,14 +272,17 @@ extern void MEM_write(struct memory *, const uint16_t, const uint8_t);
  */
 
 /*
- * Load 512 byte trainer into memory at 0x7000 - 0x71FF
+ * Write the given number of bytes to PPUDATA at once, for a loop that stores
+ * them to $2007 over the given number of CPU cycles from now.  Only done if
+ * the attached PPU would not draw anything meanwhile, see PPU_write_data.
+ * Returns whether they were written.
  */
-extern void MEM_load_trainer(struct memory *, FILE *);
+extern int MEM_write_ppu_data(struct memory *, const uint8_t *, const uint16_t, const uint32_t);
 
 /*
- * Load ROM data into memory
+ * Copy a 512 byte trainer into memory at 0x7000 - 0x71FF
  */
-extern void MEM_load_rom(struct memory *, uint8_t, FILE *);
+extern void MEM_load_trainer(struct memory *, const uint8_t *);
 
 /* 
  * Print blarggs test output 
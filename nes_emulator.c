@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdatomic.h>
 #include <SDL2/SDL.h>
 
 #include "cpu.h"
@@ -27,22 +28,242 @@
 #include "ppu.h"
 #include "loader.h"
 #include "input_processor.h"
+#include "scheduler.h"
+#include "palette.h"
+#include "render.h"
 
-// TODO: move SDL window stuff to a separate render module?
-const int SCREEN_WIDTH = 256;
-const int SCREEN_HEIGHT = 240;
+// Longest CPU run while an IRQ is held off by the interrupt flag
+#define CPU_CYCLES_PER_LINE 114
+
+// Longest the main thread waits for a frame before handling events again
+#define PRESENT_WAIT_MS 20
+
+/*
+ * Master clock time once the PPU has run the given number of dots.
+ */
+static uint64_t ppu_dots_to_ticks(const uint64_t dots)
+{
+	return dots * SCHED_TICKS_PER_PPU_DOT;
+}
+
+/*
+ * The PPU is left behind the CPU, and only caught up when its registers are
+ * accessed, or at an event.
+ */
+struct ppu_sync {
+	struct scheduler *sched;
+	struct cpu *cpu;
+	struct ppu *ppu;
+	struct ppu_memory *ppu_mem;
+	struct mapper *mapper;
+	int nmi;	// raised while catching up
+	uint32_t rendered_lines;	// clocked into the mapper so far
+	int dma;	// raised by a write to $4014
+};
+
+static void catch_up_ppu(void *data)
+{
+	struct ppu_sync *sync = data;
+	uint64_t now = SCHED_now(sync->sched) + (uint64_t)CPU_run_cycles(sync->cpu) * SCHED_TICKS_PER_CPU_CYCLE;
+
+	if (PPU_catch_up(sync->ppu, sync->ppu_mem, now / SCHED_TICKS_PER_PPU_DOT) == 0) {
+		sync->nmi = 1;
+	}
+	for (; sync->rendered_lines != PPU_rendered_lines(sync->ppu); sync->rendered_lines++) {
+		MAPPER_clock_scanline(sync->mapper);
+	}
+}
+
+static void start_oam_dma(void *data)
+{
+	struct ppu_sync *sync = data;
+
+	sync->dma = 1;
+}
+
+/*
+ * Hand the PPU's frame over to be shown.
+ */
+static void submit_frame(struct render *render, const struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	uint8_t palette_ram[PALETTE_RAM_SIZE];
+	int i;
+
+	for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+		palette_ram[i] = PPU_MEM_read(ppu_mem, 0x3F00 + i);
+	}
+	(void)RENDER_submit(render, PPU_framebuffer(ppu), palette_ram, PPU_line_masks(ppu));
+}
+
+/*
+ * Everything the emulation thread runs
+ */
+struct nes {
+	struct memory *mem;
+	struct cpu *cpu;
+	struct ppu *ppu;
+	struct ppu_memory *ppu_mem;
+	struct mapper *mapper;
+	struct controller *gamepad;
+	struct input_processor *input_processor;
+	struct render *render;
+	atomic_int running;	// cleared when emulation stops
+};
+
+static int emulate(void *data)
+{
+	struct nes *nes = data;
+	struct memory *mem = nes->mem;
+	struct cpu *cpu = nes->cpu;
+	struct ppu *ppu = nes->ppu;
+	struct ppu_memory *ppu_mem = nes->ppu_mem;
+	struct mapper *mapper = nes->mapper;
+	struct scheduler *sched = SCHED_init();
+	uint64_t frame_start = 0;
+	struct ppu_sync sync = {sched, cpu, ppu, ppu_mem, mapper, 0, 0, 0};
+	int cpu_halted = 0;
+	uint64_t nmi_dot = PPU_NEVER;
+	uint64_t status_dot = PPU_next_status_change(ppu);
+	uint64_t irq_dot = PPU_NEVER;
+	uint64_t next_irq_dot;
+	unsigned int irq_lines;
+	int irq_masked = 0;
+	uint32_t budget;
+	int event;
+	int nes_state = 1;
+	SCHED_add(sched, SCHED_FRAME_END, ppu_dots_to_ticks(PPU_DOTS_PER_FRAME));
+	SCHED_add(sched, SCHED_PPU_STATUS, ppu_dots_to_ticks(status_dot + 1));
+	MEM_set_ppu_sync(mem, catch_up_ppu, &sync);
+	MEM_set_oam_dma(mem, start_oam_dma, &sync);
+	while(nes_state != 0) {
+		// Handle soft reset
+		if(nes_state == 2) {
+			nes_state = 1;
+			CPU_reset(cpu, mem);
+			// TODO: reset the PPU
+		}
+
+		// Run the CPU up to the next event.  The PPU only catches up
+		// during the run if its registers are accessed.  An IRQ held
+		// off by the interrupt flag is checked for again after a line.
+		// While OAM DMA has the CPU halted, time just moves on to the
+		// next event.
+		if (cpu_halted == 0) {
+			budget = SCHED_cpu_cycles_to_next(sched);
+			if (irq_masked != 0 && budget > CPU_CYCLES_PER_LINE) {
+				budget = CPU_CYCLES_PER_LINE;
+			}
+			SCHED_advance(sched, (uint64_t)CPU_run(cpu, mem, budget) * SCHED_TICKS_PER_CPU_CYCLE);
+		} else {
+			SCHED_advance(sched, SCHED_next_time(sched) - SCHED_now(sched));
+		}
+
+		// OAM has already been copied, and the run stopped after the
+		// write to $4014.  The CPU is halted for 513 cycles, plus one
+		// if the DMA starts on an odd cycle.
+		if (sync.dma != 0) {
+			uint64_t stall = 513 + (SCHED_now(sched) / SCHED_TICKS_PER_CPU_CYCLE) % 2;
+
+			sync.dma = 0;
+			cpu_halted = 1;
+			SCHED_add(sched, SCHED_DMA, SCHED_now(sched) + stall * SCHED_TICKS_PER_CPU_CYCLE);
+		}
+
+		while ((event = SCHED_pop(sched)) >= 0) {
+			switch (event) {
+				case SCHED_NMI:
+					catch_up_ppu(&sync);
+					break;
+				case SCHED_MAPPER_IRQ:
+					// Clocks the mapper's counter to 0
+					catch_up_ppu(&sync);
+					break;
+				case SCHED_PPU_STATUS:
+					// Idle loops polling PPUSTATUS are only skipped
+					// up to here
+					catch_up_ppu(&sync);
+					break;
+				case SCHED_DMA:
+					cpu_halted = 0;
+					break;
+				case SCHED_FRAME_END:
+					// The whole frame is needed to present it
+					catch_up_ppu(&sync);
+					submit_frame(nes->render, ppu, ppu_mem);
+					// Input is sampled once a frame, here, so the
+					// game sees the same keys for all of the next one
+					INPUT_process(nes->input_processor, nes->gamepad, &nes_state);
+					frame_start += PPU_DOTS_PER_FRAME;
+					SCHED_add(sched, SCHED_FRAME_END, ppu_dots_to_ticks(frame_start + PPU_DOTS_PER_FRAME));
+#ifdef BLARGG 
+					MEM_print_test_status(mem);
+#endif
+					break;
+			}
+		}
+		// Interrupts wait for the end of OAM DMA
+		if (sync.nmi != 0 && cpu_halted == 0) {
+			sync.nmi = 0;
+			CPU_handle_nmi(cpu, mem);
+		}
+		irq_masked = 0;
+		if (MAPPER_irq(mapper) != 0 && cpu_halted == 0) {
+			irq_masked = CPU_handle_irq(cpu, mem) == 0;
+		}
+
+		// The PPU predicts its next NMI, so the CPU can run straight to
+		// it.  The prediction only moves when an NMI is raised, or $2000
+		// or $2002 are accessed.
+		if (PPU_next_nmi(ppu) != nmi_dot) {
+			nmi_dot = PPU_next_nmi(ppu);
+			if (nmi_dot == PPU_NEVER) {
+				SCHED_remove(sched, SCHED_NMI);
+			} else {
+				SCHED_add(sched, SCHED_NMI, ppu_dots_to_ticks(nmi_dot + 1));
+			}
+		}
+
+		// Likewise the next PPUSTATUS change, which also moves with
+		// $2001 and the sprites
+		if (PPU_next_status_change(ppu) != status_dot) {
+			status_dot = PPU_next_status_change(ppu);
+			SCHED_add(sched, SCHED_PPU_STATUS, ppu_dots_to_ticks(status_dot + 1));
+		}
+
+		// The mapper's counter and the PPU predict the next IRQ
+		// between them.  It only moves when the PPU is caught up, at
+		// a PPUMASK or mapper IRQ register write, which ends the run.
+		irq_lines = MAPPER_lines_to_irq(mapper);
+		next_irq_dot = irq_lines == 0 ? PPU_NEVER : PPU_rendered_line_dot(ppu, irq_lines);
+		if (next_irq_dot != irq_dot) {
+			irq_dot = next_irq_dot;
+			if (irq_dot == PPU_NEVER) {
+				SCHED_remove(sched, SCHED_MAPPER_IRQ);
+			} else {
+				SCHED_add(sched, SCHED_MAPPER_IRQ, ppu_dots_to_ticks(irq_dot + 1));
+			}
+		}
+	}
+
+
+	SCHED_delete(&sched);
+	atomic_store(&nes->running, 0);
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
 	/* Check for input file */
-	if (argc < 2 || argc > 3) {
-		(void)printf("Wrong number of  arguments.  You must enter a filename, and optionally specify an address to start CPU execution.\n");
+	if (argc < 2 || argc > 5) {
+		(void)printf("Wrong number of  arguments.  You must enter a filename, and optionally specify an address to start CPU execution (-s<addr>), turn on the recompiler (-j) and turn on the scanline renderer (-l).\n");
 		return 1;
 	}
 
 	char *filename = NULL;
 	uint16_t pc;
 	int use_pc = 0;
+	int use_jit = 0;
+	int use_scanlines = 0;
 	int j;
 	for(j = 1; j < argc; j++) {
 		switch(argv[j][0]) {
@@ -56,6 +277,12 @@ int main(int argc, char **argv)
 							use_pc = 1;
 						}
 						break;
+					case 'j':
+						use_jit = 1;
+						break;
+					case 'l':
+						use_scanlines = 1;
+						break;
 					default:
 						(void)printf("Unrecognized option '%s'", argv[j]);
 				}
@@ -73,7 +300,8 @@ int main(int argc, char **argv)
 	/* initialize memory and load data */
 	struct memory *mem = MEM_init();
 	struct ppu_memory *ppu_mem = PPU_MEM_init();
-	if(LOADER_load_file(mem, ppu_mem, filename) == 0) {
+	struct cartridge *cart = LOADER_load_file(mem, ppu_mem, filename);
+	if(cart == NULL) {
 		(void)printf("Could not load file '%s'.  Exiting main program.\n", filename);
 		MEM_delete(&mem);
 		PPU_MEM_delete(&ppu_mem);
@@ -87,48 +315,41 @@ int main(int argc, char **argv)
 	} else {
 		cpu = CPU_init(mem);
 	}
+	if (use_jit == 1 && CPU_enable_jit(cpu, 1) == 0) {
+		(void)printf("Recompiler not available.  Using the interpreter instead.\n");
+	}
 	struct ppu *ppu = PPU_init();
+	(void)PPU_enable_scanline_renderer(ppu, use_scanlines);
 	struct controller *gamepad = CONTROLLER_init();
 	const uint8_t *keys;
 	struct input_processor *input_processor = INPUT_init(&keys);
+	struct mapper *mapper = LOADER_mapper(cart);
 	MEM_attach_controller(mem, gamepad);
 	MEM_attach_ppu(mem, ppu);
+	PPU_attach_memory(ppu, ppu_mem);
 
 	// Setup SDL
 	SDL_Init(SDL_INIT_VIDEO);
-	SDL_Window *window = SDL_CreateWindow("nes_emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-
-	/* Execution: */
-	uint16_t cpu_cycles = 0;
-	uint16_t i;
-	uint8_t ppu_result = 0;
-	int nes_state = 1;
-	while(nes_state != 0) {
-		// Handle keyboard input and quit event
-		INPUT_process(input_processor, gamepad, &nes_state, &keys);
-
-		// Handle soft reset
-		if(nes_state == 2) {
-			nes_state = 1;
-			CPU_reset(cpu, mem);
-			// TODO: reset the PPU
-		}
-
-		// Execute the cpu step
-		cpu_cycles = CPU_step(cpu, mem);
-
-		// PPU steps 3 times for each CPU step
-		for(i = 0; i < 3 * cpu_cycles; i++) {
-			ppu_result = PPU_step(ppu, ppu_mem);
+	struct render *render = RENDER_init("nes_emulator");
+	if (render == NULL) {
+		SDL_Quit();
+		return 1;
+	}
 
-			if(ppu_result == 0) {
-				CPU_handle_nmi(cpu, mem);
-				break;
-			}
-		}
-#ifdef BLARGG 
-		MEM_print_test_status(mem);
-#endif
+	/* Execution: emulation runs on a thread of its own, while this one,
+	 * which made the window, handles events and shows frames */
+	struct nes nes = {mem, cpu, ppu, ppu_mem, mapper, gamepad, input_processor, render, 1};
+	SDL_Thread *emulation = SDL_CreateThread(emulate, "emulation", &nes);
+	if (emulation == NULL) {
+		(void)printf("Could not start emulation: %s\n", SDL_GetError());
+		atomic_store(&nes.running, 0);
+	}
+	while (atomic_load(&nes.running) != 0) {
+		INPUT_poll(input_processor, &keys);
+		(void)RENDER_present(render, PRESENT_WAIT_MS);
+	}
+	if (emulation != NULL) {
+		SDL_WaitThread(emulation, NULL);
 	}
 
 	/*
@@ -139,10 +360,11 @@ int main(int argc, char **argv)
 	CPU_delete(&cpu);
 	PPU_delete(&ppu);
 	CONTROLLER_delete(&gamepad);
+	LOADER_delete(&cart);
 	PPU_MEM_delete(&ppu_mem);
 	MEM_delete(&mem);
 
-	SDL_DestroyWindow(window);
+	RENDER_delete(&render);
 	SDL_Quit();
 	(void)printf("Shutdown complete!\n");
 	return 0;
@@ -0,0 +1,277 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  palette.c
+ *
+ *    Description:  Conversion of PPU frames to host pixels
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:27 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "palette.h"
+#include "ppu.h"
+
+#define NUM_COLOURS 64
+#define NUM_EMPHASES 8
+
+struct palette {
+	int format;
+	// host pixel for each emphasis << 6 | colour, in the low bits
+	uint32_t lut[NUM_EMPHASES * NUM_COLOURS];
+};
+
+/*
+ * The 2C02's colours, as R, G, B
+ */
+static const uint8_t nes_colours[NUM_COLOURS][3] = {
+	{84, 84, 84}, {0, 30, 116}, {8, 16, 144}, {48, 0, 136},
+	{68, 0, 100}, {92, 0, 48}, {84, 4, 0}, {60, 24, 0},
+	{32, 42, 0}, {8, 58, 0}, {0, 64, 0}, {0, 60, 0},
+	{0, 50, 60}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+	{152, 150, 152}, {8, 76, 196}, {48, 50, 236}, {92, 30, 228},
+	{136, 20, 176}, {160, 20, 100}, {152, 34, 32}, {120, 60, 0},
+	{84, 90, 0}, {40, 114, 0}, {8, 124, 0}, {0, 118, 40},
+	{0, 102, 120}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+	{236, 238, 236}, {76, 154, 236}, {120, 124, 236}, {176, 98, 236},
+	{228, 84, 236}, {236, 88, 180}, {236, 106, 100}, {212, 136, 32},
+	{160, 170, 0}, {116, 196, 0}, {76, 208, 32}, {56, 204, 108},
+	{56, 180, 204}, {60, 60, 60}, {0, 0, 0}, {0, 0, 0},
+	{236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236},
+	{236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144},
+	{204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180},
+	{160, 214, 228}, {160, 162, 160}, {0, 0, 0}, {0, 0, 0}
+};
+
+/*
+ * Emphasising a colour darkens the other two, to about 82%
+ */
+static uint8_t darken(const uint8_t channel)
+{
+	return channel * 209 / 256;
+}
+
+static uint32_t pack(const int format, const uint8_t r, const uint8_t g, const uint8_t b)
+{
+	switch (format) {
+		case PALETTE_ARGB8888:
+			return 0xFF000000 | (r << 16) | (g << 8) | b;
+		case PALETTE_RGB565:
+			return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	}
+	return (r << 16) | (g << 8) | b;
+}
+
+struct palette *PALETTE_init(const int format)
+{
+	struct palette *palette;
+	int emphasis;
+	int colour;
+
+	if (format != PALETTE_ARGB8888 && format != PALETTE_RGB565 && format != PALETTE_RGB24) {
+		return NULL;
+	}
+
+	palette = malloc(sizeof(struct palette));
+	palette->format = format;
+	for (emphasis = 0; emphasis < NUM_EMPHASES; emphasis++) {
+		for (colour = 0; colour < NUM_COLOURS; colour++) {
+			uint8_t r = nes_colours[colour][0];
+			uint8_t g = nes_colours[colour][1];
+			uint8_t b = nes_colours[colour][2];
+
+			// Bits 5, 6 and 7 of PPUMASK emphasise red, green and blue
+			if (emphasis & 1) {
+				g = darken(g);
+				b = darken(b);
+			}
+			if (emphasis & 2) {
+				r = darken(r);
+				b = darken(b);
+			}
+			if (emphasis & 4) {
+				r = darken(r);
+				g = darken(g);
+			}
+			palette->lut[emphasis * NUM_COLOURS + colour] = pack(format, r, g, b);
+		}
+	}
+	return palette;
+}
+
+void PALETTE_delete(struct palette **palette)
+{
+	free(*palette);
+	*palette = NULL;
+}
+
+int PALETTE_bytes_per_pixel(const struct palette *palette)
+{
+	switch (palette->format) {
+		case PALETTE_ARGB8888:
+			return 4;
+		case PALETTE_RGB565:
+			return 2;
+	}
+	return 3;
+}
+
+// The bits of PPUMASK that change colours: gray and the emphases
+#define COLOUR_BITS 0xE1
+
+/*
+ * The host pixel for each byte of palette RAM, with PPUMASK applied
+ */
+static void frame_colours(const struct palette *palette, const uint8_t *palette_ram, const uint8_t mask, uint32_t *colours)
+{
+	uint8_t gray = (mask & 1) != 0 ? 0x30 : 0x3F;
+	unsigned int emphasis = (mask >> 5) * NUM_COLOURS;
+	int i;
+
+	for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+		colours[i] = palette->lut[emphasis + (palette_ram[i] & gray)];
+	}
+}
+
+static void convert_row_scalar(const int format, const uint32_t *colours, const uint8_t *src, uint8_t *dst)
+{
+	int x;
+
+	switch (format) {
+		case PALETTE_ARGB8888:
+			for (x = 0; x < PPU_SCREEN_WIDTH; x++) {
+				((uint32_t *)dst)[x] = colours[src[x] % PALETTE_RAM_SIZE];
+			}
+			break;
+		case PALETTE_RGB565:
+			for (x = 0; x < PPU_SCREEN_WIDTH; x++) {
+				((uint16_t *)dst)[x] = colours[src[x] % PALETTE_RAM_SIZE];
+			}
+			break;
+		case PALETTE_RGB24:
+			for (x = 0; x < PPU_SCREEN_WIDTH; x++) {
+				uint32_t colour = colours[src[x] % PALETTE_RAM_SIZE];
+				dst[x * 3] = colour >> 16;
+				dst[x * 3 + 1] = colour >> 8;
+				dst[x * 3 + 2] = colour;
+			}
+			break;
+	}
+}
+
+#ifdef __SSSE3__
+/*
+ * With SSSE3, each byte of the pixels is looked up 16 at a time with PSHUFB,
+ * which takes a table of 16 bytes.  So each byte of the 32 colours is split
+ * into a table for indexes 0 to 15 and one for 16 to 31.
+ */
+struct byte_tables {
+	__m128i low[4];
+	__m128i high[4];
+};
+
+static void make_byte_tables(const uint32_t *colours, struct byte_tables *tables)
+{
+	uint8_t bytes[2][4][16];
+	int i, b;
+
+	for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+		for (b = 0; b < 4; b++) {
+			bytes[i / 16][b][i % 16] = colours[i] >> (8 * b);
+		}
+	}
+	for (b = 0; b < 4; b++) {
+		tables->low[b] = _mm_loadu_si128((const __m128i *)bytes[0][b]);
+		tables->high[b] = _mm_loadu_si128((const __m128i *)bytes[1][b]);
+	}
+}
+
+// Byte b of the pixels for 16 indexes, split into their low 4 bits and
+// whether bit 4 is set
+static inline __m128i lookup_byte(const struct byte_tables *tables, const int b, const __m128i low, const __m128i high)
+{
+	return _mm_or_si128(_mm_andnot_si128(high, _mm_shuffle_epi8(tables->low[b], low)),
+			_mm_and_si128(high, _mm_shuffle_epi8(tables->high[b], low)));
+}
+
+static void convert_row_ssse3(const int format, const struct byte_tables *tables, const uint8_t *src, uint8_t *dst)
+{
+	const __m128i low_bits = _mm_set1_epi8(0x0F);
+	const __m128i bit_4 = _mm_set1_epi8(0x10);
+	int x;
+
+	for (x = 0; x < PPU_SCREEN_WIDTH; x += 16) {
+		__m128i index = _mm_loadu_si128((const __m128i *)&src[x]);
+		__m128i low = _mm_and_si128(index, low_bits);
+		__m128i high = _mm_cmpeq_epi8(_mm_and_si128(index, bit_4), bit_4);
+		__m128i b0 = lookup_byte(tables, 0, low, high);
+		__m128i b1 = lookup_byte(tables, 1, low, high);
+
+		if (format == PALETTE_RGB565) {
+			__m128i *out = (__m128i *)&dst[x * 2];
+			_mm_storeu_si128(out, _mm_unpacklo_epi8(b0, b1));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi8(b0, b1));
+		} else {
+			__m128i *out = (__m128i *)&dst[x * 4];
+			__m128i b2 = lookup_byte(tables, 2, low, high);
+			__m128i b3 = lookup_byte(tables, 3, low, high);
+			__m128i b01_low = _mm_unpacklo_epi8(b0, b1);
+			__m128i b01_high = _mm_unpackhi_epi8(b0, b1);
+			__m128i b23_low = _mm_unpacklo_epi8(b2, b3);
+			__m128i b23_high = _mm_unpackhi_epi8(b2, b3);
+			_mm_storeu_si128(out, _mm_unpacklo_epi16(b01_low, b23_low));
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(b01_low, b23_low));
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(b01_high, b23_high));
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(b01_high, b23_high));
+		}
+	}
+}
+#endif
+
+void PALETTE_convert_rows(const struct palette *palette, const uint8_t *framebuffer, const uint8_t *palette_ram, const uint8_t *masks, void *pixels, const int pitch, const int first, const int rows)
+{
+	uint32_t colours[PALETTE_RAM_SIZE];
+#ifdef __SSSE3__
+	struct byte_tables tables;
+#endif
+	uint8_t mask = 0;
+	int y;
+
+	for (y = first; y < first + rows; y++) {
+		const uint8_t *src = &framebuffer[y * PPU_SCREEN_WIDTH];
+		uint8_t *dst = (uint8_t *)pixels + y * pitch;
+
+		// The 32 colours are only looked up again when gray or
+		// emphasis change from one row to the next
+		if (y == first || ((masks[y] ^ mask) & COLOUR_BITS) != 0) {
+			mask = masks[y];
+			frame_colours(palette, palette_ram, mask, colours);
+#ifdef __SSSE3__
+			make_byte_tables(colours, &tables);
+#endif
+		}
+#ifdef __SSSE3__
+		// RGB24 pixels do not line up with the 16 byte lookups
+		if (palette->format != PALETTE_RGB24) {
+			convert_row_ssse3(palette->format, &tables, src, dst);
+			continue;
+		}
+#endif
+		convert_row_scalar(palette->format, colours, src, dst);
+	}
+}
+
+void PALETTE_convert(const struct palette *palette, const uint8_t *framebuffer, const uint8_t *palette_ram, const uint8_t *masks, void *pixels, const int pitch)
+{
+	PALETTE_convert_rows(palette, framebuffer, palette_ram, masks, pixels, pitch, 0, PPU_SCREEN_HEIGHT);
+}
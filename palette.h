@@ -0,0 +1,78 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  palette.h
+ *
+ *    Description:  Public interface to the conversion of PPU frames to host
+ *                  pixels.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:27 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+struct palette;
+
+/*
+ * Colours
+ * =======
+ *
+ * The PPU's framebuffer holds palette RAM indexes, 0 to 31.  Palette RAM
+ * holds NES colours, 0 to 63, which PPUMASK can turn gray (bit 0) and tint by
+ * emphasising red, green or blue (bits 5 to 7).  The 64 colours and 8
+ * emphasis settings make 512 host pixels, which are worked out once, in the
+ * format the palette was made for.
+ *
+ * PPUMASK can change between lines, so each line comes with its own, as
+ * PPU_line_masks gives them.  Converting a line first looks up the 32 colours
+ * of palette RAM, again only when gray or emphasis differ from the line
+ * before, then each pixel is one lookup in those 32.  Consumers that want different formats
+ * each make their own palette, and only pay for the format they use.
+ */
+#define PALETTE_ARGB8888 0	// uint32_t 0xAARRGGBB, as SDL_PIXELFORMAT_ARGB8888
+#define PALETTE_RGB565 1	// uint16_t, as SDL_PIXELFORMAT_RGB565
+#define PALETTE_RGB24 2		// bytes R, G, B, as SDL_PIXELFORMAT_RGB24
+
+#define PALETTE_RAM_SIZE 32
+
+/*
+ * Create a palette converting to the given format, or NULL if the format is
+ * not one of the above.
+ */
+extern struct palette *PALETTE_init(const int);
+
+/*
+ * Delete a palette.
+ */
+extern void PALETTE_delete(struct palette **);
+
+/*
+ * Return the bytes in a pixel.
+ */
+extern int PALETTE_bytes_per_pixel(const struct palette *);
+
+/*
+ * Convert a whole frame: the PPU's framebuffer, with the 32 bytes of palette
+ * RAM and the PPUMASK each line was drawn with, into pixels.  Rows of pixels
+ * are the given pitch in bytes apart.
+ */
+extern void PALETTE_convert(const struct palette *, const uint8_t *, const uint8_t *, const uint8_t *, void *, const int);
+
+/*
+ * PALETTE_convert, for only the given number of rows from the given row on.
+ * The palette is not changed by converting, so threads can each convert some
+ * of the rows of a frame at the same time.
+ */
+extern void PALETTE_convert_rows(const struct palette *, const uint8_t *, const uint8_t *, const uint8_t *, void *, const int, const int, const int);
+
+#endif
@@ -15,8 +15,15 @@
  * =============================================================================
  */
 #include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "ppu.h"
+#include "ppu_oam_memory.h"
 
 struct ppu {
 	// Registers.
@@ -29,6 +36,12 @@ struct ppu {
 	uint8_t addr;
 	uint8_t data;
 
+	// Reads of PPUDATA below the palette return this, and then refill it
+	uint8_t read_buffer;
+
+	// PPU memory, for PPUDATA
+	struct ppu_memory *mem;
+
 	// Odd frame toggle
 	int odd_frame;
 
@@ -49,13 +62,57 @@ struct ppu {
 	unsigned int line;
 	unsigned int dot;
 
-	// background shift registers
+	// lines rendered so far, counted when the sprite fetches start
+	uint32_t rendered_lines;
+
+	// dots run since power on, for catching up to the CPU
+	uint64_t dots;
+
+	// value of dots when the next NMI is raised, or PPU_NEVER
+	uint64_t nmi_dot;
+
+	// background shift registers.  The high byte is the tile being drawn,
+	// and the low byte the next one.  Each bit of a tile's attribute bytes
+	// is its palette bit, so that all four shift together.
 	uint16_t high_bg;
 	uint16_t low_bg;
-	uint8_t high_bg_attribute;
-	uint8_t low_bg_attribute;
+	uint16_t high_bg_attribute;
+	uint16_t low_bg_attribute;
+
+	// palette RAM index of each pixel drawn
+	uint8_t framebuffer[PPU_SCREEN_HEIGHT][PPU_SCREEN_WIDTH];
+
+	// PPUMASK each line was finished with, for grayscale and emphasis
+	uint8_t line_mask[PPU_SCREEN_HEIGHT];
+	// the 64 sprites
+	struct ppu_oam_memory *oam;
+
+	// sprites on the current line, see Composition
+	uint8_t sprite_pixels[PPU_SCREEN_WIDTH];
+	unsigned int sprite_count;
+	unsigned int drawn;		// pixels of the line drawn so far
+	unsigned int composed;		// and how many of those have sprites
+
+	// draw whole lines in one pass, see PPU_enable_scanline_renderer
+	int scanline_renderer;
 };
 
+// Each bit of a pattern byte, left to right, in the low bit of a byte
+static uint64_t pattern_bits[256];
+
+static void init_pattern_bits()
+{
+	uint8_t pixels[8];
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 8; j++) {
+			pixels[j] = (i >> (7 - j)) & 1;
+		}
+		memcpy(&pattern_bits[i], pixels, 8);
+	}
+}
+
 struct ppu *PPU_init()
 {
 	struct ppu *ppu = malloc(sizeof(struct ppu));
@@ -64,11 +121,35 @@ struct ppu *PPU_init()
 	ppu->ctrl = 0x00;
 	ppu->mask = 0x00;
 	ppu->status = 0xa0;
+	ppu->oam_addr = 0x00;
+	ppu->oam_data = 0x00;
+	ppu->scroll = 0x00;
+	ppu->addr = 0x00;
+	ppu->data = 0x00;
+	ppu->read_buffer = 0x00;
+	ppu->mem = NULL;
 
 	// PPU starts at pre-render scanline 261, dot 0, even frame
 	ppu->odd_frame = 0;
 	ppu->line = 261;
 	ppu->dot = 0;
+	ppu->rendered_lines = 0;
+	ppu->dots = 0;
+	ppu->nmi_dot = PPU_NEVER;
+
+	ppu->high_bg = 0;
+	ppu->low_bg = 0;
+	ppu->high_bg_attribute = 0;
+	ppu->low_bg_attribute = 0;
+	memset(ppu->framebuffer, 0, sizeof(ppu->framebuffer));
+	memset(ppu->line_mask, 0, sizeof(ppu->line_mask));
+	ppu->oam = PPU_OAM_init();
+	memset(ppu->sprite_pixels, 0, sizeof(ppu->sprite_pixels));
+	ppu->sprite_count = 0;
+	ppu->drawn = 0;
+	ppu->composed = 0;
+	ppu->scanline_renderer = 0;
+	init_pattern_bits();
 
 	ppu->write_toggle = 0;
 	ppu->loopy_v = 0;
@@ -95,13 +176,73 @@ inline void read_or_write_data(struct ppu *ppu)
 {
 	// increment loopy_v based on control register VRAM address
 	// increment bit value (0 = add 1, 1 = add 32)
-	if ((ppu->status & 1<<2) == 0) {
+	if ((ppu->ctrl & 1<<2) == 0) {
 		ppu->loopy_v++;
 	} else {
 		ppu->loopy_v += 32;
 	}
 }
 
+/*
+ * Reads below the palette are a byte late: they return what the last one
+ * read.  Palette reads come straight back, but still refill the buffer, from
+ * the nametable byte underneath.
+ */
+static uint8_t read_data(struct ppu *ppu)
+{
+	uint16_t addr = ppu->loopy_v & 0x3FFF;
+	uint8_t val = ppu->read_buffer;
+
+	if (ppu->mem != NULL) {
+		if (addr >= 0x3F00) {
+			val = PPU_MEM_read(ppu->mem, addr);
+			addr -= 0x1000;
+		}
+		ppu->read_buffer = PPU_MEM_read(ppu->mem, addr);
+	}
+	read_or_write_data(ppu);
+	return val;
+}
+
+static void write_data(struct ppu *ppu, const uint8_t value)
+{
+	if (ppu->mem != NULL) {
+		PPU_MEM_write(ppu->mem, ppu->loopy_v & 0x3FFF, value);
+	}
+	read_or_write_data(ppu);
+}
+
+// Dots from the start of the pre-render line to line 241, dot 1, where
+// vertical blank starts, and to line 261, dot 1, where it ends
+#define VBLANK_START_DOT ((241 + 1) * PPU_DOTS_PER_LINE + 1)
+#define VBLANK_END_DOT 1
+
+// Dots from the start of the pre-render line to the current dot
+static inline unsigned int frame_dot(const struct ppu *ppu)
+{
+	return ((ppu->line + 1) % PPU_LINES_PER_FRAME) * PPU_DOTS_PER_LINE + ppu->dot;
+}
+
+/*
+ * Work out when the next NMI will be raised.  This only changes when NMIs are
+ * turned on or off, and when one is raised.
+ */
+static void predict_nmi(struct ppu *ppu)
+{
+	unsigned int now = frame_dot(ppu);
+	unsigned int nmi = VBLANK_START_DOT;
+
+	if ((ppu->ctrl & (1<<7)) == 0) {
+		ppu->nmi_dot = PPU_NEVER;
+	} else if (now <= nmi) {
+		ppu->nmi_dot = ppu->dots + (nmi - now);
+	} else {
+		ppu->nmi_dot = ppu->dots + (nmi + PPU_DOTS_PER_FRAME - now);
+	}
+}
+
+static inline void compose_drawn(struct ppu *);
+
 uint8_t PPU_read_register(struct ppu *ppu, uint16_t addr)
 {
 	uint8_t val;
@@ -114,14 +255,17 @@ uint8_t PPU_read_register(struct ppu *ppu, uint16_t addr)
 			val = ppu->mask;
 			break;
 		case 0x2002:
+			// sprite 0 may have hit in pixels already drawn
+			compose_drawn(ppu);
 			val = ppu->status;
 			read_status(ppu);
+			predict_nmi(ppu);
 			break;
 		case 0x2003:
 			val = ppu->oam_addr;
 			break;
 		case 0x2004:
-			val = ppu->oam_data;
+			val = PPU_OAM_read(ppu->oam, ppu->oam_addr);
 			break;
 		case 0x2005:
 			val = ppu->scroll;
@@ -130,8 +274,7 @@ uint8_t PPU_read_register(struct ppu *ppu, uint16_t addr)
 			val = ppu->addr;
 			break;
 		case 0x2007:
-			val = ppu->data;
-			read_or_write_data(ppu);
+			val = read_data(ppu);
 			break;
 	}
 	return val;
@@ -190,8 +333,11 @@ void PPU_write_register(struct ppu *ppu, uint16_t addr, uint8_t value)
 		case 0x2000:
 			ppu->ctrl = value;
 			write_to_ctrl(ppu, value);
+			predict_nmi(ppu);
 			break;
 		case 0x2001:
+			// pixels already drawn are composed as they were drawn
+			compose_drawn(ppu);
 			ppu->mask = value;
 			break;
 		case 0x2002:
@@ -202,6 +348,7 @@ void PPU_write_register(struct ppu *ppu, uint16_t addr, uint8_t value)
 			break;
 		case 0x2004:
 			ppu->oam_data = value;
+			PPU_OAM_write(ppu->oam, ppu->oam_addr++, value);
 			break;
 		case 0x2005:
 			ppu->scroll = value;
@@ -216,13 +363,66 @@ void PPU_write_register(struct ppu *ppu, uint16_t addr, uint8_t value)
 			break;
 		case 0x2007:
 			ppu->data = value;
-			read_or_write_data(ppu);
+			write_data(ppu, value);
 			break;
 	}
 }
 
+uint32_t PPU_rendered_lines(const struct ppu *ppu)
+{
+	return ppu->rendered_lines;
+}
+
+uint64_t PPU_rendered_line_dot(const struct ppu *ppu, const unsigned int lines)
+{
+	// Counting from the pre-render line, which the dot count starts on,
+	// lines are rendered at dot 260 of the first 241 lines of each frame
+	unsigned int row = (ppu->line + 1) % PPU_LINES_PER_FRAME;
+	uint64_t frame_start = ppu->dots - (row * PPU_DOTS_PER_LINE + ppu->dot);
+	uint64_t next = row + (ppu->dot > 260 ? 1 : 0);
+
+	if ((ppu->mask & 0x18) == 0 || lines == 0) {
+		return PPU_NEVER;
+	}
+	if (row > 240) {
+		next = 241;
+	}
+	next += lines - 1;
+	return frame_start + (next / 241) * PPU_DOTS_PER_FRAME + (next % 241) * PPU_DOTS_PER_LINE + 260;
+}
+
+int PPU_write_data(struct ppu *ppu, const uint8_t *data, const uint16_t len, const uint32_t dots)
+{
+	unsigned int now = frame_dot(ppu);
+	uint16_t i;
+
+	// Nothing is drawn while rendering is off, and the post-render line
+	// and vertical blank draw nothing either
+	if ((ppu->mask & 0x18) != 0 &&
+			(now < (240 + 1) * PPU_DOTS_PER_LINE || now + dots >= PPU_DOTS_PER_FRAME)) {
+		return 0;
+	}
+	for (i = 0; i < len; i++) {
+		ppu->data = data[i];
+		write_data(ppu, data[i]);
+	}
+	return 1;
+}
+
+void PPU_write_oam_dma(struct ppu *ppu, const uint8_t *data)
+{
+	ppu->oam_data = data[PPU_OAM_SIZE - 1];
+	PPU_OAM_write_page(ppu->oam, ppu->oam_addr, data);
+}
+
+void PPU_attach_memory(struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	ppu->mem = ppu_mem;
+}
+
 void PPU_delete(struct ppu **ppu)
 {
+	PPU_OAM_delete(&(*ppu)->oam);
 	free(*ppu);
 }
 
@@ -271,80 +471,408 @@ inline void increment_cycle(struct ppu *ppu)
 	}
 }
 
-inline void process_sprites(struct ppu *ppu, struct ppu_memory *ppu_mem)
+inline void copy_vertical(struct ppu *ppu)
+{
+	// vertical_v = vertical_t
+	ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 5, 5, 5);
+	ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 4, 11, 11);
+}
+
+inline void copy_horizontal(struct ppu *ppu)
+{
+	// horizontal_v = horizontal_t
+	ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 5, 0, 0);
+	ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 1, 10, 10);
+}
+
+inline void increment_vertical(struct ppu *ppu)
+{
+	// increment vertical_v
+	// Code taken from
+	// http://wiki.nesdev.com/w/index.php/The_skinny_on_NES_scrolling#Wrapping_around
+	if ((ppu->loopy_v & 0x7000) != 0x7000) {			// if fine Y < 7
+		ppu->loopy_v += 0x1000;					// increment fine Y
+	} else {
+		ppu->loopy_v &= ~0x7000;				// fine Y = 0
+		int y = (ppu->loopy_v & 0x03E0) >> 5;			// let y = coarse Y
+		if (y == 29) {
+			y = 0;						// coarse Y = 0
+			ppu->loopy_v ^= 0x0800;				// switch vertical nametable
+		} else if (y == 31) {
+			y = 0;						// coarse Y = 0, nametable not switched
+		} else {
+			y += 1;						// increment coarse Y
+		}
+		ppu->loopy_v = (ppu->loopy_v & ~0x03E0) | (y << 5);	// put coarse Y back into v
+	}
+}
+
+inline void increment_horizontal(struct ppu *ppu)
+{
+	// increment horizontal_v
+	if ((ppu->loopy_v & 0x001F) == 31) {	// if coarse X == 31
+		ppu->loopy_v &= ~0x001F;	// coarse X = 0
+		ppu->loopy_v ^= 0x0400;		// switch horizontal nametable
+	} else {
+		ppu->loopy_v += 1;		// increment coarse X
+	}
+}
+
+inline uint8_t rendering_is_enabled(struct ppu *ppu)
+{
+	return ppu->mask & ((1<<3) | (1<<4));
+}
+
+/*
+ * Composition
+ * ===========
+ *
+ * The sprites on a line are drawn into sprite_pixels first, as palette RAM
+ * indexes 0x11 to 0x1F, marked SPRITE_BEHIND when they are behind the
+ * background and SPRITE_0 for sprite 0.  0 is no sprite.  They are then laid
+ * over the background pixels in the framebuffer: a sprite pixel is shown
+ * unless it is transparent, or behind an opaque background pixel.  Where
+ * sprite 0 and the background are both opaque, other than at x = 255, sprite
+ * 0 has hit.
+ *
+ * The background is drawn a tile at a time, but the sprites are laid over it
+ * COMPOSE_SPAN pixels at a time, so that the SIMD loops below get whole
+ * vectors.  Pixels drawn but not yet composed are composed at the end of the
+ * line, and before PPUSTATUS is read or PPUMASK is written, so a sprite 0
+ * hit is seen on time and each pixel uses the PPUMASK it was drawn with.
+ *
+ * Grayscale and emphasis change the colours palette RAM holds, not which
+ * entry a pixel uses, so the framebuffer cannot carry them.  Instead the
+ * PPUMASK each line is finished with is kept in line_mask, for whatever
+ * turns the palette RAM indexes into colours.
+ */
+#define SPRITE_BEHIND (1<<5)
+#define SPRITE_0 (1<<6)
+#define COMPOSE_SPAN 32
+
+// Returns 1 if sprite 0 hit
+static inline int compose_scalar(uint8_t *pixels, const uint8_t *sprites, const unsigned int x, const unsigned int count)
+{
+	unsigned int i;
+	int hit = 0;
+
+	for (i = 0; i < count; i++) {
+		if ((sprites[i] & 0x03) == 0) {
+			continue;
+		}
+		if ((pixels[i] & 0x03) != 0) {
+			if ((sprites[i] & SPRITE_0) != 0 && x + i != 255) {
+				hit = 1;
+			}
+			if ((sprites[i] & SPRITE_BEHIND) != 0) {
+				continue;
+			}
+		}
+		pixels[i] = sprites[i] & 0x1F;
+	}
+	return hit;
+}
+
+#ifdef __SSE2__
+// The same, 16 pixels at a time
+static inline int compose_sse2(uint8_t *pixels, const uint8_t *sprites, const unsigned int x, const unsigned int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i colour = _mm_set1_epi8(0x03);
+	unsigned int i;
+	int hit = 0;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i background = _mm_loadu_si128((const __m128i *)(pixels + i));
+		__m128i sprite = _mm_loadu_si128((const __m128i *)(sprites + i));
+		__m128i clear_background = _mm_cmpeq_epi8(_mm_and_si128(background, colour), zero);
+		__m128i clear_sprite = _mm_cmpeq_epi8(_mm_and_si128(sprite, colour), zero);
+		__m128i in_front = _mm_cmpeq_epi8(_mm_and_si128(sprite, _mm_set1_epi8(SPRITE_BEHIND)), zero);
+		__m128i not_sprite_0 = _mm_cmpeq_epi8(_mm_and_si128(sprite, _mm_set1_epi8(SPRITE_0)), zero);
+		__m128i shown = _mm_andnot_si128(clear_sprite, _mm_or_si128(in_front, clear_background));
+		int hits = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(clear_background, clear_sprite), not_sprite_0)) & 0xFFFF;
+
+		if (x + i + 15 == 255) {
+			hits &= 0x7FFF;
+		}
+		hit |= hits != 0;
+		_mm_storeu_si128((__m128i *)(pixels + i), _mm_or_si128(
+				_mm_and_si128(shown, _mm_and_si128(sprite, _mm_set1_epi8(0x1F))),
+				_mm_andnot_si128(shown, background)));
+	}
+	return hit | compose_scalar(pixels + i, sprites + i, x + i, count - i);
+}
+#endif
+
+#ifdef __AVX2__
+// The same, 32 pixels at a time
+static inline int compose_avx2(uint8_t *pixels, const uint8_t *sprites, const unsigned int x, const unsigned int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i colour = _mm256_set1_epi8(0x03);
+	unsigned int i;
+	int hit = 0;
+
+	for (i = 0; i + 32 <= count; i += 32) {
+		__m256i background = _mm256_loadu_si256((const __m256i *)(pixels + i));
+		__m256i sprite = _mm256_loadu_si256((const __m256i *)(sprites + i));
+		__m256i clear_background = _mm256_cmpeq_epi8(_mm256_and_si256(background, colour), zero);
+		__m256i clear_sprite = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, colour), zero);
+		__m256i in_front = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, _mm256_set1_epi8(SPRITE_BEHIND)), zero);
+		__m256i not_sprite_0 = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, _mm256_set1_epi8(SPRITE_0)), zero);
+		__m256i shown = _mm256_andnot_si256(clear_sprite, _mm256_or_si256(in_front, clear_background));
+		uint32_t hits = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(clear_background, clear_sprite), not_sprite_0));
+
+		if (x + i + 31 == 255) {
+			hits &= 0x7FFFFFFF;
+		}
+		hit |= hits != 0;
+		_mm256_storeu_si256((__m256i *)(pixels + i), _mm256_or_si256(
+				_mm256_and_si256(shown, _mm256_and_si256(sprite, _mm256_set1_epi8(0x1F))),
+				_mm256_andnot_si256(shown, background)));
+	}
+	return hit | compose_sse2(pixels + i, sprites + i, x + i, count - i);
+}
+#endif
+
+// Lay the sprites over count pixels of the current line from x
+static inline void compose(struct ppu *ppu, unsigned int x, unsigned int count)
+{
+	int hit;
+
+	if (ppu->sprite_count == 0 || (ppu->mask & (1<<4)) == 0) {
+		return;
+	}
+	// Sprites hidden in the leftmost 8 pixels
+	if (x < 8 && (ppu->mask & (1<<2)) == 0) {
+		if (x + count <= 8) {
+			return;
+		}
+		count -= 8 - x;
+		x = 8;
+	}
+#ifdef __AVX2__
+	hit = compose_avx2(&ppu->framebuffer[ppu->line][x], &ppu->sprite_pixels[x], x, count);
+#elif defined(__SSE2__)
+	hit = compose_sse2(&ppu->framebuffer[ppu->line][x], &ppu->sprite_pixels[x], x, count);
+#else
+	hit = compose_scalar(&ppu->framebuffer[ppu->line][x], &ppu->sprite_pixels[x], x, count);
+#endif
+	if (hit != 0) {
+		ppu->status |= (1<<6);
+	}
+}
+
+// Lay the sprites over the pixels drawn since last time
+static inline void compose_drawn(struct ppu *ppu)
+{
+	if (ppu->composed == ppu->drawn) {
+		return;
+	}
+	compose(ppu, ppu->composed, ppu->drawn - ppu->composed);
+	ppu->composed = ppu->drawn;
+	if (ppu->drawn == PPU_SCREEN_WIDTH) {
+		ppu->line_mask[ppu->line] = ppu->mask;
+	}
+}
+
+/*
+ * Sprites
+ * =======
+ *
+ * The PPU evaluates the sprites for the next line over dots 65 to 256 of each
+ * visible line, and fetches their patterns over dots 257 to 320.  Nothing
+ * outside can see it part way, except the sprite overflow flag, so here it is
+ * all done at dot 257, drawing the next line's sprites into sprite_pixels.
+ * The pre-render line leaves no sprites for line 0.
+ */
+#define SPRITE_HEIGHT(ppu) (((ppu)->ctrl & (1<<5)) ? 16 : 8)
+
+// Draw a sprite from secondary OAM, on the line after the current one
+static inline void draw_sprite(struct ppu *ppu, struct ppu_memory *ppu_mem, const struct oam_data *sprite, const uint8_t sprite_0)
+{
+	unsigned int height = SPRITE_HEIGHT(ppu);
+	unsigned int row = ppu->line - sprite->y_pos;
+	uint8_t flags = 0x10 | ((sprite->attribute & 0x03) << 2) | sprite_0;
+	const uint8_t *pixels;
+	uint16_t pattern;
+	unsigned int i;
+
+	if ((sprite->attribute & (1<<5)) != 0) {
+		flags |= SPRITE_BEHIND;
+	}
+	if ((sprite->attribute & (1<<7)) != 0) {
+		row = height - 1 - row;
+	}
+	if (height == 16) {
+		// Bit 0 of the tile picks the pattern table, and the bottom
+		// half is the next tile
+		pattern = ((sprite->index & 1) << 12) | ((sprite->index & 0xFE) << 4) | ((row & 8) << 1) | (row & 7);
+	} else {
+		pattern = ((ppu->ctrl & (1<<3)) << 9) | (sprite->index << 4) | row;
+	}
+
+	pixels = PPU_MEM_tile_row(ppu_mem, pattern, sprite->attribute & (1<<6));
+	for (i = 0; i < 8 && sprite->x_pos + i < PPU_SCREEN_WIDTH; i++) {
+		if (pixels[i] != 0) {
+			ppu->sprite_pixels[sprite->x_pos + i] = flags | pixels[i];
+		}
+	}
+}
+
+static inline void load_sprites(struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	const struct oam_data *secondary;
+	unsigned int found;
+	unsigned int i;
+
+	if (ppu->sprite_count != 0) {
+		memset(ppu->sprite_pixels, 0, sizeof(ppu->sprite_pixels));
+		ppu->sprite_count = 0;
+	}
+	if (ppu->line >= 240 || rendering_is_enabled(ppu) == 0) {
+		return;
+	}
+
+	found = PPU_OAM_evaluate(ppu->oam, ppu->line, SPRITE_HEIGHT(ppu));
+	if ((found & PPU_OAM_OVERFLOW) != 0) {
+		ppu->status |= (1<<5);
+	}
+	ppu->sprite_count = found & 0x0F;
+
+	// Lower numbered sprites are in front, so they are drawn last
+	secondary = PPU_OAM_secondary(ppu->oam);
+	for (i = ppu->sprite_count; i-- > 0;) {
+		draw_sprite(ppu, ppu_mem, &secondary[i], (i == 0 && (found & PPU_OAM_SPRITE_0) != 0) ? SPRITE_0 : 0);
+	}
+}
+
+static inline void process_sprites(struct ppu *ppu, struct ppu_memory *ppu_mem)
 {
 	if (ppu->line == 261 || ppu->line >= 240) {
 		if((ppu->dot >= 257) && (ppu->dot <= 320)) {
 			ppu->oam_addr = 0;
 		}
 	}
+	if ((ppu->line < 240 || ppu->line == 261) && ppu->dot == 257) {
+		load_sprites(ppu, ppu_mem);
+	}
+}
+
+/*
+ * Draw the 8 pixels of the tile in the high byte of the shift registers,
+ * scrolled left by fine X, at the given x on the current line.  The sprites
+ * are laid over them later, see Composition.
+ */
+static inline void draw_tile(struct ppu *ppu, const unsigned int x)
+{
+	uint8_t *pixel = &ppu->framebuffer[ppu->line][x];
+	int i;
+
+	if (x == 0) {
+		ppu->composed = 0;
+	}
+	ppu->drawn = x + 8;
+
+	// Backdrop where the background is hidden
+	if ((ppu->mask & (1<<3)) == 0 || (x == 0 && (ppu->mask & (1<<1)) == 0)) {
+		memset(pixel, 0, 8);
+		return;
+	}
+
+	// The 8 bits of each register that are drawn
+	uint8_t low = ppu->low_bg >> (8 - ppu->loopy_x);
+	uint8_t high = ppu->high_bg >> (8 - ppu->loopy_x);
+	uint8_t low_attribute = ppu->low_bg_attribute >> (8 - ppu->loopy_x);
+	uint8_t high_attribute = ppu->high_bg_attribute >> (8 - ppu->loopy_x);
+
+	for (i = 0; i < 8; i++) {
+		int bit = 7 - i;
+		uint8_t colour = ((low >> bit) & 1) | (((high >> bit) & 1) << 1);
+		uint8_t palette = ((low_attribute >> bit) & 1) | (((high_attribute >> bit) & 1) << 1);
+
+		// Colour 0 of every background palette is the backdrop
+		pixel[i] = colour == 0 ? 0 : (palette << 2) | colour;
+	}
+}
+
+/*
+ * Read the tile at loopy_v: its nametable byte, attribute and both pattern
+ * bytes, which the PPU reads over 8 dots.
+ */
+static inline void read_tile(struct ppu *ppu, struct ppu_memory *ppu_mem, uint8_t *low, uint8_t *high, uint8_t *palette)
+{
+	uint16_t v = ppu->loopy_v;
+	uint8_t tile = PPU_MEM_read(ppu_mem, 0x2000 | (v & 0x0FFF));
+	uint8_t attribute = PPU_MEM_read(ppu_mem, 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+	uint16_t pattern = ((ppu->ctrl & (1<<4)) << 8) | (tile << 4) | ((v >> 12) & 0x07);
+
+	// Each attribute byte covers 4x4 tiles, 2 bits for each 2x2
+	*palette = (attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03;
+	*low = PPU_MEM_read(ppu_mem, pattern);
+	*high = PPU_MEM_read(ppu_mem, pattern + 8);
+}
+
+/*
+ * Fetch the tile at loopy_v into the low byte of the shift registers.
+ */
+static inline void fetch_tile(struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	uint8_t low, high, palette;
+
+	read_tile(ppu, ppu_mem, &low, &high, &palette);
+	ppu->low_bg = (ppu->low_bg << 8) | low;
+	ppu->high_bg = (ppu->high_bg << 8) | high;
+	ppu->low_bg_attribute = (ppu->low_bg_attribute << 8) | ((palette & 1) ? 0xFF : 0x00);
+	ppu->high_bg_attribute = (ppu->high_bg_attribute << 8) | ((palette & 2) ? 0xFF : 0x00);
+}
+
+/*
+ * The background pipeline, a tile at a time, at the last dot of each 8: draw
+ * the tile coming out of the shift registers, fetch another into them, and
+ * move loopy_v on to the tile after it.
+ */
+static inline void run_tile(struct ppu *ppu, struct ppu_memory *ppu_mem, const unsigned int dot)
+{
+	if (ppu->line < 240 && dot <= 256) {
+		draw_tile(ppu, dot - 8);
+		if (ppu->drawn - ppu->composed >= COMPOSE_SPAN || ppu->drawn == PPU_SCREEN_WIDTH) {
+			compose_drawn(ppu);
+		}
+	}
+	if (rendering_is_enabled(ppu) != 0) {
+		fetch_tile(ppu, ppu_mem);
+		increment_horizontal(ppu);
+	}
 }
 
-inline void process_background(struct ppu *ppu, struct ppu_memory *ppu_mem)
+static inline void process_background(struct ppu *ppu, struct ppu_memory *ppu_mem)
 {
 	if (ppu->line < 240 || ppu->line == 261) {
+		if ((ppu->dot < 257 && ppu->dot > 0) || (ppu->dot > 320)) {
+			if (ppu->dot % 8 == 0) {
+				run_tile(ppu, ppu_mem, ppu->dot);
+			}
+		}
+
+		// loopy_v is only moved while rendering
+		if (rendering_is_enabled(ppu) == 0) {
+			return;
+		}
+
 		// special case for line 261
 		if (ppu->line == 261) {
 			if (ppu->dot >= 280 && ppu->dot <= 304) {
-				// vertical_v = vertical_t
-				ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 5, 5, 5);
-				ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 4, 11, 11);
+				copy_vertical(ppu);
 			}
 		}
 
 		if (ppu->dot == 257) {
-			// horizontal_v = horizontal_t
-			ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 5, 0, 0);
-			ppu->loopy_v = set_bits(ppu->loopy_t, ppu->loopy_v, 1, 10, 10);
+			copy_horizontal(ppu);
 		}
 
 		if (ppu->dot == 256) {
-			// increment vertical_v
-			// Code taken from
-			// http://wiki.nesdev.com/w/index.php/The_skinny_on_NES_scrolling#Wrapping_around
-			if ((ppu->loopy_v & 0x7000) != 0x7000) {			// if fine Y < 7
-				ppu->loopy_v += 0x1000;					// increment fine Y
-			} else {
-				ppu->loopy_v &= ~0x7000;				// fine Y = 0
-				int y = (ppu->loopy_v & 0x03E0) >> 5;			// let y = coarse Y
-				if (y == 29) {
-					y = 0;						// coarse Y = 0
-					ppu->loopy_v ^= 0x0800;				// switch vertical nametable
-				} else if (y == 31) {
-					y = 0;						// coarse Y = 0, nametable not switched
-				} else {
-					y += 1;						// increment coarse Y
-				}
-				ppu->loopy_v = (ppu->loopy_v & ~0x03E0) | (y << 5);	// put coarse Y back into v
-			}
-		}
-
-		if ((ppu->dot < 257 && ppu->dot > 0) || (ppu->dot > 320)) {
-			uint8_t fetch_cycle = ppu->dot % 8;
-
-			switch(fetch_cycle) {
-				case 0:
-					// increment horizontal_v
-					if ((ppu->loopy_v & 0x001F) == 31) {	// if coarse X == 31
-						ppu->loopy_v &= ~0x001F;	// coarse X = 0
-						ppu->loopy_v ^= 0x0400;		// switch horizontal nametable
-					} else {
-						ppu->loopy_v += 1;		// increment coarse X
-					}
-					break;
-				case 2:
-					// fetch nametable address
-					break;
-				case 4:
-					// fetch attribute table address
-					break;
-				case 6:
-					// fetch low background tile byte
-					break;
-				case 8:
-					// fetch high background tile byte
-					break;
-			}
+			increment_vertical(ppu);
 		}
 	}
 }
@@ -365,7 +893,7 @@ inline void set_flags(struct ppu *ppu, struct ppu_memory *ppu_mem)
 	}
 }
 
-uint8_t PPU_step(struct ppu *ppu, struct ppu_memory *ppu_mem)
+static inline uint8_t step(struct ppu *ppu, struct ppu_memory *ppu_mem)
 {
 #ifdef DEBUG_PPU
 	(void)printf("SL %03d.%03d ", ppu->line, ppu->dot);
@@ -375,6 +903,12 @@ uint8_t PPU_step(struct ppu *ppu, struct ppu_memory *ppu_mem)
 	process_sprites(ppu, ppu_mem);
 	process_background(ppu, ppu_mem);
 
+	// Sprite fetches from the pattern table at 0x1000 start here, and raise
+	// PPU address line A12, which is what MMC3 counts lines by
+	if (ppu->dot == 260 && (ppu->line < 240 || ppu->line == 261) && rendering_is_enabled(ppu) != 0) {
+		ppu->rendered_lines++;
+	}
+
 	// check for NMI
 	if (ppu->line == 241 && ppu->dot == 1) {
 		if (vblank_is_enabled(ppu) != 0) {
@@ -382,13 +916,349 @@ uint8_t PPU_step(struct ppu *ppu, struct ppu_memory *ppu_mem)
 			(void)printf("\n*** Executing VBLANK ***\n");
 #endif
 			return_val = 0;
+			ppu->nmi_dot += PPU_DOTS_PER_FRAME;
 		}
 	}
 
-
 #ifdef DEBUG_PPU
 	(void)printf("ctrl:%02x mask:%02x status:%02x oamaddr:%02x oamdata:%02x scroll:%02x addr:%02x data:%02x loopy_v:%04x loopy_t:%04x loopy_x:%04x\n", ppu->ctrl, ppu->mask, ppu->status, ppu->oam_addr, ppu->oam_data, ppu->scroll, ppu->addr, ppu->data, ppu->loopy_v, ppu->loopy_t, ppu->loopy_x);
 #endif
 	increment_cycle(ppu);
+	ppu->dots++;
 	return return_val;
 }
+
+uint8_t PPU_step(struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	return step(ppu, ppu_mem);
+}
+
+/*
+ * Bulk stepping
+ * =============
+ *
+ * Registers cannot change in the middle of a PPU_run, so a run of dots on one
+ * line is handled all at once, in the same order that PPU_step would handle
+ * it dot by dot.  Each function below runs dots first to last - 1 of the
+ * current line, for one region of the frame.
+ */
+
+// Does first to last - 1 include any dot from low to high?
+static inline int dots_include(const unsigned int first, const unsigned int last, const unsigned int low, const unsigned int high)
+{
+	return first <= high && last > low;
+}
+
+// Lines 0 to 239, and the background half of the pre-render line
+static inline void run_rendering_dots(struct ppu *ppu, struct ppu_memory *ppu_mem, const unsigned int first, const unsigned int last)
+{
+	// The first dot of a tile from first on, other than 0
+	unsigned int dot = first == 0 ? 8 : (first + 7) & ~7;
+
+	// Tiles end every 8 dots up to 256, and the first two of the next
+	// line are fetched at 328 and 336.
+	for (; dot < last && dot <= 256; dot += 8) {
+		run_tile(ppu, ppu_mem, dot);
+	}
+	if (dots_include(first, last, 257, 257)) {
+		load_sprites(ppu, ppu_mem);
+	}
+	if (rendering_is_enabled(ppu) == 0) {
+		return;
+	}
+	if (dots_include(first, last, 256, 256)) {
+		increment_vertical(ppu);
+	}
+	if (dots_include(first, last, 257, 257)) {
+		copy_horizontal(ppu);
+	}
+	if (ppu->line == 261 && dots_include(first, last, 280, 304)) {
+		copy_vertical(ppu);
+	}
+	if (dots_include(first, last, 260, 260)) {
+		ppu->rendered_lines++;
+	}
+	for (dot = dot < 328 ? 328 : dot; dot < last && dot <= 336; dot += 8) {
+		run_tile(ppu, ppu_mem, dot);
+	}
+}
+
+// Lines 240 to 261
+static inline void run_idle_dots(struct ppu *ppu, const unsigned int first, const unsigned int last)
+{
+	if (dots_include(first, last, 257, 320)) {
+		ppu->oam_addr = 0;
+	}
+}
+
+/*
+ * Scanline renderer
+ * =================
+ *
+ * When a run covers dots 0 to 257 of a visible line, nothing can change
+ * part way across it, so the line is drawn in one pass instead of a tile at a
+ * time: the two tiles already in the shift registers, then the 32 read from
+ * loopy_v on, are copied 8 pixels at a time into a row, which is copied out
+ * from fine X.  loopy_v and the shift registers end up as the pipeline leaves
+ * them, so a line split by a register access is simply left to the pipeline.
+ */
+
+// 8 pixels of colours 0 to 3, as palette RAM indexes
+static inline uint64_t add_palette(const uint64_t colours, const uint8_t palette)
+{
+	uint64_t opaque = (colours | (colours >> 1)) & 0x0101010101010101ULL;
+
+	// Colour 0 of every background palette is the backdrop
+	return colours | (opaque * (palette << 2));
+}
+
+// The 8 pixels of a tile in the shift registers, as palette RAM indexes
+static inline uint64_t decode_tile(const uint8_t low, const uint8_t high, const uint8_t palette)
+{
+	return add_palette(pattern_bits[low] | (pattern_bits[high] << 1), palette);
+}
+
+// Dots 0 to 257 of a visible line
+static inline void run_line(struct ppu *ppu, struct ppu_memory *ppu_mem)
+{
+	uint8_t *pixels = ppu->framebuffer[ppu->line];
+	uint64_t row[34];
+	uint8_t attribute = 0;
+	uint64_t colours;
+	uint8_t palette;
+	int i;
+
+	if (rendering_is_enabled(ppu) == 0) {
+		memset(pixels, 0, PPU_SCREEN_WIDTH);
+		load_sprites(ppu, ppu_mem);
+		return;
+	}
+
+	row[0] = decode_tile(ppu->low_bg >> 8, ppu->high_bg >> 8,
+			((ppu->low_bg_attribute >> 8) & 1) | ((ppu->high_bg_attribute >> 8) & 2));
+	row[1] = decode_tile(ppu->low_bg & 0xFF, ppu->high_bg & 0xFF,
+			(ppu->low_bg_attribute & 1) | (ppu->high_bg_attribute & 2));
+	for (i = 2; i < 34; i++) {
+		uint16_t v = ppu->loopy_v;
+		uint8_t tile = PPU_MEM_read(ppu_mem, 0x2000 | (v & 0x0FFF));
+		uint16_t pattern = ((ppu->ctrl & (1<<4)) << 8) | (tile << 4) | ((v >> 12) & 0x07);
+
+		// 4 tiles across share an attribute byte
+		if (i == 2 || (v & 0x03) == 0) {
+			attribute = PPU_MEM_read(ppu_mem, 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+		}
+		palette = (attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03;
+		memcpy(&colours, PPU_MEM_tile_row(ppu_mem, pattern, 0), 8);
+		row[i] = add_palette(colours, palette);
+		increment_horizontal(ppu);
+
+		// The last two are left in the shift registers, as at dot 256
+		if (i >= 32) {
+			ppu->low_bg = (ppu->low_bg << 8) | PPU_MEM_read(ppu_mem, pattern);
+			ppu->high_bg = (ppu->high_bg << 8) | PPU_MEM_read(ppu_mem, pattern + 8);
+			ppu->low_bg_attribute = (ppu->low_bg_attribute << 8) | ((palette & 1) ? 0xFF : 0x00);
+			ppu->high_bg_attribute = (ppu->high_bg_attribute << 8) | ((palette & 2) ? 0xFF : 0x00);
+		}
+	}
+
+	if ((ppu->mask & (1<<3)) == 0) {
+		memset(pixels, 0, PPU_SCREEN_WIDTH);
+	} else {
+		memcpy(pixels, (uint8_t *)row + ppu->loopy_x, PPU_SCREEN_WIDTH);
+		if ((ppu->mask & (1<<1)) == 0) {
+			memset(pixels, 0, 8);
+		}
+	}
+	ppu->composed = 0;
+	ppu->drawn = PPU_SCREEN_WIDTH;
+	compose_drawn(ppu);
+	increment_vertical(ppu);
+	copy_horizontal(ppu);
+	load_sprites(ppu, ppu_mem);
+}
+
+static inline uint8_t run_dots(struct ppu *ppu, struct ppu_memory *ppu_mem, unsigned int first, const unsigned int last)
+{
+	uint8_t return_val = 1;
+
+	if (ppu->line < 240) {
+		if (ppu->scanline_renderer != 0 && first == 0 && last > 257) {
+			run_line(ppu, ppu_mem);
+			first = 258;
+		}
+		run_rendering_dots(ppu, ppu_mem, first, last);
+	} else if (ppu->line == 261) {
+		if (dots_include(first, last, 1, 1)) {
+			clear_vblank_flag(ppu);
+			clear_sprite_overflow_flag(ppu);
+			clear_sprite_0_hit_flag(ppu);
+		}
+		run_idle_dots(ppu, first, last);
+		run_rendering_dots(ppu, ppu_mem, first, last);
+	} else {
+		if (ppu->line == 241 && dots_include(first, last, 1, 1)) {
+			set_vblank_flag(ppu);
+			if (vblank_is_enabled(ppu) != 0) {
+				return_val = 0;
+				ppu->nmi_dot += PPU_DOTS_PER_FRAME;
+			}
+		}
+		run_idle_dots(ppu, first, last);
+	}
+	return return_val;
+}
+
+uint8_t PPU_run(struct ppu *ppu, struct ppu_memory *ppu_mem, uint64_t dots)
+{
+	uint8_t return_val = 1;
+
+#ifdef DEBUG_PPU
+	// Dot by dot, for the trace
+	while (dots > 0) {
+		return_val &= step(ppu, ppu_mem);
+		dots--;
+	}
+#else
+	while (dots > 0) {
+		unsigned int first = ppu->dot;
+		unsigned int last = 341;
+
+		if (ppu->line > 241 && ppu->line < 261 && first == 0 && dots >= 341) {
+			// Whole lines of vertical blank only reset OAMADDR
+			unsigned int lines = 261 - ppu->line;
+			if (dots / 341 < lines) {
+				lines = dots / 341;
+			}
+			ppu->oam_addr = 0;
+			ppu->line += lines;
+			ppu->dots += lines * 341;
+			dots -= lines * 341;
+			continue;
+		}
+
+		if (dots < last - first) {
+			last = first + dots;
+		}
+		return_val &= run_dots(ppu, ppu_mem, first, last);
+		ppu->dots += last - first;
+		dots -= last - first;
+		if (last == 341) {
+			ppu->dot = 0;
+			ppu->line = ppu->line == 261 ? 0 : ppu->line + 1;
+		} else {
+			ppu->dot = last;
+		}
+	}
+#endif
+	return return_val;
+}
+
+int PPU_enable_scanline_renderer(struct ppu *ppu, const int enable)
+{
+	ppu->scanline_renderer = enable;
+	return ppu->scanline_renderer;
+}
+
+const uint8_t *PPU_framebuffer(const struct ppu *ppu)
+{
+	return &ppu->framebuffer[0][0];
+}
+
+const uint8_t *PPU_line_masks(const struct ppu *ppu)
+{
+	return ppu->line_mask;
+}
+
+uint64_t PPU_next_nmi(const struct ppu *ppu)
+{
+	return ppu->nmi_dot;
+}
+
+// Dots from the start of the pre-render line to the given dot of a line
+#define LINE_DOT(line, dot) (((line) + 1) * PPU_DOTS_PER_LINE + (dot))
+
+/*
+ * Sprite 0 hit can be set at any dot of the lines sprite 0 is on, while both
+ * the background and sprites are shown.  Returns 0 if it cannot be set this
+ * frame, or the first and last frame dots when it can.
+ */
+static int sprite_0_window(const struct ppu *ppu, unsigned int *first, unsigned int *last)
+{
+	unsigned int y = PPU_OAM_read(ppu->oam, 0);
+	unsigned int bottom = y + SPRITE_HEIGHT(ppu);
+
+	if ((ppu->status & (1<<6)) != 0 || (ppu->mask & 0x18) != 0x18 || y >= 239) {
+		return 0;
+	}
+	*first = LINE_DOT(y + 1, 0);
+	*last = LINE_DOT(bottom < 239 ? bottom : 239, 256);
+	return 1;
+}
+
+/*
+ * The frame dot from now at which the sprite overflow or sprite 0 hit flag
+ * may next be set, or PPU_DOTS_PER_FRAME * 2 if neither can be this frame.
+ * Overflow can only be set at dot 257 of a line with 8 or more sprites on
+ * the next.  Within sprite 0's window, this is the end of it.
+ */
+static unsigned int next_sprite_flag(const struct ppu *ppu, const unsigned int now)
+{
+	unsigned int next = PPU_DOTS_PER_FRAME * 2;
+	unsigned int first, last;
+	unsigned int line;
+
+	if ((ppu->mask & 0x18) == 0) {
+		return next;
+	}
+	if (sprite_0_window(ppu, &first, &last) != 0) {
+		if (now <= first) {
+			next = first;
+		} else if (now <= last) {
+			next = last;
+		}
+	}
+	if ((ppu->status & (1<<5)) == 0) {
+		line = ppu->line == 261 ? 0 : ppu->line + (ppu->dot > 257);
+		for (; line < 240 && LINE_DOT(line, 257) < next; line++) {
+			if (PPU_OAM_count(ppu->oam, line, SPRITE_HEIGHT(ppu)) >= PPU_OAM_LINE_SPRITES) {
+				next = LINE_DOT(line, 257);
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+uint64_t PPU_next_status_change(const struct ppu *ppu)
+{
+	unsigned int now = frame_dot(ppu);
+	unsigned int next;
+
+	if (now <= VBLANK_END_DOT) {
+		next = VBLANK_END_DOT;
+	} else if (now <= VBLANK_START_DOT) {
+		next = VBLANK_START_DOT;
+	} else {
+		next = VBLANK_END_DOT + PPU_DOTS_PER_FRAME;
+	}
+	if (next_sprite_flag(ppu, now) < next) {
+		next = next_sprite_flag(ppu, now);
+	}
+	return ppu->dots + (next - now);
+}
+
+int PPU_status_is_stable(const struct ppu *ppu)
+{
+	unsigned int now = frame_dot(ppu);
+	unsigned int first, last;
+
+	return sprite_0_window(ppu, &first, &last) == 0 || now < first || now > last;
+}
+
+uint8_t PPU_catch_up(struct ppu *ppu, struct ppu_memory *ppu_mem, const uint64_t dots)
+{
+	if (ppu->dots >= dots) {
+		return 1;
+	}
+	return PPU_run(ppu, ppu_mem, dots - ppu->dots);
+}
@@ -102,12 +102,35 @@
 #define PPUADDR_ADDR 0x2006
 #define PPUDATA_ADDR 0x2007
 
+#define PPU_NEVER UINT64_MAX
+
+/*
+ * Timing
+ * ======
+ *
+ * A frame is 262 lines of 341 dots, starting from the pre-render line.
+ * The PPU runs 3 dots per CPU cycle.
+ */
+#define PPU_DOTS_PER_LINE 341
+#define PPU_LINES_PER_FRAME 262
+#define PPU_DOTS_PER_FRAME (PPU_LINES_PER_FRAME * PPU_DOTS_PER_LINE)
+/*
+ * The picture is 256x240 pixels, drawn during lines 0 to 239.
+ */
+#define PPU_SCREEN_WIDTH 256
+#define PPU_SCREEN_HEIGHT 240
+
 /*
  * Create a new ppu struct.
  * Memory must be instantiated before passing into this function.
  */
 extern struct ppu *PPU_init();
 
+/*
+ * Attach the PPU memory that PPUDATA reads and writes.
+ */
+extern void PPU_attach_memory(struct ppu *, struct ppu_memory *);
+
 /*
  * Destroy the given ppu
  */
@@ -118,8 +141,100 @@ extern void PPU_delete(struct ppu **);
  */
 extern uint8_t PPU_step(struct ppu *, struct ppu_memory *);
 
+/*
+ * Run the given number of dots, with the same result as calling PPU_step for
+ * each.  Each part of a scanline is done in one go, so this costs about the
+ * same for one dot as for a whole line.  Returns 0 if an NMI was raised.
+ */
+extern uint8_t PPU_run(struct ppu *, struct ppu_memory *, uint64_t);
+
+/*
+ * Turn the scanline renderer on or off.  It is off by default.  When a run
+ * covers the whole visible part of a line, the line is drawn in one pass,
+ * several times faster than the tile by tile pipeline; a line that is split
+ * by a register access is drawn by the pipeline.  The result is the same
+ * either way.  Returns whether it is on.
+ */
+extern int PPU_enable_scanline_renderer(struct ppu *, const int);
+
+/*
+ * Return the pixels drawn so far, PPU_SCREEN_WIDTH per line for
+ * PPU_SCREEN_HEIGHT lines.  Each is an index into palette RAM, 0 to 31,
+ * where 0 is the backdrop colour.  The background is drawn a tile at a time,
+ * so a line is complete once dot 256 has been run.
+ */
+extern const uint8_t *PPU_framebuffer(const struct ppu *);
+
+/*
+ * Return the PPUMASK each of the PPU_SCREEN_HEIGHT lines of the framebuffer
+ * was finished with.  Its grayscale and emphasis bits are not in the
+ * framebuffer, and apply to the whole line.
+ */
+extern const uint8_t *PPU_line_masks(const struct ppu *);
+
+/*
+ * Return the number of dots run since power on, at the point the next NMI is
+ * raised.  i.e. the NMI is raised while running the dot after that many
+ * have been run.  PPU_NEVER when NMIs are off.  This is only worked out again
+ * when $2000 or $2002 are accessed, or when an NMI is raised, so it is cheap
+ * enough to check after every CPU run.
+ */
+extern uint64_t PPU_next_nmi(const struct ppu *);
+
+/*
+ * Return the number of dots run since power on, at the point PPUSTATUS next
+ * changes by itself, i.e. when vertical blank starts or ends, or may change,
+ * when a sprite flag could be set.  Like PPU_next_nmi, the change is made
+ * while running the dot after that many.  Writes to $2000, $2001 and $2004
+ * can move it.
+ */
+extern uint64_t PPU_next_status_change(const struct ppu *);
+
+/*
+ * Return whether PPUSTATUS stays as it is until PPU_next_status_change.  It
+ * does not over the lines where sprite 0 can hit the background.
+ */
+extern int PPU_status_is_stable(const struct ppu *);
+
+/*
+ * Run the PPU until it has run the given number of dots since power on.  It
+ * is only run when its state is needed, e.g. for a register access or at the
+ * start of vertical blank, so one call usually covers many dots.  Returns 0
+ * if an NMI was raised on the way, like PPU_step.
+ */
+extern uint8_t PPU_catch_up(struct ppu *, struct ppu_memory *, const uint64_t);
+
+/*
+ * Return the number of lines rendered so far: the visible and pre-render
+ * lines that reached dot 260 with the background or sprites on.  This is
+ * when an MMC3 clocks its scanline counter.
+ */
+extern uint32_t PPU_rendered_lines(const struct ppu *);
+
+/*
+ * Return the number of dots run since power on, at the point the given
+ * number of further lines have been rendered.  i.e. the last of them is
+ * rendered while running the dot after that many have been run.  This holds
+ * until PPUMASK is written, and is PPU_NEVER while rendering is off.
+ */
+extern uint64_t PPU_rendered_line_dot(const struct ppu *, const unsigned int);
+
 extern uint8_t PPU_read_register(struct ppu *, uint16_t);
 
 extern void PPU_write_register(struct ppu *, uint16_t, uint8_t);
 
+/*
+ * OAM DMA: write the given 256 bytes to OAMDATA, starting at OAMADDR, which
+ * ends up back where it started.
+ */
+extern void PPU_write_oam_dma(struct ppu *, const uint8_t *);
+
+/*
+ * Write the given number of bytes to PPUDATA, one after another, as stores
+ * spread over the given number of dots from now would.  This is only done if
+ * nothing is drawn in that time, so that writing them all now cannot be told
+ * apart.  Returns whether they were written.
+ */
+extern int PPU_write_data(struct ppu *, const uint8_t *, const uint16_t, const uint32_t);
+
 #endif
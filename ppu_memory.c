@@ -15,144 +15,207 @@
  * =============================================================================
  */
 #include <stdlib.h>
+#include <string.h>
 
 #include "ppu_memory.h"
 
 #define PALETTE_RAM_ADDR 0x3F00
 #define PALETTE_RAM_SIZE 32
 #define NAME_TABLE_0_ADDR 0x2000
-#define ALL_TABLE_MIRROR_ADDR 0x3000
+#define NAME_TABLE_SIZE 0x0400
+#define CIRAM_SIZE 0x0800
+#define CHR_SIZE 0x2000
+#define CHR_BANK_SIZE 0x0400
+#define NUM_CHR_BANKS (CHR_SIZE / CHR_BANK_SIZE)
+#define TILES_PER_BANK (CHR_BANK_SIZE / 16)
 
+/*
+ * Only the memory that exists is stored.  Pattern table and name table
+ * addresses are decoded through pointer tables, so that each write is one
+ * store and changing the mirroring only swaps pointers.
+ */
 struct ppu_memory {
-	uint8_t memory[PPU_MEM_SIZE];
+	uint8_t ciram[CIRAM_SIZE];		// 2 kB of name tables on the console
+	uint8_t palette[PALETTE_RAM_SIZE];
+	uint8_t chr_ram[CHR_SIZE];		// CHR data on the cartridge
+	uint8_t *chr[NUM_CHR_BANKS];		// 1 kB banks for 0x0000 - 0x1FFF
+	uint8_t *chr_write[NUM_CHR_BANKS];	// NULL for CHR ROM
+	uint8_t *nametables[4];			// 0x2000, 0x2400, 0x2800, 0x2C00
 	uint8_t mirror_type; // 0 = horizontal mirroring, 1 = vertical mirroring
+
+	// Tiles with one byte per pixel, as is and flipped left to right.  CHR
+	// ROM is decoded once when it is loaded, so each bank points into
+	// rom_tiles at its offset.  Anything else, like CHR RAM, is decoded
+	// into ram_tiles a tile at a time when first used after it changes.
+	const uint8_t *chr_rom;
+	uint32_t chr_rom_size;
+	uint8_t (*rom_tiles)[2][8][8];
+	uint8_t (*tiles[NUM_CHR_BANKS])[2][8][8];
+	uint8_t ram_tiles[NUM_CHR_BANKS][TILES_PER_BANK][2][8][8];
+	uint8_t tile_valid[NUM_CHR_BANKS][TILES_PER_BANK];
 };
 
 struct ppu_memory *PPU_MEM_init()
 {
-	/* Allocate memory */
-	struct ppu_memory *ppu_mem = malloc(sizeof(struct ppu_memory));
-
-	/* clear the allocated memory */
-	uint8_t *mem_ptr = NULL;
-	for(mem_ptr = ppu_mem->memory; mem_ptr < ppu_mem->memory + PPU_MEM_SIZE; mem_ptr++)
-	{
-		*mem_ptr = 0;
+	int i;
+
+	/* Allocate and clear memory */
+	struct ppu_memory *ppu_mem = calloc(1, sizeof(struct ppu_memory));
+
+	for (i = 0; i < NUM_CHR_BANKS; i++) {
+		PPU_MEM_map_chr(ppu_mem, i, NULL);
 	}
+	PPU_MEM_set_mirroring(ppu_mem, PPU_MEM_MIRROR_HORIZONTAL);
 
 	return ppu_mem;
 }
 
 void PPU_MEM_delete(struct ppu_memory **ppu_mem)
 {
+	free((*ppu_mem)->rom_tiles);
 	free(*ppu_mem);
 	*ppu_mem = NULL;
 }
 
-void write_mirrored_palette(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+/*
+ * 0x3F10, 0x3F14, 0x3F18 and 0x3F1C are the same bytes as 0x3F00, 0x3F04,
+ * 0x3F08 and 0x3F0C.  The 32 bytes repeat up to 0x3FFF.
+ */
+static inline uint8_t palette_index(const uint16_t addr)
 {
-	/* These four addresses are mirrored within 0x3F00 - 0x3F1F */
-	if (addr == 0x3F00) {
-		write_mirrored_palette(ppu_mem, 0x3F10, val);
-	}
-	if (addr == 0x3F04) {
-		write_mirrored_palette(ppu_mem, 0x3F14, val);
-	}
-	if (addr == 0x3F08) {
-		write_mirrored_palette(ppu_mem, 0x3F18, val);
-	}
-	if (addr == 0x3F0C) {
-		write_mirrored_palette(ppu_mem, 0x3F1C, val);
-	}
+	uint8_t index = addr % PALETTE_RAM_SIZE;
 
-	/* All values are written 5 times, starting at 0x3F00, and
-	 * ending at 0x3FFF */
-	uint16_t base_addr = (addr % PALETTE_RAM_SIZE) + PALETTE_RAM_ADDR;
-	int i;
-	for(i = 0; i < 5; i++) {
-		uint16_t new_addr = base_addr + i * PALETTE_RAM_SIZE;
-		ppu_mem->memory[new_addr] = val;
-		//(void)printf("Writing %#x to %#x\n", val, new_addr);
+	if ((index & 0x13) == 0x10) {
+		index &= 0x0F;
 	}
+	return index;
+}
+
+/*
+ * Name tables repeat from 0x3000 to 0x3EFF.
+ */
+static inline uint8_t *nametable_byte(struct ppu_memory *ppu_mem, const uint16_t addr)
+{
+	return &ppu_mem->nametables[(addr >> 10) & 3][addr % NAME_TABLE_SIZE];
 }
 
-void write_with_mirror_nametables_to_0x3000(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+uint8_t PPU_MEM_read(struct ppu_memory *ppu_mem, const uint16_t addr)
 {
-	ppu_mem->memory[addr] = val;
+	uint16_t a = addr % PPU_MEM_SIZE;
 
-	if (addr < 0x2F00) {
-		ppu_mem->memory[addr + 0x1000] = val;
+	if (a >= PALETTE_RAM_ADDR) {
+		return ppu_mem->palette[palette_index(a)];
+	} else if (a >= NAME_TABLE_0_ADDR) {
+		return *nametable_byte(ppu_mem, a);
 	}
+	return ppu_mem->chr[a / CHR_BANK_SIZE][a % CHR_BANK_SIZE];
 }
 
-void write_with_horizontal_mirroring(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+void PPU_MEM_write(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
 {
-	write_with_mirror_nametables_to_0x3000(ppu_mem, addr, val);
-
-	if (addr < 0x2800) {
-		if (addr < 0x2400) {
-			write_with_mirror_nametables_to_0x3000(ppu_mem, addr + 0x0400, val);
-		} else {
-			write_with_mirror_nametables_to_0x3000(ppu_mem, addr - 0x0400, val);
-		}
-	} else {
-		if (addr < 0x2C00) {
-			write_with_mirror_nametables_to_0x3000(ppu_mem, addr + 0x0400, val);
-		} else {
-			write_with_mirror_nametables_to_0x3000(ppu_mem, addr - 0x0400, val);
-		}
+	uint16_t a = addr % PPU_MEM_SIZE;
+
+	if (a >= PALETTE_RAM_ADDR) {
+		ppu_mem->palette[palette_index(a)] = val;
+	} else if (a >= NAME_TABLE_0_ADDR) {
+		*nametable_byte(ppu_mem, a) = val;
+	} else if (ppu_mem->chr_write[a / CHR_BANK_SIZE] != NULL) {
+		ppu_mem->chr_write[a / CHR_BANK_SIZE][a % CHR_BANK_SIZE] = val;
+		ppu_mem->tile_valid[a / CHR_BANK_SIZE][(a % CHR_BANK_SIZE) / 16] = 0;
 	}
 }
 
-void write_with_vertical_mirroring(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+static void decode_tile(const uint8_t *pattern, uint8_t (*rows)[8][8])
 {
-	write_with_mirror_nametables_to_0x3000(ppu_mem, addr, val);
+	int row, x;
 
-	if (addr < 0x2800) {
-		write_with_mirror_nametables_to_0x3000(ppu_mem, addr + 0x0800, val);
-	} else {
-		write_with_mirror_nametables_to_0x3000(ppu_mem, addr - 0x0800, val);
+	for (row = 0; row < 8; row++) {
+		for (x = 0; x < 8; x++) {
+			uint8_t colour = ((pattern[row] >> (7 - x)) & 1) | (((pattern[row + 8] >> (7 - x)) & 1) << 1);
+			rows[0][row][x] = colour;
+			rows[1][row][7 - x] = colour;
+		}
 	}
 }
 
-void write_mirrored_nametables(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+const uint8_t *PPU_MEM_tile_row(struct ppu_memory *ppu_mem, const uint16_t addr, const int flip)
 {
-	if (ppu_mem->mirror_type == 0) {
-		write_with_horizontal_mirroring(ppu_mem, addr, val);
-	} else {
-		write_with_vertical_mirroring(ppu_mem, addr, val);
+	uint8_t bank = (addr / CHR_BANK_SIZE) % NUM_CHR_BANKS;
+	uint8_t tile = (addr % CHR_BANK_SIZE) / 16;
+
+	if (ppu_mem->tile_valid[bank][tile] == 0) {
+		decode_tile(&ppu_mem->chr[bank][tile * 16], ppu_mem->ram_tiles[bank][tile]);
+		ppu_mem->tile_valid[bank][tile] = 1;
 	}
+	return ppu_mem->tiles[bank][tile][flip != 0][addr & 0x07];
 }
 
-void PPU_MEM_write(struct ppu_memory *ppu_mem, const uint16_t addr, const uint8_t val)
+void PPU_MEM_load_chr_rom(struct ppu_memory *ppu_mem, const uint8_t *data, const uint32_t size)
 {
-	if (addr >= PALETTE_RAM_ADDR) {
-		write_mirrored_palette(ppu_mem, addr, val);
-	} else if ((addr >= NAME_TABLE_0_ADDR) && (addr < ALL_TABLE_MIRROR_ADDR)) {
-		write_mirrored_nametables(ppu_mem, addr, val);
-	} else if ((addr >= ALL_TABLE_MIRROR_ADDR) && (addr < PALETTE_RAM_ADDR)) {
-		// This causes an extra write!
-		write_mirrored_nametables(ppu_mem, addr - 0x1000, val);
-	} else {
-		ppu_mem->memory[addr] = val;
+	uint32_t tile;
+
+	free(ppu_mem->rom_tiles);
+	ppu_mem->rom_tiles = malloc((size / 16) * sizeof(*ppu_mem->rom_tiles));
+	ppu_mem->chr_rom = data;
+	ppu_mem->chr_rom_size = size;
+	for (tile = 0; tile < size / 16; tile++) {
+		decode_tile(&data[tile * 16], ppu_mem->rom_tiles[tile]);
 	}
 }
 
-void PPU_MEM_load_vrom(struct ppu_memory *ppu_mem, FILE *nes_file)
+void PPU_MEM_map_chr(struct ppu_memory *ppu_mem, const uint8_t bank, const uint8_t *data)
 {
-	uint8_t data;
-	uint32_t mem_addr = 0;
+	uint8_t index = bank % NUM_CHR_BANKS;
 
-	while ((fread(&data, sizeof(uint8_t), 1, nes_file) != 0) && (mem_addr < 0x2000)) {
-		ppu_mem->memory[mem_addr] = data;
-		if(mem_addr % 1024 == 0) {
-			(void)printf("Loading data %#x into VROM %#x\n", data, mem_addr);
-		}
-		mem_addr++;
+	if (data != NULL) {
+		// ROM, which may be a read only file mapping
+		ppu_mem->chr[index] = (uint8_t *)data;
+		ppu_mem->chr_write[index] = NULL;
+	} else {
+		ppu_mem->chr[index] = &ppu_mem->chr_ram[index * CHR_BANK_SIZE];
+		ppu_mem->chr_write[index] = ppu_mem->chr[index];
+	}
+
+	if (data != NULL && ppu_mem->rom_tiles != NULL && data >= ppu_mem->chr_rom &&
+			data + CHR_BANK_SIZE <= ppu_mem->chr_rom + ppu_mem->chr_rom_size) {
+		// Already decoded, so there is nothing to invalidate
+		ppu_mem->tiles[index] = &ppu_mem->rom_tiles[(data - ppu_mem->chr_rom) / 16];
+		memset(ppu_mem->tile_valid[index], 1, TILES_PER_BANK);
+	} else {
+		ppu_mem->tiles[index] = ppu_mem->ram_tiles[index];
+		memset(ppu_mem->tile_valid[index], 0, TILES_PER_BANK);
 	}
 }
 
 void PPU_MEM_set_mirroring(struct ppu_memory *ppu_mem, const uint8_t mirror_type)
 {
+	uint8_t *low = ppu_mem->ciram;
+	uint8_t *high = ppu_mem->ciram + NAME_TABLE_SIZE;
+
 	ppu_mem->mirror_type = mirror_type;
+	switch (mirror_type) {
+		case PPU_MEM_MIRROR_HORIZONTAL:
+			// 0x2000 = 0x2400, 0x2800 = 0x2C00
+			ppu_mem->nametables[0] = low;
+			ppu_mem->nametables[1] = low;
+			ppu_mem->nametables[2] = high;
+			ppu_mem->nametables[3] = high;
+			break;
+		case PPU_MEM_MIRROR_SINGLE_LOW:
+		case PPU_MEM_MIRROR_SINGLE_HIGH:
+			if (mirror_type == PPU_MEM_MIRROR_SINGLE_HIGH) {
+				low = high;
+			}
+			ppu_mem->nametables[0] = low;
+			ppu_mem->nametables[1] = low;
+			ppu_mem->nametables[2] = low;
+			ppu_mem->nametables[3] = low;
+			break;
+		default:
+			// 0x2000 = 0x2800, 0x2400 = 0x2C00
+			ppu_mem->nametables[0] = low;
+			ppu_mem->nametables[1] = high;
+			ppu_mem->nametables[2] = low;
+			ppu_mem->nametables[3] = high;
+	}
 }
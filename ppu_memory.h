@@ -150,10 +150,39 @@ extern uint8_t PPU_MEM_read(struct ppu_memory *, const uint16_t);
 
 extern void PPU_MEM_write(struct ppu_memory *, const uint16_t, uint8_t);
 
-extern void PPU_MEM_load_vrom(struct ppu_memory *, FILE *);
+/*
+ * Point the given 1 kB bank of the pattern tables (0 for 0x0000 - 0x03FF, up
+ * to 7 for 0x1C00 - 0x1FFF) at CHR ROM on the cartridge.  Writes to it are
+ * ignored.  NULL maps the bank back to CHR RAM.  The data is not copied, so
+ * this is how mappers switch CHR banks.
+ */
+extern void PPU_MEM_map_chr(struct ppu_memory *, const uint8_t, const uint8_t *);
+
+/*
+ * Decode every tile of the cartridge's CHR ROM for PPU_MEM_tile_row, once,
+ * before its banks are mapped.  Banks later mapped from within it share
+ * these tiles, so switching them decodes nothing.  The data is not copied.
+ */
+extern void PPU_MEM_load_chr_rom(struct ppu_memory *, const uint8_t *, const uint32_t);
+
+/*
+ * Return the 8 pixels of a row of a pattern table tile, one byte each from 0
+ * to 3, left to right or, if flip is not 0, right to left.  The address is
+ * that of the row's low bit plane.  CHR ROM given to PPU_MEM_load_chr_rom is
+ * decoded when loaded.  Other tiles, i.e. CHR RAM, are decoded when first
+ * used and again after they are written, so drawing a row is a plain 8 byte
+ * copy.
+ */
+extern const uint8_t *PPU_MEM_tile_row(struct ppu_memory *, const uint16_t, const int);
+
+#define PPU_MEM_MIRROR_HORIZONTAL 0
+#define PPU_MEM_MIRROR_VERTICAL 1
+#define PPU_MEM_MIRROR_SINGLE_LOW 2
+#define PPU_MEM_MIRROR_SINGLE_HIGH 3
 
 /*
- * 0 = horizontal mirroring, 1 = vertical mirroring
+ * 0 = horizontal mirroring, 1 = vertical mirroring, 2 and 3 = one name table
+ * (the lower or upper 1 kB) for the whole screen
  */ 
 extern void PPU_MEM_set_mirroring(struct ppu_memory *, const uint8_t);
 
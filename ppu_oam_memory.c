@@ -3,7 +3,7 @@
  *
  *       Filename:  ppu_oam_memory.c
  *
- *    Description:  
+ *    Description:  Object attribute memory, and sprite evaluation
  *
  *        Version:  1.0
  *        Created:  14-03-23 12:03:24 AM
@@ -16,17 +16,183 @@
  * =====================================================================================
  */
 #include <stdlib.h>
+#include <string.h>
 
 #include "ppu_oam_memory.h"
 
-struct oam_data {
-	uint8_t y_pos;
-	uint8_t index;
-	uint8_t attribute;
-	uint8_t x_pos;
-};
+#define NUM_LINES 256
 
+/*
+ * Besides the sprites themselves, each line has a bit for each sprite in
+ * range of it, for sprites 8 and for 16 pixels tall.  The bits are moved when
+ * a Y position is written, so evaluating a line only looks at the sprites on
+ * it.
+ */
 struct ppu_oam_memory {
-	struct oam_data primary[64];
-	struct oam_data secondary[8];
+	struct oam_data primary[PPU_OAM_SPRITES];
+	struct oam_data secondary[PPU_OAM_LINE_SPRITES];
+	uint64_t lines[2][NUM_LINES];	// [0] 8 pixels tall, [1] 16
 };
+
+// OAM as 256 bytes.  struct oam_data is 4 bytes, with no padding.
+static inline uint8_t *oam_byte(struct ppu_oam_memory *oam, const uint8_t addr)
+{
+	return &((uint8_t *)oam->primary)[addr];
+}
+
+static inline int lowest_bit(const uint64_t bits)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(bits);
+#else
+	int n = 0;
+	while (((bits >> n) & 1) == 0) {
+		n++;
+	}
+	return n;
+#endif
+}
+
+// Add a sprite to, or take it off, the lines it is in range of
+static void bin_sprite(struct ppu_oam_memory *oam, const int sprite, const int add)
+{
+	unsigned int y = oam->primary[sprite].y_pos;
+	uint64_t bit = 1ULL << sprite;
+	unsigned int line;
+	int tall;
+
+	for (tall = 0; tall < 2; tall++) {
+		for (line = y; line < y + 8 * (tall + 1) && line < NUM_LINES; line++) {
+			if (add) {
+				oam->lines[tall][line] |= bit;
+			} else {
+				oam->lines[tall][line] &= ~bit;
+			}
+		}
+	}
+}
+
+struct ppu_oam_memory *PPU_OAM_init()
+{
+	struct ppu_oam_memory *oam = calloc(1, sizeof(struct ppu_oam_memory));
+	int i;
+
+	memset(oam->primary, 0xFF, sizeof(oam->primary));
+	memset(oam->secondary, 0xFF, sizeof(oam->secondary));
+	for (i = 0; i < PPU_OAM_SPRITES; i++) {
+		oam->primary[i].attribute &= 0xE3;
+		bin_sprite(oam, i, 1);
+	}
+	return oam;
+}
+
+void PPU_OAM_delete(struct ppu_oam_memory **oam)
+{
+	free(*oam);
+	*oam = NULL;
+}
+
+uint8_t PPU_OAM_read(const struct ppu_oam_memory *oam, const uint8_t addr)
+{
+	return ((const uint8_t *)oam->primary)[addr];
+}
+
+void PPU_OAM_write(struct ppu_oam_memory *oam, const uint8_t addr, const uint8_t val)
+{
+	switch (addr % 4) {
+		case 0:
+			bin_sprite(oam, addr / 4, 0);
+			*oam_byte(oam, addr) = val;
+			bin_sprite(oam, addr / 4, 1);
+			break;
+		case 2:
+			*oam_byte(oam, addr) = val & 0xE3;
+			break;
+		default:
+			*oam_byte(oam, addr) = val;
+	}
+}
+
+void PPU_OAM_write_page(struct ppu_oam_memory *oam, const uint8_t addr, const uint8_t *data)
+{
+	int i;
+
+	if (addr % 4 != 0) {
+		for (i = 0; i < PPU_OAM_SIZE; i++) {
+			PPU_OAM_write(oam, addr + i, data[i]);
+		}
+		return;
+	}
+
+	// Whole sprites, so copy them a sprite at a time, and only move the
+	// ones whose Y position changed
+	for (i = 0; i < PPU_OAM_SPRITES; i++) {
+		struct oam_data *sprite = &oam->primary[(addr / 4 + i) % PPU_OAM_SPRITES];
+		const uint8_t *src = &data[i * 4];
+
+		if (sprite->y_pos != src[0]) {
+			bin_sprite(oam, sprite - oam->primary, 0);
+			sprite->y_pos = src[0];
+			bin_sprite(oam, sprite - oam->primary, 1);
+		}
+		sprite->index = src[1];
+		sprite->attribute = src[2] & 0xE3;
+		sprite->x_pos = src[3];
+	}
+}
+
+unsigned int PPU_OAM_count(const struct ppu_oam_memory *oam, const unsigned int line, const unsigned int height)
+{
+	uint64_t in_range = oam->lines[height == 16][line % NUM_LINES];
+	unsigned int count = 0;
+
+	for (; in_range != 0; in_range &= in_range - 1) {
+		count++;
+	}
+	return count;
+}
+
+/*
+ * After finding 8 sprites, the PPU goes on through OAM for a 9th, but moves
+ * on a byte within each sprite as well as to the next sprite, so it reads
+ * tile numbers, attributes and X positions as if they were Y positions.
+ */
+static int overflows(struct ppu_oam_memory *oam, int sprite, const unsigned int line, const unsigned int height)
+{
+	unsigned int m = 0;
+
+	for (; sprite < PPU_OAM_SPRITES; sprite++) {
+		if (line - *oam_byte(oam, sprite * 4 + m) < height) {
+			return 1;
+		}
+		m = (m + 1) % 4;
+	}
+	return 0;
+}
+
+unsigned int PPU_OAM_evaluate(struct ppu_oam_memory *oam, const unsigned int line, const unsigned int height)
+{
+	uint64_t in_range = oam->lines[height == 16][line % NUM_LINES];
+	unsigned int result = 0;
+	unsigned int count = 0;
+	int sprite = 0;
+
+	if ((in_range & 1) != 0) {
+		result |= PPU_OAM_SPRITE_0;
+	}
+	for (; in_range != 0 && count < PPU_OAM_LINE_SPRITES; in_range &= in_range - 1) {
+		sprite = lowest_bit(in_range);
+		oam->secondary[count++] = oam->primary[sprite];
+	}
+	memset(&oam->secondary[count], 0xFF, (PPU_OAM_LINE_SPRITES - count) * sizeof(struct oam_data));
+
+	if (count == PPU_OAM_LINE_SPRITES && overflows(oam, sprite + 1, line, height)) {
+		result |= PPU_OAM_OVERFLOW;
+	}
+	return result | count;
+}
+
+const struct oam_data *PPU_OAM_secondary(const struct ppu_oam_memory *oam)
+{
+	return oam->secondary;
+}
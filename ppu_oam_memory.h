@@ -3,7 +3,8 @@
  *
  *       Filename:  ppu_oam_memory.h
  *
- *    Description:  
+ *    Description:  Object attribute memory, where the PPU keeps its 64
+ *                  sprites, and sprite evaluation
  *
  *        Version:  1.0
  *        Created:  14-03-23 12:02:09 AM
@@ -36,7 +37,73 @@
  * +-------- Flip sprite vertically
  *
  * Byte 3: X position of the left side of the sprite
+ *
+ * A sprite is drawn on the lines after the one its Y position names, i.e. a
+ * sprite at Y = 0 starts on line 1.  At the end of each visible line, the PPU
+ * evaluates the sprites: it copies the first 8 of them that are on the next
+ * line into secondary OAM, and draws those.
  */
+struct oam_data {
+	uint8_t y_pos;
+	uint8_t index;
+	uint8_t attribute;
+	uint8_t x_pos;
+};
+
 struct ppu_oam_memory;
 
+#define PPU_OAM_SIZE 256
+#define PPU_OAM_SPRITES 64
+#define PPU_OAM_LINE_SPRITES 8
+
+/*
+ * Flags returned by PPU_OAM_evaluate, with the number of sprites found in the
+ * low 4 bits.
+ */
+#define PPU_OAM_SPRITE_0 (1<<4)	// sprite 0 is the first sprite found
+#define PPU_OAM_OVERFLOW (1<<5)	// the sprite overflow flag is set
+
+/*
+ * Create OAM, with every sprite off the bottom of the screen.
+ */
+extern struct ppu_oam_memory *PPU_OAM_init();
+
+extern void PPU_OAM_delete(struct ppu_oam_memory **);
+
+/*
+ * Read and write the byte at the given address, 0 to 255.  Bits 2 to 4 of
+ * the attribute bytes do not exist, and read back as 0.
+ */
+extern uint8_t PPU_OAM_read(const struct ppu_oam_memory *, const uint8_t);
+
+extern void PPU_OAM_write(struct ppu_oam_memory *, const uint8_t, const uint8_t);
+
+/*
+ * Write all 256 bytes, starting at the given address and wrapping around, the
+ * same as 256 calls to PPU_OAM_write.  This is OAM DMA.
+ */
+extern void PPU_OAM_write_page(struct ppu_oam_memory *, const uint8_t, const uint8_t *);
+
+/*
+ * Return the number of sprites in range of the given line, i.e. to be drawn
+ * on the line after it, for sprites of the given height (8 or 16).  Sprites
+ * are binned by line as their Y positions are written, so this does not look
+ * at all 64 of them.
+ */
+extern unsigned int PPU_OAM_count(const struct ppu_oam_memory *, const unsigned int, const unsigned int);
+
+/*
+ * Evaluate the sprites for the given line and height, copying up to 8 that
+ * are in range into secondary OAM in order, and filling the rest of it with
+ * 0xFF.  Returns the number copied, with the flags above.  Once 8 are found,
+ * the rest are checked for overflow the way the PPU does, which looks at the
+ * wrong bytes of most of them.
+ */
+extern unsigned int PPU_OAM_evaluate(struct ppu_oam_memory *, const unsigned int, const unsigned int);
+
+/*
+ * Return the 8 sprites of secondary OAM.
+ */
+extern const struct oam_data *PPU_OAM_secondary(const struct ppu_oam_memory *);
+
 #endif
@@ -0,0 +1,156 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  render.c
+ *
+ *    Description:  Presentation of frames in an SDL window, handed over by
+ *                  the emulation thread
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:21:03 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+
+#include "render.h"
+#include "palette.h"
+#include "ppu.h"
+
+#define RING_SIZE 4	/* frames, a power of 2 */
+
+struct frame {
+	uint8_t pixels[PPU_SCREEN_HEIGHT * PPU_SCREEN_WIDTH];
+	uint8_t palette_ram[PALETTE_RAM_SIZE];
+	uint8_t masks[PPU_SCREEN_HEIGHT];
+};
+
+/*
+ * head and tail count the frames submitted and taken, and only the
+ * submitting and presenting threads change them, respectively.  The frame at
+ * head % RING_SIZE is only written while head - tail < RING_SIZE, and only
+ * read while tail < head, so the threads never use one at the same time.
+ */
+struct render {
+	struct frame frames[RING_SIZE];
+	atomic_uint head;
+	atomic_uint tail;
+	unsigned int presented;
+	unsigned int dropped;
+
+	// Only used by the thread that made them
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture;
+	SDL_sem *submitted;	/* posted for each frame, to wake RENDER_present */
+	struct palette *palette;
+	uint32_t pixels[PPU_SCREEN_HEIGHT * PPU_SCREEN_WIDTH];
+};
+
+struct render *RENDER_init(const char *title)
+{
+	struct render *render = calloc(1, sizeof(struct render));
+
+	atomic_init(&render->head, 0);
+	atomic_init(&render->tail, 0);
+	render->palette = PALETTE_init(PALETTE_ARGB8888);
+	render->submitted = SDL_CreateSemaphore(0);
+
+	render->window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+	if (render->window != NULL) {
+		render->renderer = SDL_CreateRenderer(render->window, -1, SDL_RENDERER_PRESENTVSYNC);
+	}
+	if (render->renderer != NULL) {
+		render->texture = SDL_CreateTexture(render->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, PPU_SCREEN_WIDTH, PPU_SCREEN_HEIGHT);
+	}
+	if (render->texture == NULL || render->submitted == NULL) {
+		(void)printf("Could not start rendering: %s\n", SDL_GetError());
+		RENDER_delete(&render);
+	}
+	return render;
+}
+
+void RENDER_delete(struct render **render)
+{
+	struct render *r = *render;
+
+	if (r->texture != NULL) {
+		SDL_DestroyTexture(r->texture);
+	}
+	if (r->renderer != NULL) {
+		SDL_DestroyRenderer(r->renderer);
+	}
+	if (r->window != NULL) {
+		SDL_DestroyWindow(r->window);
+	}
+	if (r->submitted != NULL) {
+		SDL_DestroySemaphore(r->submitted);
+	}
+	PALETTE_delete(&r->palette);
+	free(r);
+	*render = NULL;
+}
+
+int RENDER_submit(struct render *render, const uint8_t *framebuffer, const uint8_t *palette_ram, const uint8_t *masks)
+{
+	unsigned int head = atomic_load_explicit(&render->head, memory_order_relaxed);
+	struct frame *frame;
+
+	if (head - atomic_load_explicit(&render->tail, memory_order_acquire) == RING_SIZE) {
+		render->dropped++;
+		return 0;
+	}
+
+	frame = &render->frames[head % RING_SIZE];
+	memcpy(frame->pixels, framebuffer, sizeof(frame->pixels));
+	memcpy(frame->palette_ram, palette_ram, sizeof(frame->palette_ram));
+	memcpy(frame->masks, masks, sizeof(frame->masks));
+	atomic_store_explicit(&render->head, head + 1, memory_order_release);
+	SDL_SemPost(render->submitted);
+	return 1;
+}
+
+int RENDER_present(struct render *render, const unsigned int timeout)
+{
+	int pitch = PPU_SCREEN_WIDTH * sizeof(uint32_t);
+	unsigned int tail;
+	const struct frame *frame;
+
+	if (SDL_SemWaitTimeout(render->submitted, timeout) != 0) {
+		return 0;
+	}
+	tail = atomic_load_explicit(&render->tail, memory_order_relaxed);
+	if (tail == atomic_load_explicit(&render->head, memory_order_acquire)) {
+		return 0;
+	}
+
+	// Convert the frame, then hand its slot back before waiting on the
+	// driver
+	frame = &render->frames[tail % RING_SIZE];
+	PALETTE_convert(render->palette, frame->pixels, frame->palette_ram, frame->masks, render->pixels, pitch);
+	atomic_store_explicit(&render->tail, tail + 1, memory_order_release);
+
+	SDL_UpdateTexture(render->texture, NULL, render->pixels, pitch);
+	SDL_RenderCopy(render->renderer, render->texture, NULL, NULL);
+	SDL_RenderPresent(render->renderer);
+	render->presented++;
+	return 1;
+}
+
+unsigned int RENDER_frames_presented(const struct render *render)
+{
+	return render->presented;
+}
+
+unsigned int RENDER_frames_dropped(const struct render *render)
+{
+	return render->dropped;
+}
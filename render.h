@@ -0,0 +1,84 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  render.h
+ *
+ *    Description:  Public interface to the presentation of frames in an SDL
+ *                  window, handed over by the emulation thread.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:21:03 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+
+struct render;
+
+/*
+ * Presentation
+ * ============
+ *
+ * The emulation thread submits each finished frame, which is copied into a
+ * ring of a few frames.  The thread that called RENDER_init, normally the
+ * main thread, takes them with RENDER_present to convert to colours, upload
+ * to a streaming texture and show.  Neither thread locks the ring.  If
+ * presenting falls behind, the ring fills and new frames are dropped until it
+ * catches up.
+ *
+ * Every SDL video call, and SDL's event handling, is made from that one
+ * thread: macOS and Direct3D only allow them from the thread that made the
+ * window.  So emulation runs on a thread of its own, and waiting for vertical
+ * sync or the driver never holds it up.
+ *
+ * A frame carries only the PPU's framebuffer, the 32 bytes of palette RAM as
+ * they are at the end of the frame, and the PPUMASK of each line.  Palette RAM
+ * written during the frame shows with its end-of-frame colours everywhere.
+ *
+ * SDL's video must be initialised first.  With the dummy video driver
+ * (SDL_VIDEODRIVER=dummy), frames are rendered without a display.
+ */
+
+/*
+ * Create the window with the given title, and its renderer and texture.
+ * Returns NULL if SDL cannot create them.
+ */
+extern struct render *RENDER_init(const char *);
+
+/*
+ * Close the window.  Call it from the thread that called RENDER_init.
+ */
+extern void RENDER_delete(struct render **);
+
+/*
+ * Submit a frame, given as the PPU's framebuffer, the 32 bytes of palette
+ * RAM and the PPUMASK of each line.  Returns 0 if the ring is full and the
+ * frame was dropped.  Only ever call this from one thread, which may be a
+ * different one from RENDER_present's.
+ */
+extern int RENDER_submit(struct render *, const uint8_t *, const uint8_t *, const uint8_t *);
+
+/*
+ * Wait up to the given number of milliseconds for a submitted frame, then
+ * show it, waiting for vertical sync.  Returns 0 if no frame came.  Call it
+ * from the thread that called RENDER_init.
+ */
+extern int RENDER_present(struct render *, const unsigned int);
+
+/*
+ * Return the number of frames shown, and dropped, so far.  Each is only up to
+ * date on the thread that presents, or submits, frames.
+ */
+extern unsigned int RENDER_frames_presented(const struct render *);
+
+extern unsigned int RENDER_frames_dropped(const struct render *);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  scheduler.c
+ *
+ *    Description:  Master clock and timed event queue
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:05:40 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+
+/*
+ * There are only a few kinds of event, so the queue is a time per kind, and
+ * the earliest is found again whenever it changes.
+ */
+struct scheduler {
+	uint64_t now;
+	uint64_t times[SCHED_NUM_EVENTS];
+	int next;	// earliest event, or -1
+};
+
+static void find_next(struct scheduler *sched)
+{
+	int i;
+
+	sched->next = -1;
+	for (i = 0; i < SCHED_NUM_EVENTS; i++) {
+		if (sched->times[i] != SCHED_NEVER &&
+				(sched->next < 0 || sched->times[i] < sched->times[sched->next])) {
+			sched->next = i;
+		}
+	}
+}
+
+struct scheduler *SCHED_init()
+{
+	struct scheduler *sched = malloc(sizeof(struct scheduler));
+	int i;
+
+	sched->now = 0;
+	for (i = 0; i < SCHED_NUM_EVENTS; i++) {
+		sched->times[i] = SCHED_NEVER;
+	}
+	sched->next = -1;
+
+	return sched;
+}
+
+void SCHED_delete(struct scheduler **sched)
+{
+	free(*sched);
+	*sched = NULL;
+}
+
+uint64_t SCHED_now(const struct scheduler *sched)
+{
+	return sched->now;
+}
+
+void SCHED_advance(struct scheduler *sched, const uint64_t ticks)
+{
+	sched->now += ticks;
+}
+
+void SCHED_add(struct scheduler *sched, const int event, const uint64_t time)
+{
+#ifdef DEBUG_SCHED
+	(void)printf("Event %d at %llu\n", event, (unsigned long long)time);
+#endif
+	sched->times[event] = time;
+	find_next(sched);
+}
+
+void SCHED_remove(struct scheduler *sched, const int event)
+{
+	sched->times[event] = SCHED_NEVER;
+	find_next(sched);
+}
+
+uint64_t SCHED_next_time(const struct scheduler *sched)
+{
+	if (sched->next < 0) {
+		return SCHED_NEVER;
+	}
+	return sched->times[sched->next];
+}
+
+uint32_t SCHED_cpu_cycles_to_next(const struct scheduler *sched)
+{
+	uint64_t next = SCHED_next_time(sched);
+	uint64_t cycles;
+
+	if (next <= sched->now) {
+		return 1;
+	}
+	cycles = (next - sched->now + SCHED_TICKS_PER_CPU_CYCLE - 1) / SCHED_TICKS_PER_CPU_CYCLE;
+	return cycles > UINT32_MAX ? UINT32_MAX : cycles;
+}
+
+int SCHED_pop(struct scheduler *sched)
+{
+	int event = sched->next;
+
+	if (event < 0 || sched->times[event] > sched->now) {
+		return -1;
+	}
+	SCHED_remove(sched, event);
+	return event;
+}
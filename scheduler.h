@@ -0,0 +1,100 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  scheduler.h
+ *
+ *    Description:  Public interface to the master clock, and the queue of
+ *                  timed events that the CPU and PPU run up to.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:05:40 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =============================================================================
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+struct scheduler;
+
+/*
+ * Master Clock
+ * ============
+ *
+ * Time is counted in ticks of the NTSC master clock, 21.477272 MHz, from
+ * power on.  The CPU divides it by 12 and the PPU by 4, so there are exactly 3
+ * PPU dots per CPU cycle.  At 64 bits, the count never wraps.
+ *
+ * Events
+ * ======
+ *
+ * Each kind of event is pending at most once, at one time.  Components run
+ * straight to the next event, which is then handled and taken off the queue.
+ */
+#define SCHED_TICKS_PER_CPU_CYCLE 12
+#define SCHED_TICKS_PER_PPU_DOT 4
+#define SCHED_NEVER UINT64_MAX
+
+#define SCHED_NMI 0		// vertical blank starts
+#define SCHED_IRQ 1		// APU frame counter or DMC
+#define SCHED_DMA 2		// end of an OAM DMA stall
+#define SCHED_FRAME_END 3	// last dot of the pre-render line
+#define SCHED_MAPPER_IRQ 4	// e.g. the MMC3 scanline counter
+#define SCHED_PPU_STATUS 5	// PPUSTATUS changes, so idle loops polling it end
+#define SCHED_NUM_EVENTS 6
+
+/*
+ * Create a scheduler at time 0, with no events.
+ */
+extern struct scheduler *SCHED_init();
+
+/*
+ * Delete a scheduler.
+ */
+extern void SCHED_delete(struct scheduler **);
+
+/*
+ * Return the master clock.
+ */
+extern uint64_t SCHED_now(const struct scheduler *);
+
+/*
+ * Move the master clock forward by the given number of ticks.
+ */
+extern void SCHED_advance(struct scheduler *, const uint64_t);
+
+/*
+ * Queue an event for the given time, replacing any pending event of the
+ * same kind.
+ */
+extern void SCHED_add(struct scheduler *, const int, const uint64_t);
+
+/*
+ * Take an event off the queue, if it is pending.
+ */
+extern void SCHED_remove(struct scheduler *, const int);
+
+/*
+ * Return the time of the next event, or SCHED_NEVER.
+ */
+extern uint64_t SCHED_next_time(const struct scheduler *);
+
+/*
+ * Return the number of whole CPU cycles to run to reach the next event,
+ * at least 1.
+ */
+extern uint32_t SCHED_cpu_cycles_to_next(const struct scheduler *);
+
+/*
+ * Take the earliest event that is due by now off the queue, and return it.
+ * Returns -1 when nothing is due.
+ */
+extern int SCHED_pop(struct scheduler *);
+
+#endif
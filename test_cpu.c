@@ -21,6 +21,7 @@
 
 #include "cpu.c"
 #include "memory.h"
+#include "ppu_memory.h"
 
 #define mu_assert(message, test) do { if (!(test)) return message; } while (0)
 #define mu_run_test(test) do { char *message = test(); tests_run++; \
@@ -37,11 +38,11 @@ static char *test_cpu_init()
 	cpu = CPU_init(memory);
 
 	mu_assert("PC not init", cpu->PC == 0);
-	mu_assert("S not init", cpu->S == MEM_STACK_START);
+	mu_assert("S not init", cpu->S == MEM_STACK_START - 2);
 	mu_assert("A not init", cpu->A == 0);
 	mu_assert("X not init", cpu->X == 0);
 	mu_assert("Y not init", cpu->Y == 0);
-	mu_assert("P not init", cpu->P == 0);
+	mu_assert("P not init", CPU_get_status(cpu) == 0x24);
 
 	CPU_delete(&cpu);
 	return 0;
@@ -70,7 +71,7 @@ static char *test_push8_stack()
 
 	CPU_push8_stack(cpu, memory, 10);
 
-	mu_assert("push8_stack - S not moved", cpu->S == MEM_STACK_START - 1);
+	mu_assert("push8_stack - S not moved", cpu->S == MEM_STACK_START - 3);
 	mu_assert("push8_stack - not pushed", MEM_read(memory, cpu->S + 1) == 10);
 
 	CPU_delete(&cpu);
@@ -84,7 +85,7 @@ static char *test_push16_stack()
 
 	CPU_push16_stack(cpu, memory, 0x0EF4);
 
-	mu_assert("push16_stack - S not moved", cpu->S == MEM_STACK_START - 2);
+	mu_assert("push16_stack - S not moved", cpu->S == MEM_STACK_START - 4);
 	mu_assert("push16_stack - low not pushed", MEM_read(memory, cpu->S+1) == 0xF4);
 	mu_assert("push16_stack - high not pushed", MEM_read(memory, cpu->S+2) == 0x0E);
 
@@ -125,6 +126,556 @@ static char *test_pop16_mem()
 	return 0;
 }
 
+static char *test_decoded_instruction_is_cached()
+{
+	memory = MEM_init();
+
+	/* LDA #$11 at 0x0200 */
+	MEM_write(memory, 0x0200, 0xA9);
+	MEM_write(memory, 0x0201, 0x11);
+
+	cpu = CPU_init_to_address(memory, 0x0200);
+	CPU_step(cpu, memory);
+
+	mu_assert("cache - wrong result", cpu->A == 0x11);
+	mu_assert("cache - instruction not cached", cpu->code_cache[0x0200].valid == 1);
+	mu_assert("cache - wrong opcode", cpu->code_cache[0x0200].opcode == 0xA9);
+	mu_assert("cache - wrong operand", cpu->code_cache[0x0200].operand == 0x11);
+
+	CPU_delete(&cpu);
+	return 0;
+}
+
+static char *test_write_to_code_invalidates_cache()
+{
+	memory = MEM_init();
+
+	/* LDA #$11 at 0x0200 */
+	MEM_write(memory, 0x0200, 0xA9);
+	MEM_write(memory, 0x0201, 0x11);
+
+	cpu = CPU_init_to_address(memory, 0x0200);
+	CPU_step(cpu, memory);
+
+	/* Rewrite the operand and run it again */
+	MEM_write(memory, 0x0201, 0x22);
+	cpu->PC = 0x0200;
+	CPU_step(cpu, memory);
+
+	mu_assert("invalidate - stale operand", cpu->A == 0x22);
+
+	CPU_delete(&cpu);
+	return 0;
+}
+
+static char *test_write_to_mirror_invalidates_cache()
+{
+	memory = MEM_init();
+
+	/* LDA #$11 at 0x0200, run from its mirror at 0x0A00 */
+	MEM_write(memory, 0x0200, 0xA9);
+	MEM_write(memory, 0x0201, 0x11);
+
+	cpu = CPU_init_to_address(memory, 0x0A00);
+	CPU_step(cpu, memory);
+
+	MEM_write(memory, 0x1201, 0x33);
+	cpu->PC = 0x0A00;
+	CPU_step(cpu, memory);
+
+	mu_assert("invalidate mirror - stale operand", cpu->A == 0x33);
+
+	CPU_delete(&cpu);
+	return 0;
+}
+
+static uint32_t seen_cycles;
+
+static uint8_t read_run_cycles(void *data, const uint16_t addr)
+{
+	(void)data;
+	(void)addr;
+	seen_cycles = CPU_run_cycles(cpu);
+	return 0;
+}
+
+static char *test_run_cycles_seen_by_memory()
+{
+	memory = MEM_init();
+
+	/* NOP; NOP; LDA $7000; JMP $0200 */
+	MEM_write(memory, 0x0200, 0xEA);
+	MEM_write(memory, 0x0201, 0xEA);
+	MEM_write(memory, 0x0202, 0xAD);
+	MEM_write(memory, 0x0203, 0x00);
+	MEM_write(memory, 0x0204, 0x70);
+	MEM_write(memory, 0x0205, 0x4C);
+	MEM_write(memory, 0x0206, 0x00);
+	MEM_write(memory, 0x0207, 0x02);
+	MEM_set_page_handlers(memory, 0x70, read_run_cycles, NULL, NULL);
+	MEM_map_page(memory, 0x70, NULL, NULL);
+
+	cpu = CPU_init_to_address(memory, 0x0200);
+	seen_cycles = 99;
+	(void)CPU_run(cpu, memory, 8);
+	mu_assert("run cycles - wrong count at read", seen_cycles == 4);
+	mu_assert("run cycles - not 0 after run", CPU_run_cycles(cpu) == 0);
+
+	/* Second time round the loop */
+	(void)CPU_run(cpu, memory, 12);
+	mu_assert("run cycles - wrong count on next run", seen_cycles == 7);
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_write_to_PPUCTRL_ends_run()
+{
+	struct ppu *ppu = PPU_init();
+
+	memory = MEM_init();
+	MEM_attach_ppu(memory, ppu);
+
+	/* LDA #$80; STA $2000; JMP $0205 */
+	MEM_write(memory, 0x0200, 0xA9);
+	MEM_write(memory, 0x0201, 0x80);
+	MEM_write(memory, 0x0202, 0x8D);
+	MEM_write(memory, 0x0203, 0x00);
+	MEM_write(memory, 0x0204, 0x20);
+	MEM_write(memory, 0x0205, 0x4C);
+	MEM_write(memory, 0x0206, 0x05);
+	MEM_write(memory, 0x0207, 0x02);
+
+	cpu = CPU_init_to_address(memory, 0x0200);
+	mu_assert("PPUCTRL - run not ended", CPU_run(cpu, memory, 1000) == 6);
+	mu_assert("PPUCTRL - wrong PC", cpu->PC == 0x0205);
+	mu_assert("PPUCTRL - next run ended", CPU_run(cpu, memory, 1000) >= 1000);
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	PPU_delete(&ppu);
+	return 0;
+}
+
+/*
+ * Idle loops at 0x8000, waiting on $10 or PPUSTATUS, after their length in
+ * bytes.  Each runs forever while the value read is 0.
+ */
+static const uint8_t idle_loops[][8] = {
+	{4, 0xA5, 0x10, 0xF0, 0xFC},			// LDA $10; BEQ
+	{5, 0xAD, 0x02, 0x20, 0x10, 0xFB},		// LDA $2002; BPL
+	{5, 0x2C, 0x02, 0x20, 0x10, 0xFB},		// BIT $2002; BPL
+	{6, 0xA5, 0x10, 0x29, 0x80, 0xF0, 0xFA},	// LDA $10; AND #$80; BEQ
+	{3, 0x4C, 0x00, 0x80},				// JMP $8000
+	{2, 0xF0, 0xFE}					// BEQ to itself
+};
+
+/*
+ * Skipped idle loops must take exactly as many cycles as running them, and
+ * the run must end on the same instruction.  Runs are compared with stepping,
+ * which never skips.
+ */
+static char *test_idle_loops_skipped_exactly()
+{
+	struct memory *step_memory;
+	struct cpu *step_cpu;
+	unsigned int loop;
+	uint16_t end;
+	int i;
+
+	srand(1);
+	for (loop = 0; loop < sizeof(idle_loops) / sizeof(idle_loops[0]); loop++) {
+		memory = MEM_init();
+		step_memory = MEM_init();
+		end = 0x8000 + idle_loops[loop][0];
+		for (i = 0; i < idle_loops[loop][0]; i++) {
+			MEM_write(memory, 0x8000 + i, idle_loops[loop][i + 1]);
+			MEM_write(step_memory, 0x8000 + i, idle_loops[loop][i + 1]);
+		}
+		// JMP to itself after the loop
+		MEM_write(memory, end, 0x4C);
+		MEM_write(memory, end + 1, end & 0xFF);
+		MEM_write(memory, end + 2, end >> 8);
+		cpu = CPU_init_to_address(memory, 0x8000);
+		step_cpu = CPU_init_to_address(step_memory, 0x8000);
+		// Half of them with the recompiler, where it is available
+		(void)CPU_enable_jit(cpu, loop % 2);
+		// Z set, for the branch to itself
+		cpu->z_result = 0;
+		step_cpu->z_result = 0;
+
+		for (i = 0; i < 20; i++) {
+			uint32_t budget = rand() % 2000;
+			uint32_t cycles = CPU_run(cpu, memory, budget);
+			uint32_t step_cycles = 0;
+
+			while (step_cycles < budget) {
+				step_cycles += CPU_step(step_cpu, step_memory);
+			}
+			mu_assert("idle loop - cycles", cycles == step_cycles);
+			mu_assert("idle loop - PC", cpu->PC == step_cpu->PC);
+			mu_assert("idle loop - A", cpu->A == step_cpu->A);
+			mu_assert("idle loop - P", CPU_get_status(cpu) == CPU_get_status(step_cpu));
+		}
+
+		/* The loop ends when the value changes between runs */
+		MEM_write(memory, 0x0010, 0x80);
+		MEM_write(memory, 0x2002, 0x80);
+		cpu->z_result = 1;
+		(void)CPU_run(cpu, memory, 100);
+		mu_assert("idle loop - not left", cpu->PC == end || idle_loops[loop][1] == 0x4C);
+
+		/* A long run finishes quickly */
+		MEM_write(memory, 0x0010, 0x00);
+		MEM_write(memory, 0x2002, 0x00);
+		cpu->PC = 0x8000;
+		cpu->z_result = 0;
+		mu_assert("idle loop - long run", CPU_run(cpu, memory, 2000000000) - 2000000000 < 8);
+
+		CPU_delete(&cpu);
+		CPU_delete(&step_cpu);
+		MEM_delete(&memory);
+		MEM_delete(&step_memory);
+	}
+	return 0;
+}
+
+/*
+ * Copy loops at 0x8000, storing to PPUDATA from $0400 on, after their length
+ * in bytes.
+ */
+static const uint8_t copy_loops[][12] = {
+	{9, 0xBD, 0x00, 0x04, 0x8D, 0x07, 0x20, 0xE8, 0xD0, 0xF7},		// LDA $0400,X; STA $2007; INX; BNE
+	{11, 0xBD, 0x80, 0x04, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0xC0, 0xD0, 0xF5},	// LDA $0480,X; STA $2007; INX; CPX #$C0; BNE
+	{9, 0xB9, 0xF0, 0x03, 0x8D, 0x07, 0x20, 0xC8, 0xD0, 0xF7},		// LDA $03F0,Y; STA $2007; INY; BNE
+	{8, 0xB1, 0x10, 0x8D, 0x07, 0x20, 0xC8, 0xD0, 0xF8}			// LDA ($10),Y; STA $2007; INY; BNE
+};
+
+static void count_sync(void *data)
+{
+	(*(int *)data)++;
+}
+
+/*
+ * Copy loops written in one go must leave the CPU and PPU memory as running
+ * them does, after the same number of cycles.
+ */
+static char *test_copy_loops_match_stepping()
+{
+	struct memory *step_memory;
+	struct cpu *step_cpu;
+	struct ppu *ppu = PPU_init();
+	struct ppu *step_ppu = PPU_init();
+	struct ppu_memory *ppu_mem = PPU_MEM_init();
+	struct ppu_memory *step_ppu_mem = PPU_MEM_init();
+	unsigned int loop;
+	uint16_t end;
+	int syncs;
+	int step_syncs;
+	int i;
+
+	PPU_attach_memory(ppu, ppu_mem);
+	PPU_attach_memory(step_ppu, step_ppu_mem);
+	srand(2);
+	for (loop = 0; loop < sizeof(copy_loops) / sizeof(copy_loops[0]); loop++) {
+		memory = MEM_init();
+		step_memory = MEM_init();
+		MEM_attach_ppu(memory, ppu);
+		MEM_attach_ppu(step_memory, step_ppu);
+		syncs = 0;
+		step_syncs = 0;
+		MEM_set_ppu_sync(memory, count_sync, &syncs);
+		MEM_set_ppu_sync(step_memory, count_sync, &step_syncs);
+
+		end = 0x8000 + copy_loops[loop][0];
+		for (i = 0; i < copy_loops[loop][0]; i++) {
+			MEM_write(memory, 0x8000 + i, copy_loops[loop][i + 1]);
+			MEM_write(step_memory, 0x8000 + i, copy_loops[loop][i + 1]);
+		}
+		// JMP to itself after the loop
+		MEM_write(memory, end, 0x4C);
+		MEM_write(memory, end + 1, end & 0xFF);
+		MEM_write(memory, end + 2, end >> 8);
+		for (i = 0; i < 3; i++) {
+			MEM_write(step_memory, end + i, MEM_read(memory, end + i));
+		}
+		for (i = 0; i < 0x200; i++) {
+			MEM_write(memory, 0x0300 + i, rand());
+			MEM_write(step_memory, 0x0300 + i, MEM_read(memory, 0x0300 + i));
+		}
+		MEM_write(memory, 0x10, 0x50);
+		MEM_write(memory, 0x11, 0x04);
+		MEM_write(step_memory, 0x10, 0x50);
+		MEM_write(step_memory, 0x11, 0x04);
+
+		/* VRAM address $2000 + loop, rendering off */
+		MEM_write(memory, 0x2006, 0x20);
+		MEM_write(memory, 0x2006, loop);
+		MEM_write(step_memory, 0x2006, 0x20);
+		MEM_write(step_memory, 0x2006, loop);
+		syncs = 0;
+		step_syncs = 0;
+
+		cpu = CPU_init_to_address(memory, 0x8000);
+		step_cpu = CPU_init_to_address(step_memory, 0x8000);
+		(void)CPU_enable_jit(cpu, loop % 2);
+		cpu->X = step_cpu->X = rand() % 64;
+		cpu->Y = step_cpu->Y = rand() % 64;
+		cpu->c = step_cpu->c = 1;
+
+		for (i = 0; i < 20; i++) {
+			uint32_t budget = rand() % 1000;
+			uint32_t cycles = CPU_run(cpu, memory, budget);
+			uint32_t step_cycles = 0;
+
+			while (step_cycles < budget) {
+				step_cycles += CPU_step(step_cpu, step_memory);
+			}
+			mu_assert("copy loop - cycles", cycles == step_cycles);
+			mu_assert("copy loop - PC", cpu->PC == step_cpu->PC);
+			mu_assert("copy loop - A", cpu->A == step_cpu->A);
+			mu_assert("copy loop - X", cpu->X == step_cpu->X);
+			mu_assert("copy loop - Y", cpu->Y == step_cpu->Y);
+			mu_assert("copy loop - P", CPU_get_status(cpu) == CPU_get_status(step_cpu));
+		}
+		mu_assert("copy loop - not finished", cpu->PC == end);
+		for (i = 0x2000; i < 0x2200; i++) {
+			mu_assert("copy loop - VRAM", PPU_MEM_read(ppu_mem, i) == PPU_MEM_read(step_ppu_mem, i));
+		}
+		mu_assert("copy loop - stored a byte at a time", syncs * 4 < step_syncs);
+
+		CPU_delete(&cpu);
+		CPU_delete(&step_cpu);
+		MEM_delete(&memory);
+		MEM_delete(&step_memory);
+	}
+
+	PPU_delete(&ppu);
+	PPU_delete(&step_ppu);
+	PPU_MEM_delete(&ppu_mem);
+	PPU_MEM_delete(&step_ppu_mem);
+	return 0;
+}
+
+static char *test_status_flags()
+{
+	int p;
+
+	memory = MEM_init();
+	cpu = CPU_init(memory);
+
+	/* Every P survives being unpacked into the lazy flags and back */
+	for (p = 0; p < 0x100; p++) {
+		set_status(cpu, p);
+		mu_assert("status - P changed", CPU_get_status(cpu) == p);
+	}
+
+	/* ADC #$50 with A = $50 overflows into the sign bit */
+	MEM_write(memory, 0x0200, 0x69);
+	MEM_write(memory, 0x0201, 0x50);
+	set_status(cpu, 0x24);
+	cpu->A = 0x50;
+	cpu->PC = 0x0200;
+	CPU_step(cpu, memory);
+	mu_assert("status - ADC flags", CPU_get_status(cpu) == (0x24 | N_FLAG | V_FLAG));
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	return 0;
+}
+
+/*
+ * Opcodes for random programs, most of them supported by the recompiler.
+ * 0xA1 and 0xB1 are not, and make blocks fall back to the interpreter.
+ */
+static const uint8_t random_opcodes[] = {
+	0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, 0xA2, 0xA6, 0xB6, 0xAE, 0xBE,
+	0xA0, 0xA4, 0xB4, 0xAC, 0xBC, 0x85, 0x95, 0x8D, 0x9D, 0x99, 0x86,
+	0x96, 0x8E, 0x84, 0x94, 0x8C, 0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19,
+	0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39, 0x49, 0x45, 0x55, 0x4D, 0x5D,
+	0x59, 0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79, 0xE9, 0xE5, 0xF5, 0xED,
+	0xFD, 0xF9, 0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9, 0xE0, 0xE4, 0xEC,
+	0xC0, 0xC4, 0xCC, 0x24, 0x2C, 0xE6, 0xF6, 0xEE, 0xFE, 0xC6, 0xD6,
+	0xCE, 0xDE, 0x0A, 0x06, 0x16, 0x0E, 0x1E, 0x4A, 0x46, 0x56, 0x4E,
+	0x5E, 0x2A, 0x26, 0x36, 0x2E, 0x3E, 0x6A, 0x66, 0x76, 0x6E, 0x7E,
+	0xE8, 0xC8, 0xCA, 0x88, 0xAA, 0xA8, 0x8A, 0x98, 0x18, 0x38, 0xB8,
+	0xD8, 0xEA, 0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0, 0xA1,
+	0xB1
+};
+
+/* An address in RAM, its mirrors or save RAM, with room for an index */
+static uint16_t random_data_addr()
+{
+	if (rand() % 2) {
+		return rand() % 0x1F00;
+	}
+	return 0x6000 + rand() % 0x1F00;
+}
+
+/*
+ * Write a random program at 0x8000, ending with JMP $8000.  Branches skip
+ * forward over at most two instructions.
+ */
+static uint16_t write_random_program(struct memory *mem1, struct memory *mem2)
+{
+	uint8_t program[256];
+	uint16_t starts[80];
+	int count = 0;
+	int len = 0;
+	int i;
+
+	while (count < 64) {
+		uint8_t opcode = random_opcodes[rand() % sizeof(random_opcodes)];
+		uint16_t addr = random_data_addr();
+
+		starts[count++] = len;
+		program[len++] = opcode;
+		switch (op_length[opcode]) {
+		case 2:
+			program[len++] = rand();
+			break;
+		case 3:
+			program[len++] = addr & 0xFF;
+			program[len++] = addr>>8;
+			break;
+		}
+	}
+	starts[count] = len;
+	program[len++] = 0x4C;
+	program[len++] = 0x00;
+	program[len++] = 0x80;
+	starts[count + 1] = len;
+	starts[count + 2] = len;
+
+	/* Point branches at a later instruction */
+	for (i = 0; i < count; i++) {
+		if ((program[starts[i]] & 0x1F) == 0x10) {
+			uint16_t target = starts[i + 1 + rand() % 3];
+			program[starts[i] + 1] = target - starts[i + 1];
+		}
+	}
+
+	for (i = 0; i < len; i++) {
+		MEM_write(mem1, 0x8000 + i, program[i]);
+		MEM_write(mem2, 0x8000 + i, program[i]);
+	}
+	return len;
+}
+
+static char *test_handle_irq()
+{
+	uint8_t vectors[MEM_PAGE_SIZE] = {0};
+
+	memory = MEM_init();
+	cpu = CPU_init(memory);
+	vectors[0xFE] = 0x34;
+	vectors[0xFF] = 0x12;
+	MEM_map_page(memory, 0xFF, vectors, NULL);
+	cpu->PC = 0x8123;
+
+	/* Held off by the interrupt flag */
+	set_status(cpu, 0x24);
+	mu_assert("irq - taken while masked", CPU_handle_irq(cpu, memory) == 0);
+	mu_assert("irq - PC moved while masked", cpu->PC == 0x8123);
+
+	/* PC, then P without B, are pushed, and I is set */
+	set_status(cpu, 0x20 | C_FLAG);
+	mu_assert("irq - not taken", CPU_handle_irq(cpu, memory) == 1);
+	mu_assert("irq - wrong vector", cpu->PC == 0x1234);
+	mu_assert("irq - I not set", CPU_interrupt_flag_is_set(cpu) != 0);
+	mu_assert("irq - wrong P pushed", MEM_read(memory, cpu->S + 1) == (0x20 | C_FLAG));
+	mu_assert("irq - wrong PC pushed", MEM_read(memory, cpu->S + 2) == 0x23 &&
+			MEM_read(memory, cpu->S + 3) == 0x81);
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_jit_compiles_hot_code()
+{
+	memory = MEM_init();
+
+	/* 8000 INX; 8001 JMP $8000 */
+	MEM_write(memory, 0x8000, 0xE8);
+	MEM_write(memory, 0x8001, 0x4C);
+	MEM_write(memory, 0x8002, 0x00);
+	MEM_write(memory, 0x8003, 0x80);
+
+	cpu = CPU_init_to_address(memory, 0x8000);
+	if (CPU_enable_jit(cpu, 1) == 0) {
+		/* Not available on this host */
+		CPU_delete(&cpu);
+		MEM_delete(&memory);
+		return 0;
+	}
+
+	mu_assert("jit - wrong cycles", CPU_run(cpu, memory, 1000) == 1000);
+	mu_assert("jit - wrong X", cpu->X == (200 & 0xFF));
+	mu_assert("jit - not compiled", JIT_lookup(cpu->jit, memory, 0x8000, 1000) != NULL);
+	mu_assert("jit - block over budget", JIT_lookup(cpu->jit, memory, 0x8000, 4) == NULL);
+
+	/* Overwriting the code drops the block */
+	MEM_write(memory, 0x8000, 0xC8);
+	mu_assert("jit - stale block", JIT_lookup(cpu->jit, memory, 0x8000, 1000) == NULL);
+	(void)CPU_run(cpu, memory, 1000);
+	mu_assert("jit - stale code ran", cpu->Y == (200 & 0xFF));
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	return 0;
+}
+
+/*
+ * Random programs must run the same, cycle for cycle, with the recompiler
+ * on and off.
+ */
+static char *test_jit_matches_interpreter()
+{
+	int seed;
+
+	for (seed = 1; seed <= 50; seed++) {
+		struct memory *jit_memory = MEM_init();
+		struct cpu *jit_cpu;
+		int slice;
+		uint32_t addr;
+
+		memory = MEM_init();
+		srand(seed);
+		(void)write_random_program(memory, jit_memory);
+
+		cpu = CPU_init_to_address(memory, 0x8000);
+		jit_cpu = CPU_init_to_address(jit_memory, 0x8000);
+		if (CPU_enable_jit(jit_cpu, 1) == 0) {
+			CPU_delete(&cpu);
+			CPU_delete(&jit_cpu);
+			MEM_delete(&memory);
+			MEM_delete(&jit_memory);
+			return 0;
+		}
+
+		for (slice = 0; slice < 200; slice++) {
+			mu_assert("jit differential - cycles", CPU_run(cpu, memory, 114) == CPU_run(jit_cpu, jit_memory, 114));
+			mu_assert("jit differential - PC", cpu->PC == jit_cpu->PC);
+			mu_assert("jit differential - A", cpu->A == jit_cpu->A);
+			mu_assert("jit differential - X", cpu->X == jit_cpu->X);
+			mu_assert("jit differential - Y", cpu->Y == jit_cpu->Y);
+			mu_assert("jit differential - P", CPU_get_status(cpu) == CPU_get_status(jit_cpu));
+		}
+		for (addr = 0; addr < 0xFFFF; addr += (addr == 0x1FFF ? 0x4001 : 1)) {
+			mu_assert("jit differential - memory", MEM_read(memory, addr) == MEM_read(jit_memory, addr));
+		}
+
+		CPU_delete(&cpu);
+		CPU_delete(&jit_cpu);
+		MEM_delete(&memory);
+		MEM_delete(&jit_memory);
+	}
+
+	return 0;
+}
+
 static char *all_tests()
 {
 	mu_run_test(test_cpu_init);
@@ -133,6 +684,17 @@ static char *all_tests()
 	mu_run_test(test_push16_stack);
 	mu_run_test(test_pop8_mem);
 	mu_run_test(test_pop16_mem);
+	mu_run_test(test_decoded_instruction_is_cached);
+	mu_run_test(test_write_to_code_invalidates_cache);
+	mu_run_test(test_write_to_mirror_invalidates_cache);
+	mu_run_test(test_status_flags);
+	mu_run_test(test_handle_irq);
+	mu_run_test(test_run_cycles_seen_by_memory);
+	mu_run_test(test_write_to_PPUCTRL_ends_run);
+	mu_run_test(test_idle_loops_skipped_exactly);
+	mu_run_test(test_copy_loops_match_stepping);
+	mu_run_test(test_jit_compiles_hot_code);
+	mu_run_test(test_jit_matches_interpreter);
 	return 0;
 }
 
@@ -0,0 +1,125 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_loader.c
+ *
+ *    Description:  Tests for the file loader
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 07:12:55 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "loader.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+#define TEST_FILE "test_loader.nes"
+
+int tests_run = 0;
+
+struct memory *memory;
+struct ppu_memory *ppu_memory;
+struct cartridge *cart;
+
+/*
+ * Write an NROM file with a trainer, one 16 kB PRG bank and one CHR bank,
+ * leaving off the given number of bytes at the end.
+ */
+static void write_file(const long missing)
+{
+	FILE *file = fopen(TEST_FILE, "wb");
+	uint8_t header[16] = {'N', 'E', 'S', 0x1A, 1, 1, 0x05};
+	long size = TRAINER_SIZE + PRG_BANK_SIZE + CHR_BANK_SIZE - missing;
+	long i;
+
+	(void)fwrite(header, 1, sizeof(header), file);
+	for (i = 0; i < size; i++) {
+		// trainer bytes are 0x31, then each bank is numbered
+		uint8_t data = 0x31;
+		if (i >= TRAINER_SIZE) {
+			data = i < TRAINER_SIZE + PRG_BANK_SIZE ? 1 : 2;
+		}
+		(void)fputc(data, file);
+	}
+	(void)fclose(file);
+}
+
+static char *test_LOADER_load_file()
+{
+	memory = MEM_init();
+	ppu_memory = PPU_MEM_init();
+	write_file(0);
+
+	cart = LOADER_load_file(memory, ppu_memory, TEST_FILE);
+	mu_assert("cartridge is NULL!", cart != NULL);
+	mu_assert("trainer not loaded", MEM_read(memory, 0x7000) == 0x31);
+	mu_assert("PRG not mapped at 0x8000", MEM_read(memory, 0x8000) == 1);
+	mu_assert("PRG not mirrored at 0xC000", MEM_read(memory, 0xFFFF) == 1);
+	mu_assert("CHR not mapped", PPU_MEM_read(ppu_memory, 0x1FFF) == 2);
+
+	/* Header bit 0 is vertical mirroring */
+	PPU_MEM_write(ppu_memory, 0x2000, 123);
+	mu_assert("not vertical mirroring", PPU_MEM_read(ppu_memory, 0x2800) == 123);
+
+	/* The file is read only */
+	MEM_write(memory, 0x8000, 0x55);
+	PPU_MEM_write(ppu_memory, 0x0000, 0x55);
+	mu_assert("PRG written", MEM_read(memory, 0x8000) == 1);
+	mu_assert("CHR written", PPU_MEM_read(ppu_memory, 0x0000) == 2);
+
+	LOADER_delete(&cart);
+	mu_assert("cartridge is not NULL!", cart == NULL);
+	(void)remove(TEST_FILE);
+	PPU_MEM_delete(&ppu_memory);
+	MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_LOADER_short_file()
+{
+	memory = MEM_init();
+	ppu_memory = PPU_MEM_init();
+	write_file(1);
+
+	cart = LOADER_load_file(memory, ppu_memory, TEST_FILE);
+	mu_assert("short file loaded", cart == NULL);
+	cart = LOADER_load_file(memory, ppu_memory, "no_such_file.nes");
+	mu_assert("missing file loaded", cart == NULL);
+
+	(void)remove(TEST_FILE);
+	PPU_MEM_delete(&ppu_memory);
+	MEM_delete(&memory);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_LOADER_load_file);
+	mu_run_test(test_LOADER_short_file);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
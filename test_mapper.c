@@ -0,0 +1,418 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_mapper.c
+ *
+ *    Description:  Tests for the cartridge mappers
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 05:30:04 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mapper.c"
+#include "cpu.h"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+#define PRG_16K 0x4000
+#define PRG_8K 0x2000
+#define CHR_1K 0x0400
+
+int tests_run = 0;
+
+struct memory *memory;
+struct ppu_memory *ppu_memory;
+struct mapper *mapper;
+
+/* 8 x 16 kB of PRG and 16 x 8 kB of CHR, each 1 kB tagged with its number */
+static uint8_t prg[8 * PRG_16K];
+static uint8_t chr[16 * 8 * CHR_1K];
+
+static void setup()
+{
+	uint32_t i;
+
+	for (i = 0; i < sizeof(prg); i++) {
+		prg[i] = i / PRG_8K;
+	}
+	for (i = 0; i < sizeof(chr); i++) {
+		chr[i] = i / CHR_1K;
+	}
+	memory = MEM_init();
+	ppu_memory = PPU_MEM_init();
+}
+
+static void teardown()
+{
+	MAPPER_delete(&mapper);
+	PPU_MEM_delete(&ppu_memory);
+	MEM_delete(&memory);
+}
+
+static char *test_MAPPER_init()
+{
+	setup();
+	mu_assert("NROM not supported", MAPPER_supported(0) == 1);
+	mu_assert("MMC3 not supported", MAPPER_supported(4) == 1);
+	mu_assert("Mapper 5 supported", MAPPER_supported(5) == 0);
+
+	mapper = MAPPER_init(5, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+	mu_assert("Unsupported mapper created", mapper == NULL);
+
+	mapper = MAPPER_init(0, memory, ppu_memory, prg, PRG_16K, chr, 8 * CHR_1K, 1);
+	mu_assert("mapper is NULL!", mapper != NULL);
+	teardown();
+	mu_assert("mapper is not NULL!", mapper == NULL);
+
+	return 0;
+}
+
+static char *test_NROM()
+{
+	setup();
+	mapper = MAPPER_init(0, memory, ppu_memory, prg, PRG_16K, chr, 8 * CHR_1K, 1);
+
+	/* 16 kB is mirrored at 0xC000 */
+	mu_assert("NROM - 0x8000", MEM_read(memory, 0x8000) == 0);
+	mu_assert("NROM - 0xA000", MEM_read(memory, 0xA000) == 1);
+	mu_assert("NROM - 0xC000", MEM_read(memory, 0xC000) == 0);
+	mu_assert("NROM - 0xFFFF", MEM_read(memory, 0xFFFF) == 1);
+	mu_assert("NROM - CHR", PPU_MEM_read(ppu_memory, 0x1C00) == 7);
+	PPU_MEM_write(ppu_memory, 0x1C00, 0x55);
+	mu_assert("NROM - CHR ROM written", PPU_MEM_read(ppu_memory, 0x1C00) == 7);
+
+	/* ROM can not be written */
+	MEM_write(memory, 0x8000, 0x55);
+	mu_assert("NROM - ROM written", MEM_read(memory, 0x8000) == 0);
+
+	/* Mirroring from the header */
+	PPU_MEM_write(ppu_memory, 0x2000, 123);
+	mu_assert("NROM - not vertical mirroring", PPU_MEM_read(ppu_memory, 0x2800) == 123);
+
+	teardown();
+	return 0;
+}
+
+static char *test_UxROM()
+{
+	setup();
+	mapper = MAPPER_init(2, memory, ppu_memory, prg, sizeof(prg), NULL, 0, 0);
+
+	mu_assert("UxROM - power on 0x8000", MEM_read(memory, 0x8000) == 0);
+	mu_assert("UxROM - last bank at 0xC000", MEM_read(memory, 0xC000) == 14);
+	mu_assert("UxROM - last bank at 0xE000", MEM_read(memory, 0xE000) == 15);
+
+	MEM_write(memory, 0x8000, 3);
+	mu_assert("UxROM - switched 0x8000", MEM_read(memory, 0x8000) == 6);
+	mu_assert("UxROM - switched 0xA000", MEM_read(memory, 0xBFFF) == 7);
+	mu_assert("UxROM - 0xC000 moved", MEM_read(memory, 0xC000) == 14);
+
+	/* CHR RAM is left alone */
+	PPU_MEM_write(ppu_memory, 0x0010, 0x42);
+	mu_assert("UxROM - CHR RAM", PPU_MEM_read(ppu_memory, 0x0010) == 0x42);
+
+	teardown();
+	return 0;
+}
+
+static char *test_CNROM()
+{
+	setup();
+	mapper = MAPPER_init(3, memory, ppu_memory, prg, 2 * PRG_16K, chr, 4 * 8 * CHR_1K, 0);
+
+	mu_assert("CNROM - power on CHR", PPU_MEM_read(ppu_memory, 0x0000) == 0);
+	MEM_write(memory, 0xFFFF, 2);
+	mu_assert("CNROM - switched 0x0000", PPU_MEM_read(ppu_memory, 0x0000) == 16);
+	mu_assert("CNROM - switched 0x1FFF", PPU_MEM_read(ppu_memory, 0x1FFF) == 23);
+	mu_assert("CNROM - PRG moved", MEM_read(memory, 0x8000) == 0);
+
+	teardown();
+	return 0;
+}
+
+/* Load an MMC1 register, one bit per write */
+static void mmc1_load(const uint16_t addr, uint8_t val)
+{
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		MEM_write(memory, addr, val & 1);
+		val >>= 1;
+	}
+}
+
+static char *test_MMC1()
+{
+	setup();
+	mapper = MAPPER_init(1, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+
+	/* Power on: last bank fixed at 0xC000 */
+	mu_assert("MMC1 - power on 0xC000", MEM_read(memory, 0xC000) == 14);
+
+	mmc1_load(0xE000, 5);
+	mu_assert("MMC1 - PRG 0x8000", MEM_read(memory, 0x8000) == 10);
+	mu_assert("MMC1 - PRG 0xC000", MEM_read(memory, 0xE000) == 15);
+
+	/* 32 kB mode, vertical mirroring, 4 kB CHR banks */
+	mmc1_load(0x8000, 0x12);
+	mu_assert("MMC1 - 32 kB 0x8000", MEM_read(memory, 0x8000) == 8);
+	mu_assert("MMC1 - 32 kB 0xC000", MEM_read(memory, 0xC000) == 10);
+	PPU_MEM_write(ppu_memory, 0x2400, 99);
+	mu_assert("MMC1 - vertical mirroring", PPU_MEM_read(ppu_memory, 0x2C00) == 99);
+
+	mmc1_load(0xA000, 3);
+	mmc1_load(0xC000, 6);
+	mu_assert("MMC1 - CHR 0x0000", PPU_MEM_read(ppu_memory, 0x0000) == 12);
+	mu_assert("MMC1 - CHR 0x1000", PPU_MEM_read(ppu_memory, 0x1000) == 24);
+
+	/* A reset part way through a load */
+	MEM_write(memory, 0x8000, 1);
+	MEM_write(memory, 0x8000, 0x80);
+	mmc1_load(0xE000, 1);
+	mu_assert("MMC1 - reset", MEM_read(memory, 0x8000) == 2);
+
+	teardown();
+	return 0;
+}
+
+static char *test_MMC3()
+{
+	setup();
+	mapper = MAPPER_init(4, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+
+	mu_assert("MMC3 - second last bank", MEM_read(memory, 0xC000) == 14);
+	mu_assert("MMC3 - last bank", MEM_read(memory, 0xE000) == 15);
+
+	/* R6 and R7 */
+	MEM_write(memory, 0x8000, 6);
+	MEM_write(memory, 0x8001, 3);
+	MEM_write(memory, 0x8000, 7);
+	MEM_write(memory, 0x8001, 9);
+	mu_assert("MMC3 - R6", MEM_read(memory, 0x8000) == 3);
+	mu_assert("MMC3 - R7", MEM_read(memory, 0xA000) == 9);
+
+	/* PRG mode 1 swaps 0x8000 and 0xC000 */
+	MEM_write(memory, 0x8000, 0x40);
+	mu_assert("MMC3 - mode 1 0x8000", MEM_read(memory, 0x8000) == 14);
+	mu_assert("MMC3 - mode 1 0xC000", MEM_read(memory, 0xC000) == 3);
+
+	/* R0 is 2 kB, R2 is 1 kB, and bit 7 swaps the pattern tables */
+	MEM_write(memory, 0x8000, 0);
+	MEM_write(memory, 0x8001, 21);
+	MEM_write(memory, 0x8000, 2);
+	MEM_write(memory, 0x8001, 40);
+	mu_assert("MMC3 - R0 low", PPU_MEM_read(ppu_memory, 0x0000) == 20);
+	mu_assert("MMC3 - R0 high", PPU_MEM_read(ppu_memory, 0x0400) == 21);
+	mu_assert("MMC3 - R2", PPU_MEM_read(ppu_memory, 0x1000) == 40);
+	MEM_write(memory, 0x8000, 0x80);
+	mu_assert("MMC3 - inverted R0", PPU_MEM_read(ppu_memory, 0x1000) == 20);
+	mu_assert("MMC3 - inverted R2", PPU_MEM_read(ppu_memory, 0x0000) == 40);
+
+	/* Mirroring */
+	MEM_write(memory, 0xA000, 1);
+	PPU_MEM_write(ppu_memory, 0x2000, 77);
+	mu_assert("MMC3 - horizontal mirroring", PPU_MEM_read(ppu_memory, 0x2400) == 77);
+
+	teardown();
+	return 0;
+}
+
+/*
+ * Code decoded from a bank must not be run after it is switched out.
+ *
+ * 8000  LDA #bank+1
+ * 8002  STA bank
+ * 8004  JMP $8000
+ */
+static char *test_MMC3_irq()
+{
+	int i;
+
+	setup();
+	mapper = MAPPER_init(4, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+	mu_assert("MMC3 irq - disabled", MAPPER_lines_to_irq(mapper) == 0);
+
+	/* Latch 3, reload and enable: loaded on the 1st line, 0 on the 4th */
+	MEM_write(memory, 0xC000, 3);
+	MEM_write(memory, 0xC001, 0);
+	MEM_write(memory, 0xE001, 0);
+	mu_assert("MMC3 irq - lines after reload", MAPPER_lines_to_irq(mapper) == 4);
+	for (i = 0; i < 3; i++) {
+		MAPPER_clock_scanline(mapper);
+		mu_assert("MMC3 irq - early", MAPPER_irq(mapper) == 0);
+		mu_assert("MMC3 irq - lines", MAPPER_lines_to_irq(mapper) == (unsigned int)(3 - i));
+	}
+	MAPPER_clock_scanline(mapper);
+	mu_assert("MMC3 irq - not raised", MAPPER_irq(mapper) == 1);
+	mu_assert("MMC3 irq - pending", MAPPER_lines_to_irq(mapper) == 0);
+
+	/* Held until acknowledged by disabling, then reloaded from the latch */
+	MAPPER_clock_scanline(mapper);
+	mu_assert("MMC3 irq - dropped", MAPPER_irq(mapper) == 1);
+	MEM_write(memory, 0xE000, 0);
+	mu_assert("MMC3 irq - not acknowledged", MAPPER_irq(mapper) == 0);
+	MEM_write(memory, 0xE001, 0);
+	mu_assert("MMC3 irq - lines after acknowledge", MAPPER_lines_to_irq(mapper) == 3);
+
+	/* Other mappers have no counter */
+	teardown();
+	setup();
+	mapper = MAPPER_init(1, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+	MAPPER_clock_scanline(mapper);
+	mu_assert("MMC1 irq", MAPPER_irq(mapper) == 0 && MAPPER_lines_to_irq(mapper) == 0);
+
+	teardown();
+	return 0;
+}
+
+/*
+ * Switching CHR or mirroring part way through a frame first brings the PPU
+ * up to the switch, while it still sees the old bank
+ */
+static int syncs;
+static uint8_t chr_seen;
+
+static void sync_ppu(void *data)
+{
+	(void)data;
+	if (syncs++ == 0) {
+		chr_seen = PPU_MEM_read(ppu_memory, 0x0000);
+	}
+}
+
+static char *test_mid_frame_switch_catches_up_ppu()
+{
+	setup();
+	mapper = MAPPER_init(3, memory, ppu_memory, prg, PRG_16K * 2, chr, sizeof(chr), 0);
+	MEM_set_ppu_sync(memory, sync_ppu, NULL);
+	syncs = 0;
+
+	MEM_write(memory, 0x8000, 2);
+	mu_assert("mid-frame CHR - PPU not caught up", syncs > 0);
+	mu_assert("mid-frame CHR - caught up after the switch", chr_seen == 0);
+	mu_assert("mid-frame CHR - not switched", PPU_MEM_read(ppu_memory, 0x0000) == 16);
+
+	/* Rewriting the same bank changes nothing the PPU can see */
+	syncs = 0;
+	MEM_write(memory, 0x8000, 2);
+	mu_assert("mid-frame CHR - caught up for nothing", syncs == 0);
+	teardown();
+
+	/* MMC3 mirroring and IRQ registers */
+	setup();
+	mapper = MAPPER_init(4, memory, ppu_memory, prg, sizeof(prg), chr, sizeof(chr), 0);
+	MEM_set_ppu_sync(memory, sync_ppu, NULL);
+	syncs = 0;
+	MEM_write(memory, 0xA000, 1);
+	mu_assert("mid-frame mirroring - PPU not caught up", syncs == 1);
+	MEM_write(memory, 0xC001, 0);
+	mu_assert("mid-frame IRQ reload - PPU not caught up", syncs == 2);
+
+	teardown();
+	return 0;
+}
+
+static char *test_bank_switch_drops_decoded_code()
+{
+	struct cpu *cpu;
+	uint8_t i;
+
+	setup();
+	for (i = 0; i < 8; i++) {
+		uint8_t program[] = {0xA9, i + 1, 0x85, i, 0x4C, 0x00, 0x80};
+		memcpy(&prg[i * PRG_16K], program, sizeof(program));
+	}
+	mapper = MAPPER_init(2, memory, ppu_memory, prg, sizeof(prg), NULL, 0, 0);
+	cpu = CPU_init_to_address(memory, 0x8000);
+
+	for (i = 0; i < 3; i++) {
+		CPU_step(cpu, memory);
+	}
+	mu_assert("bank switch - bank 0 not run", MEM_read(memory, 0x0000) == 1);
+
+	MEM_write(memory, 0x8000, 5);
+	for (i = 0; i < 3; i++) {
+		CPU_step(cpu, memory);
+	}
+	mu_assert("bank switch - old bank run", MEM_read(memory, 0x0005) == 6);
+
+	CPU_delete(&cpu);
+	teardown();
+	return 0;
+}
+
+/*
+ * Compiled code reads the bank switched in, not the one it was compiled with.
+ * In the fixed bank:
+ * C000  LDA $8000
+ * C003  STA $00
+ * C005  JMP $C000
+ */
+static char *test_bank_switch_drops_compiled_reads()
+{
+	uint8_t program[] = {0xAD, 0x00, 0x80, 0x85, 0x00, 0x4C, 0x00, 0xC0};
+	struct cpu *cpu;
+
+	setup();
+	memcpy(&prg[7 * PRG_16K], program, sizeof(program));
+	mapper = MAPPER_init(2, memory, ppu_memory, prg, sizeof(prg), NULL, 0, 0);
+	cpu = CPU_init_to_address(memory, 0xC000);
+	if (CPU_enable_jit(cpu, 1) == 0) {
+		/* Not available on this host */
+		CPU_delete(&cpu);
+		teardown();
+		return 0;
+	}
+
+	(void)CPU_run(cpu, memory, 1000);
+	mu_assert("compiled reads - bank 0 not read", MEM_read(memory, 0x0000) == 0);
+
+	MEM_write(memory, 0x8000, 3);
+	(void)CPU_run(cpu, memory, 1000);
+	mu_assert("compiled reads - old bank read", MEM_read(memory, 0x0000) == 6);
+
+	CPU_delete(&cpu);
+	teardown();
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_MAPPER_init);
+	mu_run_test(test_NROM);
+	mu_run_test(test_UxROM);
+	mu_run_test(test_CNROM);
+	mu_run_test(test_MMC1);
+	mu_run_test(test_MMC3);
+	mu_run_test(test_MMC3_irq);
+	mu_run_test(test_mid_frame_switch_catches_up_ppu);
+	mu_run_test(test_bank_switch_drops_decoded_code);
+	mu_run_test(test_bank_switch_drops_compiled_reads);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
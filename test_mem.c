@@ -45,8 +45,8 @@ static char *test_MEM_write_non_mirrored()
 	MEM_write(memory, 0x6000, 123);
 	MEM_write(memory, 0x7FFF, 99);
 
-	mu_assert("Wrong value at 0x6000", memory->memory[0x6000] == 123);
-	mu_assert("Wrong value at 0x7FFF", memory->memory[0x7FFF] == 99);
+	mu_assert("Wrong value at 0x6000", memory->sram[0x0000] == 123);
+	mu_assert("Wrong value at 0x7FFF", memory->sram[0x1FFF] == 99);
 
 	MEM_delete(&memory);
 	return 0;
@@ -58,9 +58,14 @@ static char *test_MEM_write_mirrored()
 
 	MEM_write(memory, 0x0200, 123);
 
-	mu_assert("No mirrow at 0x0200 + 1*0x0800", memory->memory[0x0200 + 0x0800] == 123);
-	mu_assert("No mirrow at 0x0200 + 2*0x0800", memory->memory[0x0200 + 2*0x0800] == 123);
-	mu_assert("No mirrow at 0x0200 + 3*0x0800", memory->memory[0x0200 + 3*0x0800] == 123);
+	mu_assert("Wrong value at 0x0200", memory->ram[0x0200] == 123);
+	mu_assert("No mirrow at 0x0200 + 1*0x0800", MEM_read(memory, 0x0200 + 0x0800) == 123);
+	mu_assert("No mirrow at 0x0200 + 2*0x0800", MEM_read(memory, 0x0200 + 2*0x0800) == 123);
+	mu_assert("No mirrow at 0x0200 + 3*0x0800", MEM_read(memory, 0x0200 + 3*0x0800) == 123);
+
+	/* Writes through a mirror land in the same RAM */
+	MEM_write(memory, 0x1A00, 45);
+	mu_assert("Mirror write lost", MEM_read(memory, 0x0200) == 45);
 
 	MEM_delete(&memory);
 	return 0;
@@ -80,17 +85,17 @@ static char *test_VRAM_registers_are_mirrored()
 	MEM_write(memory, VRAM_REG_ADDR + 6, 2);
 	MEM_write(memory, VRAM_REG_ADDR + 7, 1);
 
-	/* Ensure writes are correct and are mapped another 1023 times */
+	/* Ensure writes are correct and are seen at the other 1023 mirrors */
 	int i;
 	for(i = 0; i < 1024; i++) {
-		mu_assert("0x2000 not mirrored!", memory->memory[VRAM_REG_ADDR + 0 + i * VRAM_REG_MIRROR_SIZE] == 8);
-		mu_assert("0x2001 not mirrored!", memory->memory[VRAM_REG_ADDR + 1 + i * VRAM_REG_MIRROR_SIZE] == 7);
-		mu_assert("0x2002 not mirrored!", memory->memory[VRAM_REG_ADDR + 2 + i * VRAM_REG_MIRROR_SIZE] == 6);
-		mu_assert("0x2003 not mirrored!", memory->memory[VRAM_REG_ADDR + 3 + i * VRAM_REG_MIRROR_SIZE] == 5);
-		mu_assert("0x2004 not mirrored!", memory->memory[VRAM_REG_ADDR + 4 + i * VRAM_REG_MIRROR_SIZE] == 4);
-		mu_assert("0x2005 not mirrored!", memory->memory[VRAM_REG_ADDR + 5 + i * VRAM_REG_MIRROR_SIZE] == 3);
-		mu_assert("0x2006 not mirrored!", memory->memory[VRAM_REG_ADDR + 6 + i * VRAM_REG_MIRROR_SIZE] == 2);
-		mu_assert("0x2007 not mirrored!", memory->memory[VRAM_REG_ADDR + 7 + i * VRAM_REG_MIRROR_SIZE] == 1);
+		mu_assert("0x2000 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 0 + i * VRAM_REG_MIRROR_SIZE) == 8);
+		mu_assert("0x2001 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 1 + i * VRAM_REG_MIRROR_SIZE) == 7);
+		mu_assert("0x2002 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 2 + i * VRAM_REG_MIRROR_SIZE) == 6);
+		mu_assert("0x2003 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 3 + i * VRAM_REG_MIRROR_SIZE) == 5);
+		mu_assert("0x2004 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 4 + i * VRAM_REG_MIRROR_SIZE) == 4);
+		mu_assert("0x2005 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 5 + i * VRAM_REG_MIRROR_SIZE) == 3);
+		mu_assert("0x2006 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 6 + i * VRAM_REG_MIRROR_SIZE) == 2);
+		mu_assert("0x2007 not mirrored!", MEM_read(memory, VRAM_REG_ADDR + 7 + i * VRAM_REG_MIRROR_SIZE) == 1);
 	}
 
 	MEM_delete(&memory);
@@ -153,26 +158,203 @@ static char *test_MEM_load_trainer()
 {
 	memory = MEM_init();
 
-	// create a test file
+	// read the test file
 	FILE *trainer_data = fopen("trainer_data", "rb");
 	uint8_t test_data = 0x31;
+	uint8_t trainer[512];
 
-	MEM_load_trainer(memory, trainer_data);
+	mu_assert("trainer_data is too short", fread(trainer, 1, sizeof(trainer), trainer_data) == sizeof(trainer));
+	MEM_load_trainer(memory, trainer);
 
 	int i;
 	for(i = 0x7000; i < 0x7200; i++) {
-		mu_assert("MEM_load_trainer failed", memory->memory[i] == test_data);
+		mu_assert("MEM_load_trainer failed", MEM_read(memory, i) == test_data);
 	}
 
 	/* test just outside endpoints */
-	mu_assert("MEM_load_trainer passed low boundary", memory->memory[0x6FFF] != test_data);
-	mu_assert("MEM_load_trainer passed high boundary", memory->memory[0x7200] != test_data);
+	mu_assert("MEM_load_trainer passed low boundary", MEM_read(memory, 0x6FFF) != test_data);
+	mu_assert("MEM_load_trainer passed high boundary", MEM_read(memory, 0x7200) != test_data);
 
 	(void)fclose(trainer_data);
 	MEM_delete(&memory);
 	return 0;
 }
 
+static uint8_t hook_value;
+static uint16_t hook_addr;
+
+static uint8_t hook_read(void *data, const uint16_t addr)
+{
+	(void)data;
+	hook_addr = addr;
+	return hook_value;
+}
+
+static void hook_write(void *data, const uint16_t addr, const uint8_t val)
+{
+	*(uint8_t *)data = val;
+	hook_addr = addr;
+}
+
+static char *test_page_handlers()
+{
+	uint8_t written = 0;
+
+	memory = MEM_init();
+
+	/* Hook page 0x70 of save RAM */
+	MEM_set_page_handlers(memory, 0x70, hook_read, hook_write, &written);
+	MEM_map_page(memory, 0x70, NULL, NULL);
+
+	hook_value = 0x42;
+	mu_assert("page handler - read", MEM_read(memory, 0x7012) == 0x42);
+	mu_assert("page handler - read address", hook_addr == 0x7012);
+	MEM_write(memory, 0x70FF, 0x99);
+	mu_assert("page handler - write", written == 0x99);
+	mu_assert("page handler - write address", hook_addr == 0x70FF);
+	mu_assert("page handler - leaked into memory", memory->sram[0x10FF] == 0);
+
+	/* Neighbouring pages are untouched */
+	MEM_write(memory, 0x7100, 0x11);
+	mu_assert("page handler - neighbour", MEM_read(memory, 0x7100) == 0x11);
+
+	MEM_delete(&memory);
+	return 0;
+}
+
+static void count_sync(void *data)
+{
+	(*(int *)data)++;
+}
+
+static char *test_ppu_sync()
+{
+	struct ppu *ppu = PPU_init();
+	int syncs = 0;
+
+	memory = MEM_init();
+	MEM_set_ppu_sync(memory, count_sync, &syncs);
+
+	/* Not called while no PPU is attached */
+	MEM_write(memory, 0x2000, 0x80);
+	mu_assert("ppu sync - called without a PPU", syncs == 0);
+
+	MEM_attach_ppu(memory, ppu);
+	MEM_write(memory, 0x0010, 0x80);
+	(void)MEM_read(memory, 0x4016);
+	mu_assert("ppu sync - called for other memory", syncs == 0);
+	MEM_write(memory, 0x2000, 0x80);
+	(void)MEM_read(memory, 0x3FFA);
+	mu_assert("ppu sync - not called for registers", syncs == 2);
+
+	MEM_delete(&memory);
+	PPU_delete(&ppu);
+	return 0;
+}
+
+static char *test_oam_dma()
+{
+	struct ppu *ppu = PPU_init();
+	uint8_t bank[MEM_PAGE_SIZE];
+	int syncs = 0;
+	int dmas = 0;
+	int i;
+
+	memory = MEM_init();
+	MEM_attach_ppu(memory, ppu);
+	MEM_set_ppu_sync(memory, count_sync, &syncs);
+	MEM_set_oam_dma(memory, count_sync, &dmas);
+	for (i = 0; i < MEM_PAGE_SIZE; i++) {
+		MEM_write(memory, 0x0200 + i, i);
+		bank[i] = 0xFF - i;
+	}
+
+	/* From RAM, starting at OAMADDR */
+	MEM_write(memory, 0x2003, 4);
+	MEM_write(memory, 0x4014, 0x02);
+	mu_assert("oam dma - not reported", dmas == 1);
+	mu_assert("oam dma - PPU not caught up", syncs == 2);
+	MEM_write(memory, 0x2003, 4);
+	mu_assert("oam dma - first byte", MEM_read(memory, 0x2004) == 0);
+	MEM_write(memory, 0x2003, 3);
+	mu_assert("oam dma - last byte", MEM_read(memory, 0x2004) == 0xFF);
+	MEM_write(memory, 0x2003, 9);
+	mu_assert("oam dma - tile", MEM_read(memory, 0x2004) == 5);
+
+	/* From ROM */
+	MEM_map_page(memory, 0x80, bank, NULL);
+	MEM_write(memory, 0x2003, 0);
+	MEM_write(memory, 0x4014, 0x80);
+	mu_assert("oam dma - rom", MEM_read(memory, 0x2004) == 0xFF);
+	MEM_write(memory, 0x2003, 0x81);
+	mu_assert("oam dma - rom", MEM_read(memory, 0x2004) == 0x7E);
+
+	/* From a page with no host memory, through its handler */
+	MEM_write(memory, 0x4014, 0x50);
+	mu_assert("oam dma - unmapped", MEM_read(memory, 0x2004) == 0);
+	mu_assert("oam dma - not reported", dmas == 3);
+
+	MEM_delete(&memory);
+	PPU_delete(&ppu);
+	return 0;
+}
+
+static char *test_map_page()
+{
+	uint8_t bank[MEM_PAGE_SIZE];
+	int i;
+
+	memory = MEM_init();
+	for (i = 0; i < MEM_PAGE_SIZE; i++) {
+		bank[i] = i;
+	}
+
+	/* Read only, like a ROM bank */
+	MEM_map_page(memory, 0x80, bank, NULL);
+	MEM_set_page_handlers(memory, 0x80, NULL, hook_write, &bank[0]);
+
+	mu_assert("map page - read", MEM_read(memory, 0x80AB) == 0xAB);
+	mu_assert("map page - host pointer", MEM_host_pointer(memory, 0x8010, 0x10) == &bank[0x10]);
+	mu_assert("map page - not contiguous", MEM_host_pointer(memory, 0x80F0, 0x20) == NULL);
+	mu_assert("map page - handler page", MEM_host_pointer(memory, 0x2000, 1) == NULL);
+	MEM_write(memory, 0x8001, 0x77);
+	mu_assert("map page - write handler", bank[0] == 0x77 && bank[1] == 1);
+
+	MEM_delete(&memory);
+	return 0;
+}
+
+/*
+ * A page holding decoded code goes back to its own write handler when it is
+ * mapped to something that is not written directly
+ */
+static char *test_map_page_unwatches_code()
+{
+	uint8_t written = 0;
+	struct cpu *cpu;
+
+	memory = MEM_init();
+	cpu = CPU_init(memory);
+	MEM_set_page_handlers(memory, 0x60, NULL, hook_write, &written);
+	MEM_watch_code(memory, 0x6000);
+	MEM_write(memory, 0x6001, 0x55);
+	mu_assert("unwatch - watched write", memory->sram[1] == 0x55 && written == 0);
+
+	// Save RAM switched off
+	MEM_map_page(memory, 0x60, NULL, NULL);
+	MEM_write(memory, 0x6002, 0x66);
+	mu_assert("unwatch - write handler", written == 0x66 && memory->sram[2] == 0);
+
+	// and back on
+	MEM_map_page(memory, 0x60, memory->sram, memory->sram);
+	MEM_write(memory, 0x6003, 0x77);
+	mu_assert("unwatch - direct write", memory->sram[3] == 0x77 && written == 0x66);
+
+	CPU_delete(&cpu);
+	MEM_delete(&memory);
+	return 0;
+}
+
 static char *all_tests()
 {
 	mu_run_test(test_MEM_init);
@@ -185,6 +367,11 @@ static char *all_tests()
 	mu_run_test(test_write_to_PPU_DATA_increments_PPU_ADDR_by_32);
 	*/
 	mu_run_test(test_MEM_load_trainer);
+	mu_run_test(test_page_handlers);
+	mu_run_test(test_ppu_sync);
+	mu_run_test(test_oam_dma);
+	mu_run_test(test_map_page);
+	mu_run_test(test_map_page_unwatches_code);
 
 	return 0;
 }
@@ -0,0 +1,182 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_palette.c
+ *
+ *    Description:  Tests for the conversion of frames to host pixels
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:40:51 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "palette.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+int tests_run = 0;
+
+struct palette *palette;
+
+uint8_t framebuffer[PPU_SCREEN_HEIGHT][PPU_SCREEN_WIDTH];
+uint8_t palette_ram[PALETTE_RAM_SIZE];
+uint8_t masks[PPU_SCREEN_HEIGHT];
+uint8_t pixels[PPU_SCREEN_HEIGHT][PPU_SCREEN_WIDTH * 4];
+
+static char *test_PALETTE_init()
+{
+	palette = PALETTE_init(PALETTE_RGB565);
+	mu_assert("palette is NULL!", palette != NULL);
+	mu_assert("wrong pixel size", PALETTE_bytes_per_pixel(palette) == 2);
+	PALETTE_delete(&palette);
+	mu_assert("palette is not NULL!", palette == NULL);
+	mu_assert("unknown format", PALETTE_init(3) == NULL);
+
+	return 0;
+}
+
+static char *test_PALETTE_convert()
+{
+	uint32_t *argb = (uint32_t *)pixels[239];
+	uint16_t *rgb565 = (uint16_t *)pixels[239];
+
+	memset(framebuffer, 0, sizeof(framebuffer));
+	palette_ram[0] = 0x0F;
+	palette_ram[1] = 0x30;
+	palette_ram[0x11] = 0x16;
+	framebuffer[239][0] = 1;
+	framebuffer[239][1] = 0x11;
+
+	palette = PALETTE_init(PALETTE_ARGB8888);
+	memset(masks, 0x00, sizeof(masks));
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("argb8888 - white", argb[0] == 0xFFECEEEC);
+	mu_assert("argb8888 - red", argb[1] == 0xFF982220);
+	mu_assert("argb8888 - backdrop", argb[2] == 0xFF000000);
+
+	/* Gray keeps only the brightness, emphasis darkens the other colours */
+	memset(masks, 0x01, sizeof(masks));
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("argb8888 - gray", argb[1] == 0xFF989698);
+	memset(masks, 0x20, sizeof(masks));
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("argb8888 - red emphasis", argb[0] == (0xFF000000 | (236 << 16) | (darken(238) << 8) | darken(236)));
+
+	/* Each row uses its own PPUMASK */
+	framebuffer[238][1] = 0x11;
+	memset(masks, 0x00, sizeof(masks));
+	masks[239] = 0x01;
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("argb8888 - row not gray", argb[1] == 0xFF989698);
+	mu_assert("argb8888 - row before gray", ((uint32_t *)pixels[238])[1] == 0xFF982220);
+	PALETTE_delete(&palette);
+
+	palette = PALETTE_init(PALETTE_RGB565);
+	memset(masks, 0x00, sizeof(masks));
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("rgb565 - white", rgb565[0] == ((236 >> 3) << 11 | (238 >> 2) << 5 | (236 >> 3)));
+	PALETTE_delete(&palette);
+
+	palette = PALETTE_init(PALETTE_RGB24);
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]));
+	mu_assert("rgb24 - white", pixels[239][0] == 236 && pixels[239][1] == 238 && pixels[239][2] == 236);
+	mu_assert("rgb24 - backdrop", pixels[239][6] == 0 && pixels[239][7] == 0 && pixels[239][8] == 0);
+	PALETTE_delete(&palette);
+
+	return 0;
+}
+
+/*
+ * Rows converted on their own are the same as in a whole frame, whatever the
+ * PPUMASK of the rows before them
+ */
+static char *test_PALETTE_convert_rows()
+{
+	static uint8_t whole[PPU_SCREEN_HEIGHT][PPU_SCREEN_WIDTH * 4];
+	int i;
+
+	srand(1);
+	for (i = 0; i < PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT; i++) {
+		framebuffer[i / PPU_SCREEN_WIDTH][i % PPU_SCREEN_WIDTH] = rand() % PALETTE_RAM_SIZE;
+	}
+	for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+		palette_ram[i] = rand() % 64;
+	}
+	for (i = 0; i < PPU_SCREEN_HEIGHT; i++) {
+		masks[i] = i < 90 ? 0x41 : 0x1E | (rand() % 4 == 0 ? 0xE1 : 0);
+	}
+
+	palette = PALETTE_init(PALETTE_ARGB8888);
+	PALETTE_convert(palette, &framebuffer[0][0], palette_ram, masks, whole, sizeof(whole[0]));
+	memset(pixels, 0, sizeof(pixels));
+	PALETTE_convert_rows(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]), 0, 100);
+	PALETTE_convert_rows(palette, &framebuffer[0][0], palette_ram, masks, pixels, sizeof(pixels[0]), 100, 140);
+	mu_assert("rows differ", memcmp(pixels, whole, sizeof(pixels)) == 0);
+	PALETTE_delete(&palette);
+
+	return 0;
+}
+
+static char *test_PALETTE_ssse3_matches_scalar()
+{
+#ifdef __SSSE3__
+	static uint8_t scalar[PPU_SCREEN_WIDTH * 4];
+	static uint8_t ssse3[PPU_SCREEN_WIDTH * 4];
+	struct byte_tables tables;
+	uint32_t colours[PALETTE_RAM_SIZE];
+	int formats[] = {PALETTE_ARGB8888, PALETTE_RGB565};
+	int f, i;
+
+	srand(2);
+	for (f = 0; f < 2; f++) {
+		palette = PALETTE_init(formats[f]);
+		for (i = 0; i < PALETTE_RAM_SIZE; i++) {
+			palette_ram[i] = rand();
+		}
+		for (i = 0; i < PPU_SCREEN_WIDTH; i++) {
+			framebuffer[0][i] = rand() % PALETTE_RAM_SIZE;
+		}
+		frame_colours(palette, palette_ram, rand(), colours);
+		make_byte_tables(colours, &tables);
+		convert_row_scalar(formats[f], colours, framebuffer[0], scalar);
+		convert_row_ssse3(formats[f], &tables, framebuffer[0], ssse3);
+		mu_assert("ssse3 - pixels differ", memcmp(scalar, ssse3, sizeof(scalar)) == 0);
+		PALETTE_delete(&palette);
+	}
+#endif
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_PALETTE_init);
+	mu_run_test(test_PALETTE_convert);
+	mu_run_test(test_PALETTE_convert_rows);
+	mu_run_test(test_PALETTE_ssse3_matches_scalar);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -0,0 +1,531 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_ppu.c
+ *
+ *    Description:  Tests for the PPU
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:35:08 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ppu.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+#define DOTS_PER_LINE 341
+#define DOTS_PER_FRAME (262 * DOTS_PER_LINE)
+
+int tests_run = 0;
+
+struct ppu_memory *ppu_memory;
+
+static int same_state(const struct ppu *a, const struct ppu *b)
+{
+	return a->ctrl == b->ctrl && a->mask == b->mask &&
+		a->status == b->status && a->oam_addr == b->oam_addr &&
+		a->loopy_v == b->loopy_v && a->loopy_t == b->loopy_t &&
+		a->loopy_x == b->loopy_x && a->write_toggle == b->write_toggle &&
+		a->line == b->line && a->dot == b->dot && a->dots == b->dots &&
+		a->rendered_lines == b->rendered_lines &&
+		a->low_bg == b->low_bg && a->high_bg == b->high_bg &&
+		a->low_bg_attribute == b->low_bg_attribute &&
+		a->high_bg_attribute == b->high_bg_attribute &&
+		memcmp(a->framebuffer, b->framebuffer, sizeof(a->framebuffer)) == 0;
+}
+
+static char *test_PPU_run_vblank()
+{
+	struct ppu *ppu = PPU_init();
+
+	ppu_memory = PPU_MEM_init();
+	PPU_write_register(ppu, PPUCTRL_ADDR, 0x80);
+
+	/* Pre-render line and 241 lines, up to just before dot 1 of line 241 */
+	mu_assert("NMI too early", PPU_run(ppu, ppu_memory, 341 + 241 * 341 + 1) == 1);
+	mu_assert("VBLANK too early", (ppu->status & 0x80) == 0);
+	mu_assert("no NMI", PPU_run(ppu, ppu_memory, 1) == 0);
+	mu_assert("VBLANK not set", (ppu->status & 0x80) != 0);
+	mu_assert("wrong position", ppu->line == 241 && ppu->dot == 2);
+
+	/* To the end of the frame, and into the next */
+	mu_assert("NMI in vblank", PPU_run(ppu, ppu_memory, 20 * 341) == 1);
+	mu_assert("wrong line after vblank", ppu->line == 261 && ppu->dot == 2);
+	mu_assert("VBLANK not cleared", (ppu->status & 0x80) == 0);
+	mu_assert("wrong dot count", ppu->dots == DOTS_PER_FRAME + 2);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static char *test_PPU_next_nmi()
+{
+	struct ppu *ppu = PPU_init();
+	uint64_t nmi_dot;
+
+	ppu_memory = PPU_MEM_init();
+	mu_assert("NMI predicted while off", PPU_next_nmi(ppu) == PPU_NEVER);
+
+	/* Turned on part way into the frame */
+	(void)PPU_run(ppu, ppu_memory, 1000);
+	PPU_write_register(ppu, PPUCTRL_ADDR, 0x80);
+	nmi_dot = PPU_next_nmi(ppu);
+	mu_assert("NMI not predicted", nmi_dot == 341 + 241 * 341 + 1);
+	mu_assert("NMI early", PPU_run(ppu, ppu_memory, nmi_dot - 1000) == 1);
+	mu_assert("NMI not at prediction", PPU_run(ppu, ppu_memory, 1) == 0);
+	mu_assert("next NMI not a frame later", PPU_next_nmi(ppu) == nmi_dot + DOTS_PER_FRAME);
+
+	/* Turned on after line 241, dot 1, so in the next frame */
+	PPU_write_register(ppu, PPUCTRL_ADDR, 0x00);
+	mu_assert("NMI predicted after turning off", PPU_next_nmi(ppu) == PPU_NEVER);
+	(void)PPU_run(ppu, ppu_memory, 10);
+	PPU_write_register(ppu, PPUCTRL_ADDR, 0x80);
+	mu_assert("NMI not predicted next frame", PPU_next_nmi(ppu) == nmi_dot + DOTS_PER_FRAME);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static char *test_PPU_draws_background()
+{
+	struct ppu *ppu = PPU_init();
+	const uint8_t *pixels;
+	int i;
+
+	ppu_memory = PPU_MEM_init();
+
+	/* Tile 1 is colour 1 on the left half and colour 2 on the right */
+	for (i = 0; i < 8; i++) {
+		PPU_MEM_write(ppu_memory, 0x0010 + i, 0xF0);
+		PPU_MEM_write(ppu_memory, 0x0018 + i, 0x0F);
+	}
+	for (i = 0; i < 0x3C0; i++) {
+		PPU_MEM_write(ppu_memory, 0x2000 + i, 1);
+	}
+	/* Palette 3 for the top left 2x2 tiles */
+	PPU_MEM_write(ppu_memory, 0x23C0, 0x03);
+
+	/* Background on, scrolled 2 pixels right */
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x0A);
+	PPU_write_register(ppu, PPUSCROLL_ADDR, 2);
+	PPU_write_register(ppu, PPUSCROLL_ADDR, 0);
+	(void)PPU_run(ppu, ppu_memory, PPU_DOTS_PER_FRAME);
+
+	pixels = PPU_framebuffer(ppu);
+	mu_assert("wrong pixel 0", pixels[0] == ((3 << 2) | 1));
+	mu_assert("wrong pixel 1", pixels[1] == ((3 << 2) | 1));
+	mu_assert("wrong pixel 2", pixels[2] == ((3 << 2) | 2));
+	mu_assert("wrong pixel 6", pixels[6] == ((3 << 2) | 1));
+	mu_assert("wrong palette for tile 2", pixels[14] == 1);
+	mu_assert("wrong palette on line 16", pixels[16 * PPU_SCREEN_WIDTH + 1] == 1);
+	mu_assert("wrong last tile", pixels[PPU_SCREEN_HEIGHT * PPU_SCREEN_WIDTH - 3] == 2);
+
+	/* Left 8 pixels hidden */
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x08);
+	(void)PPU_run(ppu, ppu_memory, PPU_DOTS_PER_FRAME);
+	mu_assert("left pixels not hidden", pixels[7] == 0 && pixels[8] == ((3 << 2) | 1));
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static void write_sprite(struct ppu *ppu, const uint8_t sprite, const uint8_t y, const uint8_t index, const uint8_t attribute, const uint8_t x)
+{
+	PPU_write_register(ppu, OAMADDR_ADDR, sprite * 4);
+	PPU_write_register(ppu, OAMDATA_ADDR, y);
+	PPU_write_register(ppu, OAMDATA_ADDR, index);
+	PPU_write_register(ppu, OAMDATA_ADDR, attribute);
+	PPU_write_register(ppu, OAMDATA_ADDR, x);
+}
+
+static char *test_PPU_draws_sprites()
+{
+	struct ppu *ppu = PPU_init();
+	const uint8_t *pixels = PPU_framebuffer(ppu);
+	const uint8_t *line;
+	int i;
+
+	ppu_memory = PPU_MEM_init();
+
+	/* Tile 1 is colour 1 on the left half and colour 2 on the right, and
+	 * is in the background at x = 80, y = 40 */
+	for (i = 0; i < 8; i++) {
+		PPU_MEM_write(ppu_memory, 0x0010 + i, 0xF0);
+		PPU_MEM_write(ppu_memory, 0x0018 + i, 0x0F);
+	}
+	PPU_MEM_write(ppu_memory, 0x2000 + 5 * 32 + 10, 1);
+
+	/* Sprite 0 over the right half of it, sprite 2 behind the left half,
+	 * and sprite 1 flipped at the right edge */
+	write_sprite(ppu, 0, 39, 1, 0x01, 84);
+	write_sprite(ppu, 1, 99, 1, 0x42, 250);
+	write_sprite(ppu, 2, 39, 1, 0x20, 80);
+	PPU_write_register(ppu, OAMADDR_ADDR, 6);
+	mu_assert("OAM not written", PPU_read_register(ppu, OAMDATA_ADDR) == 0x42);
+
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x1E);
+	(void)PPU_run(ppu, ppu_memory, PPU_DOTS_PER_FRAME);
+
+	line = pixels + 40 * PPU_SCREEN_WIDTH;
+	mu_assert("sprite above background", line[80] == 1);
+	mu_assert("sprite 0 not drawn", line[84] == (0x10 | (1 << 2) | 1));
+	mu_assert("sprite 0 right half not drawn", line[88] == (0x10 | (1 << 2) | 2));
+	mu_assert("sprite drawn too soon", pixels[39 * PPU_SCREEN_WIDTH + 88] == 0);
+	mu_assert("sprite drawn too long", pixels[48 * PPU_SCREEN_WIDTH + 88] == 0);
+	line = pixels + 100 * PPU_SCREEN_WIDTH;
+	mu_assert("sprite not flipped", line[250] == (0x10 | (2 << 2) | 2) && line[255] == (0x10 | (2 << 2) | 1));
+	mu_assert("no sprite 0 hit", (ppu->status & 0x40) != 0);
+	mu_assert("sprite overflow", (ppu->status & 0x20) == 0);
+
+	/* 9 sprites on a line overflow; without sprite 0, there is no hit */
+	for (i = 3; i < 12; i++) {
+		write_sprite(ppu, i, 150, 0, 0, i * 8);
+	}
+	write_sprite(ppu, 0, 0xF0, 1, 0, 84);
+	(void)PPU_run(ppu, ppu_memory, PPU_DOTS_PER_FRAME);
+	mu_assert("sprite 0 hit", (ppu->status & 0x40) == 0);
+	mu_assert("no sprite overflow", (ppu->status & 0x20) != 0);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+/*
+ * Runs of random lengths must leave the PPU exactly as stepping it dot by dot
+ * does, with random register writes between runs.
+ */
+static char *test_PPU_run_matches_PPU_step()
+{
+	struct ppu *bulk = PPU_init();
+	struct ppu *stepped = PPU_init();
+	struct ppu *scanlines = PPU_init();
+	int run;
+
+	ppu_memory = PPU_MEM_init();
+	mu_assert("no scanline renderer", PPU_enable_scanline_renderer(scanlines, 1) == 1);
+	srand(1);
+	for (run = 0; run < 0x3F00; run++) {
+		PPU_MEM_write(ppu_memory, run, rand());
+	}
+	for (run = 0; run < 5000; run++) {
+		uint64_t dots;
+		uint64_t start;
+		uint64_t predicted;
+		uint8_t bulk_nmi;
+		uint8_t stepped_nmi = 1;
+		uint8_t status;
+		uint64_t status_change;
+		int status_is_stable;
+		uint64_t i;
+
+		if (rand() % 4 == 0) {
+			uint16_t addr = PPUCTRL_ADDR + rand() % 8;
+			uint8_t value = rand();
+			PPU_write_register(bulk, addr, value);
+			PPU_write_register(stepped, addr, value);
+			PPU_write_register(scanlines, addr, value);
+		}
+		if (rand() % 8 == 0) {
+			(void)PPU_read_register(bulk, PPUSTATUS_ADDR);
+			(void)PPU_read_register(stepped, PPUSTATUS_ADDR);
+			(void)PPU_read_register(scanlines, PPUSTATUS_ADDR);
+		}
+		if (rand() % 2 == 0) {
+			uint8_t addr = rand();
+			uint8_t value = rand();
+			write_sprite(bulk, addr / 4, value, addr, value, addr * 3);
+			write_sprite(stepped, addr / 4, value, addr, value, addr * 3);
+			write_sprite(scanlines, addr / 4, value, addr, value, addr * 3);
+		}
+
+		switch (rand() % 4) {
+			case 0:
+				dots = rand() % 8;
+				break;
+			case 1:
+				dots = rand() % 341;
+				break;
+			case 2:
+				dots = rand() % (20 * 341);
+				break;
+			default:
+				dots = rand() % (2 * DOTS_PER_FRAME);
+		}
+
+		start = bulk->dots;
+		predicted = PPU_next_nmi(bulk);
+		status = bulk->status;
+		status_change = PPU_next_status_change(bulk);
+		status_is_stable = PPU_status_is_stable(bulk);
+		bulk_nmi = PPU_run(bulk, ppu_memory, dots);
+		for (i = 0; i < dots; i++) {
+			stepped_nmi &= PPU_step(stepped, ppu_memory);
+		}
+		mu_assert("run - NMI differs", bulk_nmi == stepped_nmi);
+		mu_assert("run - state differs", same_state(bulk, stepped));
+		mu_assert("run - NMI prediction differs", PPU_next_nmi(bulk) == PPU_next_nmi(stepped));
+		mu_assert("run - NMI not as predicted", (bulk_nmi == 0) == (predicted >= start && predicted < start + dots));
+		mu_assert("run - PPUSTATUS changed early", status_is_stable == 0 || start + dots > status_change || bulk->status == status);
+
+		/* Lines drawn in one pass match those drawn a tile at a time */
+		mu_assert("scanlines - NMI differs", PPU_run(scanlines, ppu_memory, dots) == stepped_nmi);
+		mu_assert("scanlines - state differs", same_state(scanlines, stepped));
+	}
+
+	PPU_delete(&bulk);
+	PPU_delete(&stepped);
+	PPU_delete(&scanlines);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+/*
+ * Lines 0-239 and the pre-render line are counted while rendering is on, and
+ * the count reaches each prediction on the predicted dot
+ */
+static char *test_rendered_lines()
+{
+	struct ppu *ppu = PPU_init();
+	int run;
+
+	ppu_memory = PPU_MEM_init();
+	mu_assert("rendered lines - predicted while off", PPU_rendered_line_dot(ppu, 1) == PPU_NEVER);
+	PPU_run(ppu, ppu_memory, DOTS_PER_FRAME);
+	mu_assert("rendered lines - counted while off", PPU_rendered_lines(ppu) == 0);
+
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x08);
+	PPU_run(ppu, ppu_memory, DOTS_PER_FRAME);
+	mu_assert("rendered lines - frame", PPU_rendered_lines(ppu) == 241);
+
+	srand(2);
+	for (run = 0; run < 1000; run++) {
+		unsigned int lines = 1 + rand() % 300;
+		uint32_t start;
+		uint64_t dot;
+
+		PPU_run(ppu, ppu_memory, rand() % DOTS_PER_FRAME);
+		start = PPU_rendered_lines(ppu);
+		dot = PPU_rendered_line_dot(ppu, lines);
+		PPU_catch_up(ppu, ppu_memory, dot);
+		mu_assert("rendered lines - early", PPU_rendered_lines(ppu) - start == lines - 1);
+		PPU_run(ppu, ppu_memory, 1);
+		mu_assert("rendered lines - late", PPU_rendered_lines(ppu) - start == lines);
+	}
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static char *test_PPU_compose()
+{
+	struct ppu *ppu = PPU_init();
+	uint8_t *line = ppu->framebuffer[0];
+
+	ppu->line = 0;
+	/* Opaque and clear background, under sprites in front and behind */
+	line[0] = 0x01; line[1] = 0x00; line[2] = 0x02; line[3] = 0x04;
+	ppu->sprite_pixels[0] = 0x11;
+	ppu->sprite_pixels[1] = 0x12 | SPRITE_BEHIND;
+	ppu->sprite_pixels[2] = 0x13 | SPRITE_BEHIND;
+	ppu->sprite_pixels[3] = 0x14;
+	ppu->sprite_pixels[255] = 0x11 | SPRITE_0;
+	line[255] = 0x01;
+	ppu->sprite_count = 1;
+
+	/* Hidden in the leftmost 8 pixels, then shown */
+	ppu->mask = 0x10;
+	compose(ppu, 0, 8);
+	mu_assert("compose - sprites not hidden", line[0] == 0x01 && line[1] == 0x00);
+	ppu->mask = 0x14;
+	compose(ppu, 0, PPU_SCREEN_WIDTH);
+	mu_assert("compose - sprite in front", line[0] == 0x11);
+	mu_assert("compose - sprite behind clear background", line[1] == 0x12);
+	mu_assert("compose - sprite behind background", line[2] == 0x02);
+	mu_assert("compose - clear sprite", line[3] == 0x04);
+	mu_assert("compose - sprite 0 hit at x = 255", (ppu->status & 0x40) == 0);
+
+	line[254] = 0x03;
+	ppu->sprite_pixels[254] = 0x13 | SPRITE_0 | SPRITE_BEHIND;
+	compose(ppu, 248, 8);
+	mu_assert("compose - no sprite 0 hit", (ppu->status & 0x40) != 0);
+
+	PPU_delete(&ppu);
+	return 0;
+}
+
+/*
+ * Random lines of background and sprites, from random x, composed by each
+ * SIMD loop built and by the scalar loop
+ */
+static char *test_PPU_compose_simd_matches_scalar()
+{
+#ifdef __SSE2__
+	uint8_t background[PPU_SCREEN_WIDTH];
+	uint8_t sprites[PPU_SCREEN_WIDTH];
+	uint8_t scalar[PPU_SCREEN_WIDTH];
+	uint8_t simd[PPU_SCREEN_WIDTH];
+	int run;
+	int i;
+
+	srand(2);
+	for (run = 0; run < 10000; run++) {
+		unsigned int x = rand() % PPU_SCREEN_WIDTH;
+		unsigned int count = rand() % (PPU_SCREEN_WIDTH - x + 1);
+		int hit;
+
+		for (i = 0; i < PPU_SCREEN_WIDTH; i++) {
+			background[i] = rand() % 16;
+			// mostly no sprite, and sprite 0 only now and then
+			sprites[i] = rand() % 4 == 0 ? (0x10 | (rand() & 0x2F)) : 0;
+			if (rand() % 64 == 0) {
+				sprites[i] |= SPRITE_0;
+			}
+		}
+		memcpy(scalar, background, sizeof(background));
+		hit = compose_scalar(scalar + x, sprites + x, x, count);
+
+		memcpy(simd, background, sizeof(background));
+		mu_assert("compose - SSE2 sprite 0 hit differs", compose_sse2(simd + x, sprites + x, x, count) == hit);
+		mu_assert("compose - SSE2 pixels differ", memcmp(scalar, simd, sizeof(scalar)) == 0);
+#ifdef __AVX2__
+		memcpy(simd, background, sizeof(background));
+		mu_assert("compose - AVX2 sprite 0 hit differs", compose_avx2(simd + x, sprites + x, x, count) == hit);
+		mu_assert("compose - AVX2 pixels differ", memcmp(scalar, simd, sizeof(scalar)) == 0);
+#endif
+	}
+#endif
+	return 0;
+}
+
+/*
+ * The tile pipeline lays sprites over whole spans, but a sprite 0 hit in
+ * pixels drawn is seen by a PPUSTATUS read straight away, and each line keeps
+ * the PPUMASK it was finished with
+ */
+static char *test_PPU_compose_spans()
+{
+	struct ppu *ppu = PPU_init();
+
+	ppu_memory = PPU_MEM_init();
+	PPU_MEM_write(ppu_memory, 0x0000, 0xFF);
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x1E);
+	while (ppu->line != 0 || ppu->dot != 0) {
+		PPU_run(ppu, ppu_memory, 1);
+	}
+
+	/* Sprite 0 over an opaque background pixel at x = 9 of line 0 */
+	ppu->sprite_pixels[9] = 0x11 | SPRITE_0;
+	ppu->sprite_count = 1;
+	PPU_run(ppu, ppu_memory, 17);
+	mu_assert("spans - not composed yet", ppu->composed == 0 && ppu->drawn == 16);
+	mu_assert("spans - hit not seen", (PPU_read_register(ppu, 0x2002) & 0x40) != 0);
+	mu_assert("spans - not composed on read", ppu->composed == 16);
+
+	/* Each line is finished with the PPUMASK written before it */
+	PPU_write_register(ppu, PPUMASK_ADDR, 0x3E);
+	PPU_run(ppu, ppu_memory, DOTS_PER_LINE);
+	PPU_write_register(ppu, PPUMASK_ADDR, 0xDF);
+	PPU_run(ppu, ppu_memory, DOTS_PER_LINE);
+	mu_assert("spans - line 0 mask", PPU_line_masks(ppu)[0] == 0x3E);
+	mu_assert("spans - line 1 mask", PPU_line_masks(ppu)[1] == 0xDF);
+	mu_assert("spans - sprite not drawn", ppu->framebuffer[0][9] == 0x11);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static char *test_PPU_data()
+{
+	struct ppu *ppu = PPU_init();
+	struct ppu_memory *ppu_memory = PPU_MEM_init();
+	const uint8_t block[] = {0x31, 0x32, 0x33};
+
+	PPU_attach_memory(ppu, ppu_memory);
+
+	/* Writes go to loopy_v, which moves on by 1 or 32 */
+	PPU_write_register(ppu, 0x2006, 0x21);
+	PPU_write_register(ppu, 0x2006, 0x00);
+	PPU_write_register(ppu, 0x2007, 0x11);
+	PPU_write_register(ppu, 0x2007, 0x12);
+	PPU_write_register(ppu, 0x2000, 0x04);
+	PPU_write_register(ppu, 0x2007, 0x13);
+	mu_assert("data - not written", PPU_MEM_read(ppu_memory, 0x2100) == 0x11);
+	mu_assert("data - not incremented by 1", PPU_MEM_read(ppu_memory, 0x2101) == 0x12);
+	mu_assert("data - not incremented by 32", PPU_MEM_read(ppu_memory, 0x2102) == 0x13);
+	mu_assert("data - address", ppu->loopy_v == 0x2122);
+
+	/* Reads are a byte late, apart from the palette */
+	PPU_write_register(ppu, 0x2000, 0x00);
+	PPU_MEM_write(ppu_memory, 0x3F01, 0x2A);
+	PPU_MEM_write(ppu_memory, 0x2F01, 0x77);
+	PPU_write_register(ppu, 0x2006, 0x21);
+	PPU_write_register(ppu, 0x2006, 0x00);
+	(void)PPU_read_register(ppu, 0x2007);
+	mu_assert("data - read not buffered", PPU_read_register(ppu, 0x2007) == 0x11);
+	mu_assert("data - read not buffered", PPU_read_register(ppu, 0x2007) == 0x12);
+	PPU_write_register(ppu, 0x2006, 0x3F);
+	PPU_write_register(ppu, 0x2006, 0x01);
+	mu_assert("data - palette read buffered", PPU_read_register(ppu, 0x2007) == 0x2A);
+	mu_assert("data - buffer not from under the palette", ppu->read_buffer == 0x77);
+
+	/* Blocks only while nothing is drawn */
+	PPU_write_register(ppu, 0x2006, 0x22);
+	PPU_write_register(ppu, 0x2006, 0x00);
+	mu_assert("data - block refused", PPU_write_data(ppu, block, 3, 1000));
+	mu_assert("data - block not written", PPU_MEM_read(ppu_memory, 0x2202) == 0x33 && ppu->loopy_v == 0x2203);
+	PPU_write_register(ppu, 0x2001, 0x08);
+	mu_assert("data - block written while drawing", PPU_write_data(ppu, block, 3, 100) == 0);
+	(void)PPU_run(ppu, ppu_memory, 241 * PPU_DOTS_PER_LINE);
+	mu_assert("data - block refused in vblank", PPU_write_data(ppu, block, 3, 100));
+	mu_assert("data - block written past vblank", PPU_write_data(ppu, block, 3, 21 * PPU_DOTS_PER_LINE) == 0);
+
+	PPU_delete(&ppu);
+	PPU_MEM_delete(&ppu_memory);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_PPU_run_vblank);
+	mu_run_test(test_PPU_next_nmi);
+	mu_run_test(test_PPU_draws_background);
+	mu_run_test(test_PPU_draws_sprites);
+	mu_run_test(test_PPU_run_matches_PPU_step);
+	mu_run_test(test_rendered_lines);
+	mu_run_test(test_PPU_compose);
+	mu_run_test(test_PPU_compose_simd_matches_scalar);
+	mu_run_test(test_PPU_compose_spans);
+	mu_run_test(test_PPU_data);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -16,6 +16,7 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ppu_memory.c"
 
@@ -45,17 +46,17 @@ static char *test_PPU_MEM_write_mirrored_palette_0x3F00()
 	PPU_MEM_write(memory, 0x3F00, 123);
 	PPU_MEM_write(memory, 0x3F01, 234);
 
-	mu_assert("0x3F00 not set", memory->memory[0x3F00] == 123);
-	mu_assert("0x3F00 not mirrored", memory->memory[0x3F00 + 1 * 32] == 123);
-	mu_assert("0x3F00 not mirrored", memory->memory[0x3F00 + 2 * 32] == 123);
-	mu_assert("0x3F00 not mirrored", memory->memory[0x3F00 + 3 * 32] == 123);
-	mu_assert("0x3F00 not mirrored", memory->memory[0x3F00 + 4 * 32] == 123);
+	mu_assert("0x3F00 not set", PPU_MEM_read(memory, 0x3F00) == 123);
+	mu_assert("0x3F00 not mirrored", PPU_MEM_read(memory, 0x3F00 + 1 * 32) == 123);
+	mu_assert("0x3F00 not mirrored", PPU_MEM_read(memory, 0x3F00 + 2 * 32) == 123);
+	mu_assert("0x3F00 not mirrored", PPU_MEM_read(memory, 0x3F00 + 3 * 32) == 123);
+	mu_assert("0x3F00 not mirrored", PPU_MEM_read(memory, 0x3F00 + 4 * 32) == 123);
 
-	mu_assert("0x3F01 not set", memory->memory[0x3F01] == 234);
-	mu_assert("0x3F01 not mirrored", memory->memory[0x3F01 + 1 * 32] == 234);
-	mu_assert("0x3F01 not mirrored", memory->memory[0x3F01 + 2 * 32] == 234);
-	mu_assert("0x3F01 not mirrored", memory->memory[0x3F01 + 3 * 32] == 234);
-	mu_assert("0x3F01 not mirrored", memory->memory[0x3F01 + 4 * 32] == 234);
+	mu_assert("0x3F01 not set", PPU_MEM_read(memory, 0x3F01) == 234);
+	mu_assert("0x3F01 not mirrored", PPU_MEM_read(memory, 0x3F01 + 1 * 32) == 234);
+	mu_assert("0x3F01 not mirrored", PPU_MEM_read(memory, 0x3F01 + 2 * 32) == 234);
+	mu_assert("0x3F01 not mirrored", PPU_MEM_read(memory, 0x3F01 + 3 * 32) == 234);
+	mu_assert("0x3F01 not mirrored", PPU_MEM_read(memory, 0x3F01 + 4 * 32) == 234);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -67,11 +68,11 @@ static char *test_PPU_MEM_write_mirrored_palette_0x3F00_to_0x3F10()
 
 	PPU_MEM_write(memory, 0x3F00, 123);
 
-	mu_assert("0x3F10 not set", memory->memory[0x3F10 + 0 * 32] == 123);
-	mu_assert("0x3F10 not mirrored", memory->memory[0x3F10 + 1 * 32] == 123);
-	mu_assert("0x3F10 not mirrored", memory->memory[0x3F10 + 2 * 32] == 123);
-	mu_assert("0x3F10 not mirrored", memory->memory[0x3F10 + 3 * 32] == 123);
-	mu_assert("0x3F10 not mirrored", memory->memory[0x3F10 + 4 * 32] == 123);
+	mu_assert("0x3F10 not set", PPU_MEM_read(memory, 0x3F10 + 0 * 32) == 123);
+	mu_assert("0x3F10 not mirrored", PPU_MEM_read(memory, 0x3F10 + 1 * 32) == 123);
+	mu_assert("0x3F10 not mirrored", PPU_MEM_read(memory, 0x3F10 + 2 * 32) == 123);
+	mu_assert("0x3F10 not mirrored", PPU_MEM_read(memory, 0x3F10 + 3 * 32) == 123);
+	mu_assert("0x3F10 not mirrored", PPU_MEM_read(memory, 0x3F10 + 4 * 32) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -83,11 +84,11 @@ static char *test_PPU_MEM_write_mirrored_palette_0x3F04_to_0x3F14()
 
 	PPU_MEM_write(memory, 0x3F04, 123);
 
-	mu_assert("0x3F14 not set", memory->memory[0x3F14 + 0 * 32] == 123);
-	mu_assert("0x3F14 not mirrored", memory->memory[0x3F14 + 1 * 32] == 123);
-	mu_assert("0x3F14 not mirrored", memory->memory[0x3F14 + 2 * 32] == 123);
-	mu_assert("0x3F14 not mirrored", memory->memory[0x3F14 + 3 * 32] == 123);
-	mu_assert("0x3F14 not mirrored", memory->memory[0x3F14 + 4 * 32] == 123);
+	mu_assert("0x3F14 not set", PPU_MEM_read(memory, 0x3F14 + 0 * 32) == 123);
+	mu_assert("0x3F14 not mirrored", PPU_MEM_read(memory, 0x3F14 + 1 * 32) == 123);
+	mu_assert("0x3F14 not mirrored", PPU_MEM_read(memory, 0x3F14 + 2 * 32) == 123);
+	mu_assert("0x3F14 not mirrored", PPU_MEM_read(memory, 0x3F14 + 3 * 32) == 123);
+	mu_assert("0x3F14 not mirrored", PPU_MEM_read(memory, 0x3F14 + 4 * 32) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -99,11 +100,11 @@ static char *test_PPU_MEM_write_mirrored_palette_0x3F08_to_0x3F18()
 
 	PPU_MEM_write(memory, 0x3F08, 123);
 
-	mu_assert("0x3F18 not set", memory->memory[0x3F18 + 0 * 32] == 123);
-	mu_assert("0x3F18 not mirrored", memory->memory[0x3F18 + 1 * 32] == 123);
-	mu_assert("0x3F18 not mirrored", memory->memory[0x3F18 + 2 * 32] == 123);
-	mu_assert("0x3F18 not mirrored", memory->memory[0x3F18 + 3 * 32] == 123);
-	mu_assert("0x3F18 not mirrored", memory->memory[0x3F18 + 4 * 32] == 123);
+	mu_assert("0x3F18 not set", PPU_MEM_read(memory, 0x3F18 + 0 * 32) == 123);
+	mu_assert("0x3F18 not mirrored", PPU_MEM_read(memory, 0x3F18 + 1 * 32) == 123);
+	mu_assert("0x3F18 not mirrored", PPU_MEM_read(memory, 0x3F18 + 2 * 32) == 123);
+	mu_assert("0x3F18 not mirrored", PPU_MEM_read(memory, 0x3F18 + 3 * 32) == 123);
+	mu_assert("0x3F18 not mirrored", PPU_MEM_read(memory, 0x3F18 + 4 * 32) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -115,11 +116,11 @@ static char *test_PPU_MEM_write_mirrored_palette_0x3F0C_to_0x3F1C()
 
 	PPU_MEM_write(memory, 0x3F1C, 123);
 
-	mu_assert("0x3F1C not set", memory->memory[0x3F1C + 0 * 32] == 123);
-	mu_assert("0x3F1C not mirrored", memory->memory[0x3F1C + 1 * 32] == 123);
-	mu_assert("0x3F1C not mirrored", memory->memory[0x3F1C + 2 * 32] == 123);
-	mu_assert("0x3F1C not mirrored", memory->memory[0x3F1C + 3 * 32] == 123);
-	mu_assert("0x3F1C not mirrored", memory->memory[0x3F1C + 4 * 32] == 123);
+	mu_assert("0x3F1C not set", PPU_MEM_read(memory, 0x3F1C + 0 * 32) == 123);
+	mu_assert("0x3F1C not mirrored", PPU_MEM_read(memory, 0x3F1C + 1 * 32) == 123);
+	mu_assert("0x3F1C not mirrored", PPU_MEM_read(memory, 0x3F1C + 2 * 32) == 123);
+	mu_assert("0x3F1C not mirrored", PPU_MEM_read(memory, 0x3F1C + 3 * 32) == 123);
+	mu_assert("0x3F1C not mirrored", PPU_MEM_read(memory, 0x3F1C + 4 * 32) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -132,10 +133,10 @@ static char *test_PPU_MEM_nametable0_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2000, 123);
 
-	mu_assert("Nametable 0 not set", memory->memory[0x2000] == 123);
-	mu_assert("Nametable 0 not mirrored in nametable 1", memory->memory[0x2400] == 123);
-	mu_assert("Nametable 0 not mirrored at 0x3000", memory->memory[0x3000] == 123);
-	mu_assert("Nametable 0 not mirrored at 0x3400", memory->memory[0x3400] == 123);
+	mu_assert("Nametable 0 not set", PPU_MEM_read(memory, 0x2000) == 123);
+	mu_assert("Nametable 0 not mirrored in nametable 1", PPU_MEM_read(memory, 0x2400) == 123);
+	mu_assert("Nametable 0 not mirrored at 0x3000", PPU_MEM_read(memory, 0x3000) == 123);
+	mu_assert("Nametable 0 not mirrored at 0x3400", PPU_MEM_read(memory, 0x3400) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -148,10 +149,10 @@ static char *test_PPU_MEM_attributetable0_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x23C0, 123);
 
-	mu_assert("Attrib table 0 not set", memory->memory[0x23C0] == 123);
-	mu_assert("Attrib table 0 not mirrored in Attrib table 1", memory->memory[0x27C0] == 123);
-	mu_assert("Attrib table 0 not mirrored 0x33C0", memory->memory[0x33C0] == 123);
-	mu_assert("Attrib table 0 not mirrored 0x37C0", memory->memory[0x37C0] == 123);
+	mu_assert("Attrib table 0 not set", PPU_MEM_read(memory, 0x23C0) == 123);
+	mu_assert("Attrib table 0 not mirrored in Attrib table 1", PPU_MEM_read(memory, 0x27C0) == 123);
+	mu_assert("Attrib table 0 not mirrored 0x33C0", PPU_MEM_read(memory, 0x33C0) == 123);
+	mu_assert("Attrib table 0 not mirrored 0x37C0", PPU_MEM_read(memory, 0x37C0) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -164,10 +165,10 @@ static char *test_PPU_MEM_nametable1_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2400, 123);
 
-	mu_assert("Nametable 1 not set", memory->memory[0x2400] == 123);
-	mu_assert("Nametable 1 not mirrored in nametable 0", memory->memory[0x2000] == 123);
-	mu_assert("Nametable 1 not mirrored at 0x3400", memory->memory[0x3400] == 123);
-	mu_assert("Nametable 1 not mirrored at 0x3000", memory->memory[0x3000] == 123);
+	mu_assert("Nametable 1 not set", PPU_MEM_read(memory, 0x2400) == 123);
+	mu_assert("Nametable 1 not mirrored in nametable 0", PPU_MEM_read(memory, 0x2000) == 123);
+	mu_assert("Nametable 1 not mirrored at 0x3400", PPU_MEM_read(memory, 0x3400) == 123);
+	mu_assert("Nametable 1 not mirrored at 0x3000", PPU_MEM_read(memory, 0x3000) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -180,10 +181,10 @@ static char *test_PPU_MEM_attributetable1_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x27C0, 123);
 
-	mu_assert("Attrib table 1 not set", memory->memory[0x27C0] == 123);
-	mu_assert("Attrib table 1 not mirrored in Attrib table 0", memory->memory[0x23C0] == 123);
-	mu_assert("Attrib table 1 not mirrored at 0x37C0", memory->memory[0x37C0] == 123);
-	mu_assert("Attrib table 1 not mirrored at 0x33C0", memory->memory[0x33C0] == 123);
+	mu_assert("Attrib table 1 not set", PPU_MEM_read(memory, 0x27C0) == 123);
+	mu_assert("Attrib table 1 not mirrored in Attrib table 0", PPU_MEM_read(memory, 0x23C0) == 123);
+	mu_assert("Attrib table 1 not mirrored at 0x37C0", PPU_MEM_read(memory, 0x37C0) == 123);
+	mu_assert("Attrib table 1 not mirrored at 0x33C0", PPU_MEM_read(memory, 0x33C0) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -196,10 +197,10 @@ static char *test_PPU_MEM_nametable2_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2800, 123);
 
-	mu_assert("Nametable 2 not set", memory->memory[0x2800] == 123);
-	mu_assert("Nametable 2 not mirrored in nametable 3", memory->memory[0x2C00] == 123);
-	mu_assert("Nametable 2 not mirrored 0x3800", memory->memory[0x3800] == 123);
-	mu_assert("Nametable 2 not mirrored 0x3C00", memory->memory[0x3C00] == 123);
+	mu_assert("Nametable 2 not set", PPU_MEM_read(memory, 0x2800) == 123);
+	mu_assert("Nametable 2 not mirrored in nametable 3", PPU_MEM_read(memory, 0x2C00) == 123);
+	mu_assert("Nametable 2 not mirrored 0x3800", PPU_MEM_read(memory, 0x3800) == 123);
+	mu_assert("Nametable 2 not mirrored 0x3C00", PPU_MEM_read(memory, 0x3C00) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -212,10 +213,10 @@ static char *test_PPU_MEM_attributetable2_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2BC0, 123);
 
-	mu_assert("Attrib table 2 not set", memory->memory[0x2BC0] == 123);
-	mu_assert("Attrib table 2 not mirrored in Attrib table 3", memory->memory[0x2FC0] == 123);
-	mu_assert("Attrib table 2 not mirrored at 0x3BC0", memory->memory[0x3BC0] == 123);
-	mu_assert("Attrib table 2 mirrored at 0x3FC0", memory->memory[0x3FC0] != 123);
+	mu_assert("Attrib table 2 not set", PPU_MEM_read(memory, 0x2BC0) == 123);
+	mu_assert("Attrib table 2 not mirrored in Attrib table 3", PPU_MEM_read(memory, 0x2FC0) == 123);
+	mu_assert("Attrib table 2 not mirrored at 0x3BC0", PPU_MEM_read(memory, 0x3BC0) == 123);
+	mu_assert("Attrib table 2 mirrored at 0x3FC0", PPU_MEM_read(memory, 0x3FC0) != 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -228,10 +229,10 @@ static char *test_PPU_MEM_nametable3_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2C00, 123);
 
-	mu_assert("Nametable 3 not set", memory->memory[0x2C00] == 123);
-	mu_assert("Nametable 3 not mirrored in nametable 2", memory->memory[0x2800] == 123);
-	mu_assert("Nametable 3 not mirrored at 0x3C00", memory->memory[0x3C00] == 123);
-	mu_assert("Nametable 3 not mirrored at 0x3800", memory->memory[0x3800] == 123);
+	mu_assert("Nametable 3 not set", PPU_MEM_read(memory, 0x2C00) == 123);
+	mu_assert("Nametable 3 not mirrored in nametable 2", PPU_MEM_read(memory, 0x2800) == 123);
+	mu_assert("Nametable 3 not mirrored at 0x3C00", PPU_MEM_read(memory, 0x3C00) == 123);
+	mu_assert("Nametable 3 not mirrored at 0x3800", PPU_MEM_read(memory, 0x3800) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -244,10 +245,10 @@ static char *test_PPU_MEM_attributetable3_horizontal_mirroring()
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2FC0, 123);
 
-	mu_assert("Attrib table 3 not set", memory->memory[0x2FC0] == 123);
-	mu_assert("Attrib table 3 not mirrored in Attrib table 2", memory->memory[0x2BC0] == 123);
-	mu_assert("Attrib table 3 not mirrored at 0x3BC0", memory->memory[0x3BC0] == 123);
-	mu_assert("Attrib table 3 mirrored at 0x3FC0", memory->memory[0x3FC0] != 123);
+	mu_assert("Attrib table 3 not set", PPU_MEM_read(memory, 0x2FC0) == 123);
+	mu_assert("Attrib table 3 not mirrored in Attrib table 2", PPU_MEM_read(memory, 0x2BC0) == 123);
+	mu_assert("Attrib table 3 not mirrored at 0x3BC0", PPU_MEM_read(memory, 0x3BC0) == 123);
+	mu_assert("Attrib table 3 mirrored at 0x3FC0", PPU_MEM_read(memory, 0x3FC0) != 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -260,10 +261,10 @@ static char *test_PPU_MEM_nametable0_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2000, 123);
 
-	mu_assert("Nametable 0 not set", memory->memory[0x2000] == 123);
-	mu_assert("Nametable 0 not v-mirrored in nametable 2", memory->memory[0x2800] == 123);
-	mu_assert("Nametable 0 not v-mirrored at 0x3000", memory->memory[0x3000] == 123);
-	mu_assert("Nametable 0 not v-mirrored at 0x3800", memory->memory[0x3800] == 123);
+	mu_assert("Nametable 0 not set", PPU_MEM_read(memory, 0x2000) == 123);
+	mu_assert("Nametable 0 not v-mirrored in nametable 2", PPU_MEM_read(memory, 0x2800) == 123);
+	mu_assert("Nametable 0 not v-mirrored at 0x3000", PPU_MEM_read(memory, 0x3000) == 123);
+	mu_assert("Nametable 0 not v-mirrored at 0x3800", PPU_MEM_read(memory, 0x3800) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -276,10 +277,10 @@ static char *test_PPU_MEM_attributetable0_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x23C0, 123);
 
-	mu_assert("Attrib table 0 not set", memory->memory[0x23C0] == 123);
-	mu_assert("Attrib table 0 not v-mirrored in Attrib table 2", memory->memory[0x2BC0] == 123);
-	mu_assert("Attrib table 0 not v-mirrored at 0x33C0", memory->memory[0x33C0] == 123);
-	mu_assert("Attrib table 0 not v-mirrored at 0x3BC0", memory->memory[0x3BC0] == 123);
+	mu_assert("Attrib table 0 not set", PPU_MEM_read(memory, 0x23C0) == 123);
+	mu_assert("Attrib table 0 not v-mirrored in Attrib table 2", PPU_MEM_read(memory, 0x2BC0) == 123);
+	mu_assert("Attrib table 0 not v-mirrored at 0x33C0", PPU_MEM_read(memory, 0x33C0) == 123);
+	mu_assert("Attrib table 0 not v-mirrored at 0x3BC0", PPU_MEM_read(memory, 0x3BC0) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -292,10 +293,10 @@ static char *test_PPU_MEM_nametable1_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2400, 123);
 
-	mu_assert("Nametable 1 not set", memory->memory[0x2400] == 123);
-	mu_assert("Nametable 1 not v-mirrored in nametable 3", memory->memory[0x2C00] == 123);
-	mu_assert("Nametable 1 not v-mirrored at 0x3400", memory->memory[0x3400] == 123);
-	mu_assert("Nametable 1 not v-mirrored at 0x3C00", memory->memory[0x3C00] == 123);
+	mu_assert("Nametable 1 not set", PPU_MEM_read(memory, 0x2400) == 123);
+	mu_assert("Nametable 1 not v-mirrored in nametable 3", PPU_MEM_read(memory, 0x2C00) == 123);
+	mu_assert("Nametable 1 not v-mirrored at 0x3400", PPU_MEM_read(memory, 0x3400) == 123);
+	mu_assert("Nametable 1 not v-mirrored at 0x3C00", PPU_MEM_read(memory, 0x3C00) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -308,10 +309,10 @@ static char *test_PPU_MEM_attributetable1_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x27C0, 123);
 
-	mu_assert("Attrib table 1 not set", memory->memory[0x27C0] == 123);
-	mu_assert("Attrib table 1 not v-mirrored in Attrib table 3", memory->memory[0x2FC0] == 123);
-	mu_assert("Attrib table 1 not v-mirrored at 0x37C0", memory->memory[0x37C0] == 123);
-	mu_assert("Attrib table 1 v-mirrored at 0x3FC0", memory->memory[0x3FC0] != 123);
+	mu_assert("Attrib table 1 not set", PPU_MEM_read(memory, 0x27C0) == 123);
+	mu_assert("Attrib table 1 not v-mirrored in Attrib table 3", PPU_MEM_read(memory, 0x2FC0) == 123);
+	mu_assert("Attrib table 1 not v-mirrored at 0x37C0", PPU_MEM_read(memory, 0x37C0) == 123);
+	mu_assert("Attrib table 1 v-mirrored at 0x3FC0", PPU_MEM_read(memory, 0x3FC0) != 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -324,10 +325,10 @@ static char *test_PPU_MEM_nametable2_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2800, 123);
 
-	mu_assert("Nametable 2 not set", memory->memory[0x2800] == 123);
-	mu_assert("Nametable 2 not v-mirrored in nametable 0", memory->memory[0x2000] == 123);
-	mu_assert("Nametable 2 not v-mirrored at 0x3800", memory->memory[0x3800] == 123);
-	mu_assert("Nametable 2 not v-mirrored at 0x3000", memory->memory[0x3000] == 123);
+	mu_assert("Nametable 2 not set", PPU_MEM_read(memory, 0x2800) == 123);
+	mu_assert("Nametable 2 not v-mirrored in nametable 0", PPU_MEM_read(memory, 0x2000) == 123);
+	mu_assert("Nametable 2 not v-mirrored at 0x3800", PPU_MEM_read(memory, 0x3800) == 123);
+	mu_assert("Nametable 2 not v-mirrored at 0x3000", PPU_MEM_read(memory, 0x3000) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -340,10 +341,10 @@ static char *test_PPU_MEM_attributetable2_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2BC0, 123);
 
-	mu_assert("Attrib table 2 not set", memory->memory[0x2BC0] == 123);
-	mu_assert("Attrib table 2 not v-mirrored in Attrib table 0", memory->memory[0x23C0] == 123);
-	mu_assert("Attrib table 2 not v-mirrored at 0x3BC0", memory->memory[0x3BC0] == 123);
-	mu_assert("Attrib table 2 not v-mirrored at 0x33C0", memory->memory[0x33C0] == 123);
+	mu_assert("Attrib table 2 not set", PPU_MEM_read(memory, 0x2BC0) == 123);
+	mu_assert("Attrib table 2 not v-mirrored in Attrib table 0", PPU_MEM_read(memory, 0x23C0) == 123);
+	mu_assert("Attrib table 2 not v-mirrored at 0x3BC0", PPU_MEM_read(memory, 0x3BC0) == 123);
+	mu_assert("Attrib table 2 not v-mirrored at 0x33C0", PPU_MEM_read(memory, 0x33C0) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -356,10 +357,10 @@ static char *test_PPU_MEM_nametable3_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2C00, 123);
 
-	mu_assert("Nametable 3 not set", memory->memory[0x2C00] == 123);
-	mu_assert("Nametable 3 not v-mirrored in nametable 1", memory->memory[0x2400] == 123);
-	mu_assert("Nametable 3 not v-mirrored 0x3C00", memory->memory[0x3C00] == 123);
-	mu_assert("Nametable 3 not v-mirrored 0x3400", memory->memory[0x3400] == 123);
+	mu_assert("Nametable 3 not set", PPU_MEM_read(memory, 0x2C00) == 123);
+	mu_assert("Nametable 3 not v-mirrored in nametable 1", PPU_MEM_read(memory, 0x2400) == 123);
+	mu_assert("Nametable 3 not v-mirrored 0x3C00", PPU_MEM_read(memory, 0x3C00) == 123);
+	mu_assert("Nametable 3 not v-mirrored 0x3400", PPU_MEM_read(memory, 0x3400) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -372,10 +373,10 @@ static char *test_PPU_MEM_attributetable3_vertical_mirroring()
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2FC0, 123);
 
-	mu_assert("Attrib table 3 not set", memory->memory[0x2FC0] == 123);
-	mu_assert("Attrib table 3 not v-mirrored in Attrib table 1", memory->memory[0x27C0] == 123);
-	mu_assert("Attrib table 3 v-mirrored at 0x3FC0", memory->memory[0x3FC0] != 123);
-	mu_assert("Attrib table 3 not v-mirrored at 0x37C0", memory->memory[0x37C0] == 123);
+	mu_assert("Attrib table 3 not set", PPU_MEM_read(memory, 0x2FC0) == 123);
+	mu_assert("Attrib table 3 not v-mirrored in Attrib table 1", PPU_MEM_read(memory, 0x27C0) == 123);
+	mu_assert("Attrib table 3 v-mirrored at 0x3FC0", PPU_MEM_read(memory, 0x3FC0) != 123);
+	mu_assert("Attrib table 3 not v-mirrored at 0x37C0", PPU_MEM_read(memory, 0x37C0) == 123);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -387,12 +388,91 @@ static char *test_PPU_MEM_0x2F00_not_mirrored()
 
 	PPU_MEM_set_mirroring(memory, 0);
 	PPU_MEM_write(memory, 0x2F00, 123);
-	mu_assert("0x2F00 should not be h-mirrored to 0x3F00", memory->memory[0x3F00] != 123);
+	mu_assert("0x2F00 should not be h-mirrored to 0x3F00", PPU_MEM_read(memory, 0x3F00) != 123);
 
 
 	PPU_MEM_set_mirroring(memory, 1);
 	PPU_MEM_write(memory, 0x2F00, 123);
-	mu_assert("0x2F00 should not be v-mirrored to 0x3F00", memory->memory[0x3F00] != 123);
+	mu_assert("0x2F00 should not be v-mirrored to 0x3F00", PPU_MEM_read(memory, 0x3F00) != 123);
+
+	PPU_MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_PPU_MEM_change_mirroring()
+{
+	memory = PPU_MEM_init();
+
+	PPU_MEM_set_mirroring(memory, 0);
+	PPU_MEM_write(memory, 0x2400, 123);
+	PPU_MEM_write(memory, 0x2800, 45);
+
+	/* The same two tables, seen the other way */
+	PPU_MEM_set_mirroring(memory, 1);
+	mu_assert("Nametable 0 lost on mirroring change", PPU_MEM_read(memory, 0x2000) == 123);
+	mu_assert("Nametable 2 not remapped", PPU_MEM_read(memory, 0x2800) == 123);
+	mu_assert("Nametable 1 not remapped", PPU_MEM_read(memory, 0x2400) == 45);
+	mu_assert("Nametable 3 not remapped", PPU_MEM_read(memory, 0x2C00) == 45);
+
+	/* Writes to 0x3F10 land in 0x3F00 as well */
+	PPU_MEM_write(memory, 0x3F10, 67);
+	mu_assert("0x3F10 not mirrored to 0x3F00", PPU_MEM_read(memory, 0x3F00) == 67);
+
+	PPU_MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_PPU_MEM_tile_row()
+{
+	static const uint8_t rom[CHR_BANK_SIZE] = {[0x13] = 0xF0, [0x1B] = 0x3C};
+	const uint8_t row[8] = {1, 1, 3, 3, 2, 2, 0, 0};
+	const uint8_t flipped[8] = {0, 0, 2, 2, 3, 3, 1, 1};
+
+	memory = PPU_MEM_init();
+
+	/* Tile 1 of the second pattern table, row 3 */
+	PPU_MEM_write(memory, 0x1013, 0xF0);
+	PPU_MEM_write(memory, 0x101B, 0x3C);
+	mu_assert("row not decoded", memcmp(PPU_MEM_tile_row(memory, 0x1013, 0), row, 8) == 0);
+	mu_assert("row not flipped", memcmp(PPU_MEM_tile_row(memory, 0x1013, 1), flipped, 8) == 0);
+
+	/* Writing CHR RAM decodes the tile again */
+	PPU_MEM_write(memory, 0x101B, 0x00);
+	mu_assert("stale row after write", PPU_MEM_tile_row(memory, 0x1013, 0)[2] == 1);
+
+	/* So does mapping a bank, into either pattern table */
+	PPU_MEM_map_chr(memory, 4, rom);
+	mu_assert("stale row after map", memcmp(PPU_MEM_tile_row(memory, 0x1013, 0), row, 8) == 0);
+	PPU_MEM_map_chr(memory, 4, NULL);
+	mu_assert("stale row after unmap", PPU_MEM_tile_row(memory, 0x1013, 0)[2] == 1);
+
+	PPU_MEM_delete(&memory);
+	return 0;
+}
+
+static char *test_PPU_MEM_load_chr_rom()
+{
+	static const uint8_t rom[2 * CHR_BANK_SIZE] = {[CHR_BANK_SIZE + 0x13] = 0xF0, [CHR_BANK_SIZE + 0x1B] = 0x3C};
+	const uint8_t row[8] = {1, 1, 3, 3, 2, 2, 0, 0};
+	const uint8_t flipped[8] = {0, 0, 2, 2, 3, 3, 1, 1};
+
+	memory = PPU_MEM_init();
+	PPU_MEM_load_chr_rom(memory, rom, sizeof(rom));
+
+	/* Every tile is decoded up front, keyed by its offset in the ROM */
+	mu_assert("rom not decoded", memcmp(memory->rom_tiles[(CHR_BANK_SIZE + 0x10) / 16][0][3], row, 8) == 0);
+	mu_assert("rom not flipped", memcmp(memory->rom_tiles[(CHR_BANK_SIZE + 0x10) / 16][1][3], flipped, 8) == 0);
+
+	/* Windows share the decoded tiles of the bank they map */
+	PPU_MEM_map_chr(memory, 0, &rom[CHR_BANK_SIZE]);
+	PPU_MEM_map_chr(memory, 4, &rom[CHR_BANK_SIZE]);
+	mu_assert("row not from rom", memcmp(PPU_MEM_tile_row(memory, 0x1013, 0), row, 8) == 0);
+	mu_assert("windows not shared", PPU_MEM_tile_row(memory, 0x0013, 1) == PPU_MEM_tile_row(memory, 0x1013, 1));
+	mu_assert("rom tile decoded again", PPU_MEM_tile_row(memory, 0x1013, 0) == memory->rom_tiles[(CHR_BANK_SIZE + 0x10) / 16][0][3]);
+
+	/* Switching to another bank of the ROM needs no decoding either */
+	PPU_MEM_map_chr(memory, 4, rom);
+	mu_assert("stale row after switch", PPU_MEM_tile_row(memory, 0x1013, 0) == memory->rom_tiles[1][0][3]);
 
 	PPU_MEM_delete(&memory);
 	return 0;
@@ -434,6 +514,9 @@ static char *all_tests()
 	mu_run_test(test_PPU_MEM_attributetable3_vertical_mirroring);
 
 	mu_run_test(test_PPU_MEM_0x2F00_not_mirrored);
+	mu_run_test(test_PPU_MEM_change_mirroring);
+	mu_run_test(test_PPU_MEM_tile_row);
+	mu_run_test(test_PPU_MEM_load_chr_rom);
 
 	//mu_run_test(test_PPU_MEM_load_vrom);
 
@@ -0,0 +1,188 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_ppu_oam.c
+ *
+ *    Description:  Tests for PPU OAM and sprite evaluation
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:04:51 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ppu_oam_memory.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+int tests_run = 0;
+
+struct ppu_oam_memory *oam;
+
+static void write_sprite(const uint8_t sprite, const uint8_t y, const uint8_t index, const uint8_t attribute, const uint8_t x)
+{
+	PPU_OAM_write(oam, sprite * 4, y);
+	PPU_OAM_write(oam, sprite * 4 + 1, index);
+	PPU_OAM_write(oam, sprite * 4 + 2, attribute);
+	PPU_OAM_write(oam, sprite * 4 + 3, x);
+}
+
+static char *test_PPU_OAM_init()
+{
+	oam = PPU_OAM_init();
+	mu_assert("OAM is NULL!", oam != NULL);
+	mu_assert("sprite on screen", PPU_OAM_read(oam, 0) == 0xFF);
+	mu_assert("sprite in range", PPU_OAM_evaluate(oam, 0, 16) == 0);
+	PPU_OAM_delete(&oam);
+	mu_assert("OAM is not NULL!", oam == NULL);
+
+	return 0;
+}
+
+static char *test_PPU_OAM_read_write()
+{
+	oam = PPU_OAM_init();
+
+	write_sprite(5, 10, 0x42, 0xFF, 200);
+	mu_assert("Y not written", PPU_OAM_read(oam, 20) == 10);
+	mu_assert("tile not written", PPU_OAM_read(oam, 21) == 0x42);
+	mu_assert("unused attribute bits kept", PPU_OAM_read(oam, 22) == 0xE3);
+	mu_assert("X not written", PPU_OAM_read(oam, 23) == 200);
+
+	PPU_OAM_delete(&oam);
+	return 0;
+}
+
+static char *test_PPU_OAM_evaluate()
+{
+	const struct oam_data *secondary;
+
+	oam = PPU_OAM_init();
+
+	write_sprite(0, 20, 1, 0, 0);
+	write_sprite(7, 24, 2, 0, 0);
+	write_sprite(3, 28, 3, 0, 0);
+
+	/* In OAM order, 8 or 16 lines from Y */
+	mu_assert("sprite found above", PPU_OAM_evaluate(oam, 19, 8) == 0);
+	mu_assert("wrong sprites", PPU_OAM_evaluate(oam, 28, 8) == 2);
+	mu_assert("not in OAM order", PPU_OAM_secondary(oam)[0].index == 3);
+	mu_assert("wrong sprites", PPU_OAM_evaluate(oam, 27, 8) == (2 | PPU_OAM_SPRITE_0));
+	secondary = PPU_OAM_secondary(oam);
+	mu_assert("not in order", secondary[0].index == 1 && secondary[1].index == 2);
+	mu_assert("secondary not cleared", secondary[2].y_pos == 0xFF && secondary[7].x_pos == 0xFF);
+	mu_assert("8x16 bottom missed", PPU_OAM_evaluate(oam, 35, 16) == (3 | PPU_OAM_SPRITE_0));
+	mu_assert("8x8 bottom found", PPU_OAM_evaluate(oam, 35, 8) == 1);
+	mu_assert("wrong count", PPU_OAM_count(oam, 28, 16) == 3);
+
+	/* Moving a sprite moves its lines */
+	PPU_OAM_write(oam, 0, 100);
+	mu_assert("sprite not moved off", PPU_OAM_evaluate(oam, 27, 8) == 1);
+	mu_assert("sprite not moved on", PPU_OAM_evaluate(oam, 100, 8) == (1 | PPU_OAM_SPRITE_0));
+
+	PPU_OAM_delete(&oam);
+	return 0;
+}
+
+static char *test_PPU_OAM_overflow()
+{
+	int i;
+
+	oam = PPU_OAM_init();
+
+	/* 8 sprites on a line is not an overflow */
+	for (i = 0; i < 8; i++) {
+		write_sprite(i, 50, 0, 0, 0);
+	}
+	mu_assert("overflow with 8", PPU_OAM_evaluate(oam, 50, 8) == (8 | PPU_OAM_SPRITE_0));
+
+	/* A 9th is, found by its Y */
+	write_sprite(8, 50, 0, 0, 0);
+	mu_assert("no overflow with 9", PPU_OAM_evaluate(oam, 50, 8) == (8 | PPU_OAM_OVERFLOW | PPU_OAM_SPRITE_0));
+	mu_assert("wrong count", PPU_OAM_count(oam, 50, 8) == 9);
+
+	/* After sprite 8, the PPU reads the tile of sprite 9 as a Y... */
+	write_sprite(8, 0xFF, 0, 0, 0);
+	write_sprite(9, 0xFF, 50, 0, 0);
+	mu_assert("overflow bug missed", PPU_OAM_evaluate(oam, 50, 8) & PPU_OAM_OVERFLOW);
+
+	/* ...and so misses the Y of sprite 10 */
+	write_sprite(9, 0xFF, 0, 0, 0);
+	write_sprite(10, 50, 0, 0, 0);
+	mu_assert("overflow bug not copied", (PPU_OAM_evaluate(oam, 50, 8) & PPU_OAM_OVERFLOW) == 0);
+
+	PPU_OAM_delete(&oam);
+	return 0;
+}
+
+static char *test_PPU_OAM_write_page()
+{
+	struct ppu_oam_memory *bytes;
+	uint8_t page[PPU_OAM_SIZE];
+	int addr, i, line;
+
+	for (i = 0; i < PPU_OAM_SIZE; i++) {
+		page[i] = (i * 37 + 11) & 0xFF;
+	}
+
+	/* Aligned and unaligned, onto OAM that has sprites already */
+	for (addr = 0; addr < 8; addr++) {
+		oam = PPU_OAM_init();
+		bytes = PPU_OAM_init();
+		for (i = 0; i < PPU_OAM_SIZE; i++) {
+			PPU_OAM_write(oam, i, i & 0x7F);
+			PPU_OAM_write(bytes, i, i & 0x7F);
+		}
+
+		PPU_OAM_write_page(oam, addr, page);
+		for (i = 0; i < PPU_OAM_SIZE; i++) {
+			PPU_OAM_write(bytes, addr + i, page[i]);
+		}
+
+		for (i = 0; i < PPU_OAM_SIZE; i++) {
+			mu_assert("write page - wrong byte", PPU_OAM_read(oam, i) == PPU_OAM_read(bytes, i));
+		}
+		for (line = 0; line < 256; line++) {
+			mu_assert("write page - wrong lines", PPU_OAM_evaluate(oam, line, 16) == PPU_OAM_evaluate(bytes, line, 16));
+			mu_assert("write page - wrong lines", PPU_OAM_count(oam, line, 8) == PPU_OAM_count(bytes, line, 8));
+		}
+
+		PPU_OAM_delete(&oam);
+		PPU_OAM_delete(&bytes);
+	}
+
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_PPU_OAM_init);
+	mu_run_test(test_PPU_OAM_read_write);
+	mu_run_test(test_PPU_OAM_evaluate);
+	mu_run_test(test_PPU_OAM_overflow);
+	mu_run_test(test_PPU_OAM_write_page);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_render.c
+ *
+ *    Description:  Tests for the presentation of frames, with SDL's dummy
+ *                  video driver
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:48:16 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "render.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+int tests_run = 0;
+
+struct render *render;
+
+uint8_t framebuffer[PPU_SCREEN_HEIGHT * PPU_SCREEN_WIDTH];
+uint8_t palette_ram[PALETTE_RAM_SIZE];
+uint8_t masks[PPU_SCREEN_HEIGHT];
+
+static char *test_RENDER_init()
+{
+	render = RENDER_init("test_render");
+	mu_assert("render is NULL!", render != NULL);
+	mu_assert("frames presented", RENDER_frames_presented(render) == 0);
+	RENDER_delete(&render);
+	mu_assert("render is not NULL!", render == NULL);
+
+	return 0;
+}
+
+/*
+ * With nothing presenting frames, the ring fills and then drops them
+ */
+static char *test_RENDER_submit()
+{
+	struct render *r = calloc(1, sizeof(struct render));
+	int i;
+
+	r->submitted = SDL_CreateSemaphore(0);
+	for (i = 0; i < RING_SIZE; i++) {
+		framebuffer[0] = i;
+		masks[PPU_SCREEN_HEIGHT - 1] = i;
+		mu_assert("frame dropped", RENDER_submit(r, framebuffer, palette_ram, masks) == 1);
+	}
+	mu_assert("full ring - frame not dropped", RENDER_submit(r, framebuffer, palette_ram, masks) == 0);
+	mu_assert("full ring - dropped", RENDER_frames_dropped(r) == 1);
+	mu_assert("frames in order", r->frames[1].pixels[0] == 1 && r->frames[1].masks[PPU_SCREEN_HEIGHT - 1] == 1);
+
+	// Taking one frame frees its slot, which the next frame goes in
+	atomic_store(&r->tail, 1);
+	framebuffer[0] = 0xAB;
+	mu_assert("free slot - frame dropped", RENDER_submit(r, framebuffer, palette_ram, masks) == 1);
+	mu_assert("free slot - wrong slot", r->frames[0].pixels[0] == 0xAB);
+	mu_assert("free slot - head", atomic_load(&r->head) == RING_SIZE + 1);
+
+	SDL_DestroySemaphore(r->submitted);
+	free(r);
+
+	return 0;
+}
+
+/*
+ * Frames submitted from another thread, as the emulation thread does
+ */
+static int submit_frames(void *data)
+{
+	unsigned int *submitted = data;
+	int i;
+
+	for (i = 0; i < 60; i++) {
+		*submitted += RENDER_submit(render, framebuffer, palette_ram, masks);
+		SDL_Delay(1);
+	}
+	return 0;
+}
+
+/*
+ * Every frame submitted is either shown, on the thread that made the window,
+ * or dropped
+ */
+static char *test_RENDER_present()
+{
+	unsigned int submitted = 0;
+	SDL_Thread *thread;
+	int idle = 0;
+
+	render = RENDER_init("test_render");
+	mu_assert("render is NULL!", render != NULL);
+	mu_assert("nothing to present", RENDER_present(render, 0) == 0);
+
+	thread = SDL_CreateThread(submit_frames, "submit", &submitted);
+	mu_assert("thread is NULL!", thread != NULL);
+	// Until a while after the last frame
+	while (idle < 10) {
+		idle = RENDER_present(render, 10) != 0 ? 0 : idle + 1;
+	}
+	SDL_WaitThread(thread, NULL);
+	mu_assert("no frames presented", RENDER_frames_presented(render) > 0);
+	mu_assert("frames lost", RENDER_frames_presented(render) == submitted);
+	mu_assert("frames not counted", submitted + RENDER_frames_dropped(render) == 60);
+	RENDER_delete(&render);
+
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_RENDER_init);
+	mu_run_test(test_RENDER_submit);
+	mu_run_test(test_RENDER_present);
+
+	return 0;
+}
+
+int main()
+{
+	char *result;
+
+	SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+		(void) printf("Could not start SDL: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	SDL_Quit();
+	return result != 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  test_scheduler.c
+ *
+ *    Description:  Tests for the scheduler
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:40:13 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Alan Kydd (), akydd@ualberta.net
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "scheduler.c"
+
+
+#define mu_assert(message, test) do { if (!(test)) return message; } while (0)
+#define mu_run_test(test) do { char *message = test(); tests_run++; \
+	if (message) return message; } while (0)
+
+int tests_run = 0;
+
+struct scheduler *sched;
+
+static char *test_SCHED_init()
+{
+	sched = SCHED_init();
+	mu_assert("scheduler is NULL!", sched != NULL);
+	mu_assert("clock does not start at 0", SCHED_now(sched) == 0);
+	mu_assert("event pending", SCHED_next_time(sched) == SCHED_NEVER);
+	mu_assert("event due", SCHED_pop(sched) == -1);
+	SCHED_delete(&sched);
+	mu_assert("scheduler is not NULL!", sched == NULL);
+
+	return 0;
+}
+
+static char *test_SCHED_events_in_time_order()
+{
+	sched = SCHED_init();
+
+	SCHED_add(sched, SCHED_FRAME_END, 300);
+	SCHED_add(sched, SCHED_NMI, 100);
+	SCHED_add(sched, SCHED_DMA, 200);
+	mu_assert("wrong next time", SCHED_next_time(sched) == 100);
+	mu_assert("event due early", SCHED_pop(sched) == -1);
+
+	SCHED_advance(sched, 250);
+	mu_assert("NMI not first", SCHED_pop(sched) == SCHED_NMI);
+	mu_assert("DMA not second", SCHED_pop(sched) == SCHED_DMA);
+	mu_assert("frame end due early", SCHED_pop(sched) == -1);
+	mu_assert("wrong next time after pop", SCHED_next_time(sched) == 300);
+
+	/* Replacing and removing */
+	SCHED_add(sched, SCHED_FRAME_END, 400);
+	mu_assert("event not replaced", SCHED_next_time(sched) == 400);
+	SCHED_remove(sched, SCHED_FRAME_END);
+	mu_assert("event not removed", SCHED_next_time(sched) == SCHED_NEVER);
+
+	SCHED_delete(&sched);
+	return 0;
+}
+
+static char *test_SCHED_cpu_cycles_to_next()
+{
+	sched = SCHED_init();
+
+	/* Rounded up to whole CPU cycles */
+	SCHED_add(sched, SCHED_NMI, 10 * SCHED_TICKS_PER_CPU_CYCLE + 1);
+	mu_assert("not rounded up", SCHED_cpu_cycles_to_next(sched) == 11);
+	SCHED_advance(sched, 11 * SCHED_TICKS_PER_CPU_CYCLE);
+	mu_assert("past event not 1 cycle", SCHED_cpu_cycles_to_next(sched) == 1);
+
+	/* 64 bit clock */
+	SCHED_advance(sched, 1ULL << 40);
+	SCHED_add(sched, SCHED_NMI, SCHED_now(sched) + 3 * SCHED_TICKS_PER_CPU_CYCLE);
+	mu_assert("clock wrapped", SCHED_cpu_cycles_to_next(sched) == 3);
+
+	SCHED_delete(&sched);
+	return 0;
+}
+
+static char *all_tests()
+{
+	mu_run_test(test_SCHED_init);
+	mu_run_test(test_SCHED_events_in_time_order);
+	mu_run_test(test_SCHED_cpu_cycles_to_next);
+
+	return 0;
+}
+
+int main()
+{
+	char *result = all_tests();
+	if (result != 0) {
+		(void) printf("%s\n", result);
+	} else {
+		(void) printf("All tests passed!\n");
+	}
+	(void) printf("Tests run: %d\n", tests_run);
+
+	return result != 0;
+}